@@ -0,0 +1,787 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <json-glib/json-glib.h>
+#include <ufo/ufo.h>
+#include "ufo/compat.h"
+
+#define RESULTS_VERSION 1
+
+typedef struct {
+    const gchar *name;
+    const gchar *unit;
+    gboolean higher_is_better;
+    gboolean (*run) (gconstpointer data, gdouble *value, GError **error);
+    gconstpointer data;
+} Benchmark;
+
+typedef struct {
+    const gchar *name;
+    const gchar *unit;
+    gboolean higher_is_better;
+    gdouble median;
+    gdouble min;
+    gdouble max;
+    guint n_runs;
+} Result;
+
+static GQuark
+bench_error_quark (void)
+{
+    return g_quark_from_static_string ("ufo-bench-error-quark");
+}
+
+static gdouble
+now (void)
+{
+    return g_get_monotonic_time () / 1e6;
+}
+
+/* Two-way queues */
+
+#define N_HANDOFFS  100000
+
+typedef struct {
+    UfoTwoWayQueue *ping;
+    UfoTwoWayQueue *pong;
+    guint n_items;
+} QueuePair;
+
+static gpointer
+pong_loop (QueuePair *pair)
+{
+    for (guint i = 0; i < pair->n_items; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_consumer_pop (pair->ping);
+        ufo_two_way_queue_consumer_push (pair->ping, item);
+        item = ufo_two_way_queue_producer_pop (pair->pong);
+        ufo_two_way_queue_producer_push (pair->pong, item);
+    }
+
+    return NULL;
+}
+
+static gboolean
+bench_queue_latency (gconstpointer data, gdouble *value, GError **error)
+{
+    QueuePair pair;
+    GList *items;
+    GThread *thread;
+    gdouble start;
+
+    items = g_list_append (NULL, GINT_TO_POINTER (1));
+    pair.ping = ufo_two_way_queue_new (items);
+    pair.pong = ufo_two_way_queue_new (items);
+    pair.n_items = N_HANDOFFS / 2;
+    g_list_free (items);
+
+    start = now ();
+    thread = g_thread_create ((GThreadFunc) pong_loop, &pair, TRUE, error);
+
+    if (thread == NULL)
+        return FALSE;
+
+    for (guint i = 0; i < pair.n_items; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_producer_pop (pair.ping);
+        ufo_two_way_queue_producer_push (pair.ping, item);
+        item = ufo_two_way_queue_consumer_pop (pair.pong);
+        ufo_two_way_queue_consumer_push (pair.pong, item);
+    }
+
+    g_thread_join (thread);
+    *value = (now () - start) / N_HANDOFFS * 1e6;
+
+    ufo_two_way_queue_free (pair.ping);
+    ufo_two_way_queue_free (pair.pong);
+    return TRUE;
+}
+
+static gpointer
+produce_loop (QueuePair *pair)
+{
+    for (guint i = 0; i < pair->n_items; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_producer_pop (pair->ping);
+        ufo_two_way_queue_producer_push (pair->ping, item);
+    }
+
+    return NULL;
+}
+
+static gboolean
+bench_queue_throughput (gconstpointer data, gdouble *value, GError **error)
+{
+    QueuePair pair;
+    GList *items = NULL;
+    GThread *thread;
+    gdouble start;
+
+    for (guint i = 0; i < 16; i++)
+        items = g_list_append (items, GUINT_TO_POINTER (i + 1));
+
+    pair.ping = ufo_two_way_queue_new (items);
+    pair.n_items = N_HANDOFFS;
+    g_list_free (items);
+
+    start = now ();
+    thread = g_thread_create ((GThreadFunc) produce_loop, &pair, TRUE, error);
+
+    if (thread == NULL)
+        return FALSE;
+
+    for (guint i = 0; i < pair.n_items; i++) {
+        gpointer item;
+
+        item = ufo_two_way_queue_consumer_pop (pair.ping);
+        ufo_two_way_queue_consumer_push (pair.ping, item);
+    }
+
+    g_thread_join (thread);
+    *value = pair.n_items / (now () - start);
+
+    ufo_two_way_queue_free (pair.ping);
+    return TRUE;
+}
+
+/* Groups */
+
+#define N_TARGETS   4
+
+static gboolean
+bench_group (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoSendPattern pattern;
+    UfoGroup *group;
+    UfoRequisition requisition;
+    GList *targets = NULL;
+    GList *it;
+    guint n_items;
+    gdouble start;
+
+    pattern = (UfoSendPattern) GPOINTER_TO_INT (data);
+    n_items = pattern == UFO_SEND_SCATTER ? 100000 : 2000;
+
+    for (guint i = 0; i < N_TARGETS; i++)
+        targets = g_list_append (targets, ufo_dummy_task_new ());
+
+    /* Broadcasting copies every item, 1 MB frames make that cost visible */
+    requisition.n_dims = 2;
+    requisition.dims[0] = 512;
+    requisition.dims[1] = 512;
+
+    group = ufo_group_new (targets, NULL, pattern);
+    start = now ();
+
+    for (guint i = 0; i < n_items; i++) {
+        UfoBuffer *buffer;
+
+        buffer = ufo_group_pop_output_buffer (group, &requisition);
+        ufo_group_push_output_buffer (group, buffer);
+
+        if (pattern == UFO_SEND_SCATTER) {
+            UfoTask *target = UFO_TASK (g_list_nth_data (targets, i % N_TARGETS));
+
+            buffer = ufo_group_pop_input_buffer (group, target);
+            ufo_group_push_input_buffer (group, target, buffer);
+        }
+        else {
+            g_list_for (targets, it) {
+                buffer = ufo_group_pop_input_buffer (group, UFO_TASK (it->data));
+                ufo_group_push_input_buffer (group, UFO_TASK (it->data), buffer);
+            }
+        }
+    }
+
+    *value = n_items / (now () - start);
+
+    g_object_unref (group);
+    g_list_free_full (targets, g_object_unref);
+    return TRUE;
+}
+
+/* Buffers */
+
+static gboolean
+bench_buffer_convert (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoBufferDepth depth;
+    UfoBuffer *buffer;
+    UfoRequisition requisition;
+    const guint n_frames = 50;
+    gdouble start;
+
+    depth = (UfoBufferDepth) GPOINTER_TO_INT (data);
+    requisition.n_dims = 2;
+    requisition.dims[0] = 2048;
+    requisition.dims[1] = 2048;
+
+    buffer = ufo_buffer_new (&requisition, NULL);
+    memset (ufo_buffer_get_host_array (buffer, NULL), 0, ufo_buffer_get_size (buffer));
+    start = now ();
+
+    /* Converting in place reinterprets the previous result, which does not
+     * matter for the run time of the integer conversions */
+    for (guint i = 0; i < n_frames; i++)
+        ufo_buffer_convert (buffer, depth);
+
+    *value = n_frames * 2048 * 2048 / (now () - start) / 1e6;
+
+    g_object_unref (buffer);
+    return TRUE;
+}
+
+static gboolean
+bench_buffer_copy_metadata (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoBuffer *src;
+    UfoBuffer *dst;
+    UfoRequisition requisition;
+    GValue number = {0};
+    GValue text = {0};
+    const guint n_copies = 20000;
+    gdouble start;
+
+    requisition.n_dims = 1;
+    requisition.dims[0] = 1;
+    src = ufo_buffer_new (&requisition, NULL);
+    dst = ufo_buffer_new (&requisition, NULL);
+
+    g_value_init (&number, G_TYPE_DOUBLE);
+    g_value_init (&text, G_TYPE_STRING);
+
+    /* About as many entries as readers attach to a frame */
+    for (guint i = 0; i < 8; i++) {
+        gchar *name;
+
+        name = g_strdup_printf ("number-%i", i);
+        g_value_set_double (&number, i);
+        ufo_buffer_set_metadata (src, name, &number);
+        g_free (name);
+
+        name = g_strdup_printf ("text-%i", i);
+        g_value_set_string (&text, name);
+        ufo_buffer_set_metadata (src, name, &text);
+        g_free (name);
+    }
+
+    start = now ();
+
+    for (guint i = 0; i < n_copies; i++)
+        ufo_buffer_copy_metadata (src, dst);
+
+    *value = (now () - start) / n_copies * 1e6;
+
+    g_value_unset (&number);
+    g_value_unset (&text);
+    g_object_unref (src);
+    g_object_unref (dst);
+    return TRUE;
+}
+
+/* Graphs */
+
+#define N_NODES     1000
+
+static gboolean
+bench_graph_setup (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoTaskGraph *graph;
+    UfoTaskNode *previous;
+    GList *roots;
+    GList *leaves;
+    gdouble start;
+
+    start = now ();
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    previous = UFO_TASK_NODE (ufo_dummy_task_new ());
+
+    for (guint i = 1; i < N_NODES; i++) {
+        UfoTaskNode *next;
+
+        next = UFO_TASK_NODE (ufo_dummy_task_new ());
+        ufo_task_graph_connect_nodes (graph, previous, next);
+        g_object_unref (previous);
+        previous = next;
+    }
+
+    g_object_unref (previous);
+
+    roots = ufo_graph_get_roots (UFO_GRAPH (graph));
+    leaves = ufo_graph_get_leaves (UFO_GRAPH (graph));
+    *value = (now () - start) * 1e3;
+
+    g_list_free (roots);
+    g_list_free (leaves);
+    g_object_unref (graph);
+    return TRUE;
+}
+
+static gchar *
+make_json_chain (guint n_nodes)
+{
+    GString *json;
+
+    json = g_string_new ("{\"nodes\": [");
+
+    for (guint i = 0; i < n_nodes; i++)
+        g_string_append_printf (json, "%s{\"plugin\": \"[dummy]\", \"name\": \"n%i\"}",
+                                i > 0 ? ", " : "", i);
+
+    g_string_append (json, "], \"edges\": [");
+
+    for (guint i = 1; i < n_nodes; i++)
+        g_string_append_printf (json, "%s{\"from\": {\"name\": \"n%i\"}, \"to\": {\"name\": \"n%i\"}}",
+                                i > 1 ? ", " : "", i - 1, i);
+
+    g_string_append (json, "]}");
+    return g_string_free (json, FALSE);
+}
+
+static gboolean
+bench_json_parse (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoPluginManager *manager;
+    UfoTaskGraph *graph;
+    gchar *json;
+    GError *tmp_error = NULL;
+    gdouble start;
+
+    json = make_json_chain (N_NODES);
+    manager = ufo_plugin_manager_new ();
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+
+    start = now ();
+    ufo_task_graph_read_from_data (graph, manager, json, &tmp_error);
+    *value = (now () - start) * 1e3;
+
+    g_object_unref (graph);
+    g_object_unref (manager);
+    g_free (json);
+
+    if (tmp_error != NULL) {
+        g_propagate_error (error, tmp_error);
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gboolean
+bench_graph_expand (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoGraph *graph;
+    UfoNode *nodes[N_NODES / 4];
+    GList *path = NULL;
+    const guint n_nodes = N_NODES / 4;
+    const guint n_copies = 4;
+    gdouble start;
+
+    graph = ufo_graph_new ();
+
+    for (guint i = 0; i < n_nodes; i++) {
+        nodes[i] = ufo_dummy_task_new ();
+        path = g_list_append (path, nodes[i]);
+
+        if (i > 0)
+            ufo_graph_connect_nodes (graph, nodes[i - 1], nodes[i], NULL);
+    }
+
+    start = now ();
+
+    for (guint i = 1; i < n_copies; i++) {
+        /* The graph releases inner nodes of the path once per expansion */
+        for (guint j = 1; j < n_nodes - 1; j++)
+            g_object_ref (nodes[j]);
+
+        ufo_graph_expand (graph, path);
+    }
+
+    *value = (now () - start) * 1e3;
+
+    g_list_free (path);
+    g_object_unref (graph);
+
+    for (guint i = 0; i < n_nodes; i++)
+        g_object_unref (nodes[i]);
+
+    return TRUE;
+}
+
+/* Pipelines */
+
+static UfoTaskNode *
+make_stage (const gchar *mode, guint n_items)
+{
+    UfoNode *node;
+
+    /* Small empty items so that nothing but the runtime is measured */
+    node = ufo_synthetic_task_new ();
+    g_object_set (node, "mode", mode, "number", n_items, "width", 32, "height", 32, NULL);
+    return UFO_TASK_NODE (node);
+}
+
+static gboolean
+bench_pipeline (gconstpointer data, gdouble *value, GError **error)
+{
+    UfoResources *resources;
+    UfoBaseScheduler *scheduler;
+    UfoTaskGraph *graph;
+    UfoTaskNode *previous;
+    guint n_stages;
+    const guint n_items = 5000;
+    gboolean success;
+    gdouble start;
+
+    n_stages = GPOINTER_TO_UINT (data);
+    resources = ufo_resources_new (error);
+
+    if (resources == NULL)
+        return FALSE;
+
+    graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
+    previous = make_stage ("generator", n_items);
+
+    for (guint i = 1; i < n_stages; i++) {
+        UfoTaskNode *next;
+
+        next = make_stage (i < n_stages - 1 ? "processor" : "sink", 0);
+        ufo_task_graph_connect_nodes (graph, previous, next);
+        g_object_unref (previous);
+        previous = next;
+    }
+
+    g_object_unref (previous);
+
+    scheduler = ufo_scheduler_new ();
+    ufo_base_scheduler_set_resources (scheduler, resources);
+
+    start = now ();
+    ufo_base_scheduler_run (scheduler, graph, error);
+    *value = n_items / (now () - start);
+    success = error == NULL || *error == NULL;
+
+    g_object_unref (scheduler);
+    g_object_unref (graph);
+    g_object_unref (resources);
+    return success;
+}
+
+static const Benchmark benchmarks[] = {
+    { "queue/handoff-latency",  "us",       FALSE, bench_queue_latency, NULL },
+    { "queue/throughput",       "items/s",  TRUE,  bench_queue_throughput, NULL },
+    { "group/scatter",          "items/s",  TRUE,  bench_group, GINT_TO_POINTER (UFO_SEND_SCATTER) },
+    { "group/broadcast",        "items/s",  TRUE,  bench_group, GINT_TO_POINTER (UFO_SEND_BROADCAST) },
+    { "buffer/convert-8u",      "Mpx/s",    TRUE,  bench_buffer_convert, GINT_TO_POINTER (UFO_BUFFER_DEPTH_8U) },
+    { "buffer/convert-16u",     "Mpx/s",    TRUE,  bench_buffer_convert, GINT_TO_POINTER (UFO_BUFFER_DEPTH_16U) },
+    { "buffer/copy-metadata",   "us",       FALSE, bench_buffer_copy_metadata, NULL },
+    { "graph/setup",            "ms",       FALSE, bench_graph_setup, NULL },
+    { "graph/expand",           "ms",       FALSE, bench_graph_expand, NULL },
+    { "json/parse",             "ms",       FALSE, bench_json_parse, NULL },
+    { "pipeline/stages-2",      "items/s",  TRUE,  bench_pipeline, GUINT_TO_POINTER (2) },
+    { "pipeline/stages-8",      "items/s",  TRUE,  bench_pipeline, GUINT_TO_POINTER (8) },
+    { "pipeline/stages-32",     "items/s",  TRUE,  bench_pipeline, GUINT_TO_POINTER (32) },
+    { NULL }
+};
+
+static gint
+cmp_double (gconstpointer a, gconstpointer b)
+{
+    gdouble x = *((const gdouble *) a);
+    gdouble y = *((const gdouble *) b);
+
+    return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+static gboolean
+run_benchmark (const Benchmark *benchmark, guint n_runs, Result *result, GError **error)
+{
+    gdouble values[n_runs];
+    gdouble dummy;
+
+    /* Warm up caches, allocators and lazily initialized types */
+    if (!benchmark->run (benchmark->data, &dummy, error))
+        return FALSE;
+
+    for (guint i = 0; i < n_runs; i++) {
+        if (!benchmark->run (benchmark->data, &values[i], error))
+            return FALSE;
+    }
+
+    qsort (values, n_runs, sizeof (gdouble), cmp_double);
+
+    result->name = benchmark->name;
+    result->unit = benchmark->unit;
+    result->higher_is_better = benchmark->higher_is_better;
+    result->median = values[n_runs / 2];
+    result->min = values[0];
+    result->max = values[n_runs - 1];
+    result->n_runs = n_runs;
+    return TRUE;
+}
+
+static gboolean
+write_results (GList *results, const gchar *filename, GError **error)
+{
+    JsonBuilder *builder;
+    JsonGenerator *generator;
+    JsonNode *root;
+    GDateTime *date;
+    gchar *date_string;
+    GList *it;
+    gboolean success;
+
+    date = g_date_time_new_now_local ();
+    date_string = g_date_time_format (date, "%Y-%m-%dT%H:%M:%S%z");
+
+    builder = json_builder_new ();
+    json_builder_begin_object (builder);
+    json_builder_set_member_name (builder, "version");
+    json_builder_add_int_value (builder, RESULTS_VERSION);
+    json_builder_set_member_name (builder, "ufo");
+    json_builder_add_string_value (builder, UFO_VERSION);
+    json_builder_set_member_name (builder, "host");
+    json_builder_add_string_value (builder, g_get_host_name ());
+    json_builder_set_member_name (builder, "date");
+    json_builder_add_string_value (builder, date_string);
+    json_builder_set_member_name (builder, "results");
+    json_builder_begin_array (builder);
+
+    g_list_for (results, it) {
+        Result *result = (Result *) it->data;
+
+        json_builder_begin_object (builder);
+        json_builder_set_member_name (builder, "name");
+        json_builder_add_string_value (builder, result->name);
+        json_builder_set_member_name (builder, "unit");
+        json_builder_add_string_value (builder, result->unit);
+        json_builder_set_member_name (builder, "higher_is_better");
+        json_builder_add_boolean_value (builder, result->higher_is_better);
+        json_builder_set_member_name (builder, "median");
+        json_builder_add_double_value (builder, result->median);
+        json_builder_set_member_name (builder, "min");
+        json_builder_add_double_value (builder, result->min);
+        json_builder_set_member_name (builder, "max");
+        json_builder_add_double_value (builder, result->max);
+        json_builder_set_member_name (builder, "runs");
+        json_builder_add_int_value (builder, result->n_runs);
+        json_builder_end_object (builder);
+    }
+
+    json_builder_end_array (builder);
+    json_builder_end_object (builder);
+
+    root = json_builder_get_root (builder);
+    generator = json_generator_new ();
+    json_generator_set_root (generator, root);
+    json_generator_set_pretty (generator, TRUE);
+    success = json_generator_to_file (generator, filename, error);
+
+    g_object_unref (generator);
+    json_node_free (root);
+    g_object_unref (builder);
+    g_free (date_string);
+    g_date_time_unref (date);
+    return success;
+}
+
+/*
+ * Compare the medians with those of a previous run and return the number of
+ * benchmarks that got worse by more than @threshold percent.
+ */
+static gint
+compare_results (GList *results, const gchar *filename, gdouble threshold, GError **error)
+{
+    JsonParser *parser;
+    JsonObject *root;
+    JsonArray *baseline;
+    GHashTable *medians;
+    GList *it;
+    gint n_regressions = 0;
+
+    parser = json_parser_new ();
+
+    if (!json_parser_load_from_file (parser, filename, error)) {
+        g_object_unref (parser);
+        return -1;
+    }
+
+    root = json_node_get_object (json_parser_get_root (parser));
+
+    if (root == NULL || !json_object_has_member (root, "results")) {
+        g_set_error (error, bench_error_quark (), 0, "`%s' contains no benchmark results", filename);
+        g_object_unref (parser);
+        return -1;
+    }
+
+    baseline = json_object_get_array_member (root, "results");
+    medians = g_hash_table_new (g_str_hash, g_str_equal);
+
+    for (guint i = 0; i < json_array_get_length (baseline); i++) {
+        JsonObject *object = json_array_get_object_element (baseline, i);
+
+        g_hash_table_insert (medians, (gpointer) json_object_get_string_member (object, "name"),
+                             json_object_get_member (object, "median"));
+    }
+
+    g_print ("\n%-24s %14s %14s %9s\n", "Benchmark", "Baseline", "Current", "Change");
+
+    g_list_for (results, it) {
+        Result *result = (Result *) it->data;
+        JsonNode *node;
+        gdouble previous;
+        gdouble change;
+        gboolean worse;
+
+        node = g_hash_table_lookup (medians, result->name);
+
+        if (node == NULL) {
+            g_print ("%-24s %14s %14.3f %9s\n", result->name, "-", result->median, "new");
+            continue;
+        }
+
+        /* Medians that happen to be integral are read back as integers */
+        if (json_node_get_value_type (node) == G_TYPE_INT64)
+            previous = (gdouble) json_node_get_int (node);
+        else
+            previous = json_node_get_double (node);
+
+        change = previous != 0.0 ? 100.0 * (result->median - previous) / previous : 0.0;
+        worse = result->higher_is_better ? change < -threshold : change > threshold;
+
+        g_print ("%-24s %14.3f %14.3f %+8.1f%%%s\n", result->name, previous,
+                 result->median, change, worse ? "  REGRESSION" : "");
+
+        if (worse)
+            n_regressions++;
+    }
+
+    g_hash_table_destroy (medians);
+    g_object_unref (parser);
+    return n_regressions;
+}
+
+int
+main (int argc, char *argv[])
+{
+    GOptionContext *context;
+    GList *results = NULL;
+    GError *error = NULL;
+    gint status = 0;
+
+    static gchar *output = NULL;
+    static gchar *baseline = NULL;
+    static gchar *filter = NULL;
+    static gint n_runs = 5;
+    static gdouble threshold = 10.0;
+    static gboolean list = FALSE;
+
+    static GOptionEntry entries[] = {
+        { "output", 'o', 0, G_OPTION_ARG_FILENAME, &output, "write results as JSON to this file", NULL },
+        { "compare", 'c', 0, G_OPTION_ARG_FILENAME, &baseline, "compare against results of a previous run", NULL },
+        { "threshold", 't', 0, G_OPTION_ARG_DOUBLE, &threshold, "percent by which a benchmark may get worse [10]", NULL },
+        { "filter", 'f', 0, G_OPTION_ARG_STRING, &filter, "run only benchmarks matching this pattern, e.g. 'queue/*'", NULL },
+        { "runs", 'r', 0, G_OPTION_ARG_INT, &n_runs, "number of measured runs per benchmark [5]", NULL },
+        { "list", 'l', 0, G_OPTION_ARG_NONE, &list, "list benchmarks and exit", NULL },
+        { NULL }
+    };
+
+#if !(GLIB_CHECK_VERSION (2, 36, 0))
+    g_type_init ();
+#endif
+
+#if !(GLIB_CHECK_VERSION (2, 32, 0))
+    g_thread_init (NULL);
+#endif
+
+    context = g_option_context_new ("- benchmark the UFO runtime");
+    g_option_context_add_main_entries (context, entries, NULL);
+
+    if (!g_option_context_parse (context, &argc, &argv, &error)) {
+        g_printerr ("Option parsing failed: %s\n", error->message);
+        return 1;
+    }
+
+    if (n_runs < 1) {
+        g_printerr ("--runs must be at least 1\n");
+        return 1;
+    }
+
+    for (const Benchmark *benchmark = benchmarks; benchmark->name != NULL; benchmark++) {
+        Result *result;
+
+        if (filter != NULL && !g_pattern_match_simple (filter, benchmark->name))
+            continue;
+
+        if (list) {
+            g_print ("%s\n", benchmark->name);
+            continue;
+        }
+
+        result = g_new0 (Result, 1);
+
+        if (!run_benchmark (benchmark, (guint) n_runs, result, &error)) {
+            g_print ("%-24s skipped: %s\n", benchmark->name, error != NULL ? error->message : "failed");
+            g_clear_error (&error);
+            g_free (result);
+            continue;
+        }
+
+        g_print ("%-24s %14.3f %-8s (min %.3f, max %.3f)\n", result->name,
+                 result->median, result->unit, result->min, result->max);
+
+        results = g_list_append (results, result);
+    }
+
+    if (output != NULL && !write_results (results, output, &error)) {
+        g_printerr ("Could not write results: %s\n", error->message);
+        g_clear_error (&error);
+        status = 1;
+    }
+
+    if (baseline != NULL) {
+        gint n_regressions;
+
+        n_regressions = compare_results (results, baseline, threshold, &error);
+
+        if (n_regressions < 0) {
+            g_printerr ("Could not read baseline: %s\n", error->message);
+            g_clear_error (&error);
+            status = 1;
+        }
+        else if (n_regressions > 0) {
+            g_print ("\n%i benchmark(s) regressed by more than %.1f%%\n", n_regressions, threshold);
+            status = 2;
+        }
+    }
+
+    g_list_free_full (results, g_free);
+    g_option_context_free (context);
+    g_free (output);
+    g_free (baseline);
+    g_free (filter);
+
+    return status;
+}
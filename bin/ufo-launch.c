@@ -174,6 +174,136 @@ progress_update (gpointer user)
         g_print (".");
 }
 
+static void
+print_latencies (UfoTaskGraph *graph)
+{
+    GList *leaves;
+    GList *it;
+
+    leaves = ufo_graph_get_leaves (UFO_GRAPH (graph));
+
+    g_list_for (leaves, it) {
+        UfoTaskNode *node;
+        UfoProfiler *profiler;
+        guint n_items;
+        gdouble mean;
+        gdouble max;
+
+        node = UFO_TASK_NODE (it->data);
+        profiler = ufo_task_node_get_profiler (node);
+        ufo_profiler_get_latency (profiler, &n_items, &mean, &max);
+
+        if (n_items > 0)
+            g_print ("%s: %u items, latency mean=%.3fms p50=%.3fms p90=%.3fms p99=%.3fms max=%.3fms\n",
+                     ufo_task_node_get_plugin_name (node), n_items, mean * 1e3,
+                     ufo_profiler_get_percentile (profiler, UFO_PROFILER_HISTOGRAM_LATENCY, 50.0) * 1e3,
+                     ufo_profiler_get_percentile (profiler, UFO_PROFILER_HISTOGRAM_LATENCY, 90.0) * 1e3,
+                     ufo_profiler_get_percentile (profiler, UFO_PROFILER_HISTOGRAM_LATENCY, 99.0) * 1e3,
+                     max * 1e3);
+    }
+
+    g_list_free (leaves);
+}
+
+static void
+print_durations (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoTaskNode *node;
+        UfoProfiler *profiler;
+        UfoProfilerHistogram histogram;
+
+        node = UFO_TASK_NODE (it->data);
+        profiler = ufo_task_node_get_profiler (node);
+        histogram = UFO_PROFILER_HISTOGRAM_PROCESS;
+
+        if (ufo_profiler_get_num_durations (profiler, histogram) == 0)
+            histogram = UFO_PROFILER_HISTOGRAM_GENERATE;
+
+        if (ufo_profiler_get_num_durations (profiler, histogram) == 0)
+            continue;
+
+        g_print ("%s: %s p50=%.3fms p90=%.3fms p99=%.3fms max=%.3fms\n",
+                 ufo_task_node_get_plugin_name (node),
+                 histogram == UFO_PROFILER_HISTOGRAM_PROCESS ? "process" : "generate",
+                 ufo_profiler_get_percentile (profiler, histogram, 50.0) * 1e3,
+                 ufo_profiler_get_percentile (profiler, histogram, 90.0) * 1e3,
+                 ufo_profiler_get_percentile (profiler, histogram, 99.0) * 1e3,
+                 ufo_profiler_get_percentile (profiler, histogram, 100.0) * 1e3);
+    }
+
+    g_list_free (nodes);
+}
+
+static void
+print_memory (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoTaskNode *node;
+        UfoProfiler *profiler;
+        GList *devices;
+        GList *jt;
+        gsize host_peak = 0;
+        gsize device_peak = 0;
+
+        node = UFO_TASK_NODE (it->data);
+        profiler = ufo_task_node_get_profiler (node);
+        devices = ufo_profiler_get_memory_devices (profiler);
+
+        g_list_for (devices, jt) {
+            gsize peak;
+
+            ufo_profiler_get_memory (profiler, jt->data, NULL, &peak);
+
+            if (jt->data == NULL)
+                host_peak = peak;
+            else
+                device_peak += peak;
+        }
+
+        if (devices != NULL)
+            g_print ("%s: peak memory host=%.1fMB device=%.1fMB\n",
+                     ufo_task_node_get_plugin_name (node),
+                     host_peak / 1048576.0, device_peak / 1048576.0);
+
+        g_list_free (devices);
+    }
+
+    g_list_free (nodes);
+}
+
+static void
+print_dropped (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoTaskNode *node;
+        guint n_dropped;
+
+        node = UFO_TASK_NODE (it->data);
+        n_dropped = ufo_profiler_get_num_dropped (ufo_task_node_get_profiler (node));
+
+        if (n_dropped > 0)
+            g_print ("%s: %u items dropped\n", ufo_task_node_get_plugin_name (node), n_dropped);
+    }
+
+    g_list_free (nodes);
+}
+
 static GValueArray *
 string_array_to_value_array (gchar **array)
 {
@@ -209,15 +339,27 @@ main(int argc, char* argv[])
     static gboolean progress = FALSE;
     static gboolean trace = FALSE;
     static gboolean do_time = FALSE;
+    static gboolean do_stats = FALSE;
+    static gboolean low_latency = FALSE;
+    static gchar *metrics_file = NULL;
+    static gint metrics_port = -1;
     static gchar **addresses = NULL;
     static gchar *dump = NULL;
+    static gchar *devices = NULL;
+    static gchar *partition = NULL;
 
     static GOptionEntry entries[] = {
         { "progress", 'p', 0, G_OPTION_ARG_NONE, &progress, "show progress", NULL },
         { "trace", 't', 0, G_OPTION_ARG_NONE, &trace, "enable tracing", NULL },
         { "time", 0, 0, G_OPTION_ARG_NONE, &do_time, "print run time", NULL },
+        { "stats", 0, 0, G_OPTION_ARG_NONE, &do_stats, "print per-node durations, memory, latency and dropped items", NULL },
+        { "low-latency", 0, 0, G_OPTION_ARG_NONE, &low_latency, "minimize per-item latency instead of maximizing throughput", NULL },
+        { "metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &metrics_file, "periodically write live metrics to this file", NULL },
+        { "metrics-port", 0, 0, G_OPTION_ARG_INT, &metrics_port, "serve live metrics in Prometheus format on this local port", NULL },
         { "address", 'a', 0, G_OPTION_ARG_STRING_ARRAY, &addresses, "Address of remote server running `ufod'", NULL },
         { "dump", 'd', 0, G_OPTION_ARG_STRING, &dump, "Dump to JSON file", NULL },
+        { "devices", 0, 0, G_OPTION_ARG_STRING, &devices, "Use only these device indices, e.g. 0,2-3", NULL },
+        { "partition", 0, 0, G_OPTION_ARG_STRING, &partition, "Split devices into sub-devices, `numa' or `equal:N'", NULL },
         { NULL }
     };
 
@@ -233,6 +375,11 @@ main(int argc, char* argv[])
         return 1;
     }
 
+    if (metrics_port != -1 && (metrics_port < 1 || metrics_port > 65535)) {
+        g_print ("Error parsing options: --metrics-port must be between 1 and 65535\n");
+        return 1;
+    }
+
     if (argc == 1) {
         g_print ("%s", g_option_context_get_help (context, TRUE, NULL));
         return 0;
@@ -264,12 +411,31 @@ main(int argc, char* argv[])
         g_object_set (sched, "enable-tracing", TRUE, NULL);
     }
 
+    if (low_latency) {
+        g_object_set (sched, "low-latency", TRUE, NULL);
+    }
+
+    if (metrics_file != NULL || metrics_port > 0) {
+        g_object_set (sched,
+                      "metrics-file", metrics_file,
+                      "metrics-port", metrics_port > 0 ? (guint) metrics_port : 0,
+                      NULL);
+    }
+
     address_list = string_array_to_value_array (addresses);
 
-    if (address_list) {
+    if (address_list || devices || partition) {
         resources = UFO_RESOURCES (ufo_resources_new (NULL));
-        g_object_set (G_OBJECT (resources), "remotes", address_list, NULL);
-        g_value_array_free (address_list);
+        g_object_set (G_OBJECT (resources),
+                      "device-selection", devices,
+                      "device-partition", partition,
+                      NULL);
+
+        if (address_list) {
+            g_object_set (G_OBJECT (resources), "remotes", address_list, NULL);
+            g_value_array_free (address_list);
+        }
+
         ufo_base_scheduler_set_resources (sched, resources);
     }
 
@@ -290,6 +456,13 @@ main(int argc, char* argv[])
         g_print ("%3.5fs\n", run_time);
     }
 
+    if (do_stats) {
+        print_durations (graph);
+        print_memory (graph);
+        print_latencies (graph);
+        print_dropped (graph);
+    }
+
     if (resources) {
         g_object_unref (resources);
     }
@@ -34,6 +34,10 @@ static UfoDaemon *global_daemon;
 typedef struct {
     gchar **paths;
     gchar *addr;
+    gchar *devices;
+    gchar *partition;
+    gchar *metrics_file;
+    gint metrics_port;
 } Options;
 
 static Options *
@@ -45,12 +49,21 @@ opts_parse (gint *argc, gchar ***argv)
     GError *error = NULL;
 
     opts = g_new0 (Options, 1);
+    opts->metrics_port = -1;
 
     GOptionEntry entries[] = {
         { "listen", 'l', 0, G_OPTION_ARG_STRING, &opts->addr,
           "Address to listen on (see http://api.zeromq.org/3-2:zmq-tcp)", NULL },
         { "path", 'p', 0, G_OPTION_ARG_STRING_ARRAY, &opts->paths,
           "Path to node plugins or OpenCL kernels", NULL },
+        { "devices", 0, 0, G_OPTION_ARG_STRING, &opts->devices,
+          "Use only these device indices, e.g. 0,2-3", NULL },
+        { "partition", 0, 0, G_OPTION_ARG_STRING, &opts->partition,
+          "Split devices into sub-devices, `numa' or `equal:N'", NULL },
+        { "metrics-file", 0, 0, G_OPTION_ARG_FILENAME, &opts->metrics_file,
+          "Periodically write live metrics to this file", NULL },
+        { "metrics-port", 0, 0, G_OPTION_ARG_INT, &opts->metrics_port,
+          "Serve live metrics in Prometheus format on this local port", NULL },
         { "version", 'v', 0, G_OPTION_ARG_NONE, &show_version,
           "Show version information", NULL },
         { NULL }
@@ -65,6 +78,12 @@ opts_parse (gint *argc, gchar ***argv)
         return NULL;
     }
 
+    if (opts->metrics_port != -1 && (opts->metrics_port < 1 || opts->metrics_port > 65535)) {
+        g_print ("Option parsing failed: --metrics-port must be between 1 and 65535\n");
+        g_free (opts);
+        return NULL;
+    }
+
     if (show_version) {
         g_print ("ufod %s\n", UFO_VERSION);
         exit (EXIT_SUCCESS);
@@ -83,6 +102,9 @@ opts_free (Options *opts)
 {
     g_strfreev (opts->paths);
     g_free (opts->addr);
+    g_free (opts->devices);
+    g_free (opts->partition);
+    g_free (opts->metrics_file);
     g_free (opts);
 }
 
@@ -126,6 +148,8 @@ main (int argc, char * argv[])
     (void) signal (SIGINT, terminate);
 
     global_daemon = ufo_daemon_new (opts->addr);
+    ufo_daemon_set_devices (global_daemon, opts->devices, opts->partition);
+    ufo_daemon_set_metrics (global_daemon, opts->metrics_file, opts->metrics_port > 0 ? (guint) opts->metrics_port : 0);
     ufo_daemon_start (global_daemon, &error);
 
     if (error != NULL) {
@@ -0,0 +1,375 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdlib.h>
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+#define WIDTH   512
+#define HEIGHT  256
+
+typedef struct {
+    UfoBuffer *a;
+    UfoBuffer *b;
+    UfoBuffer *out;
+} Fixture;
+
+static void
+setup (Fixture *fixture, gconstpointer data)
+{
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = WIDTH,
+        .dims[1] = HEIGHT,
+    };
+    gfloat *a;
+    gfloat *b;
+
+    fixture->a = ufo_buffer_new (&requisition, NULL);
+    fixture->b = ufo_buffer_new (&requisition, NULL);
+    fixture->out = ufo_buffer_new (&requisition, NULL);
+
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+    b = ufo_buffer_get_host_array (fixture->b, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++) {
+        a[i] = (gfloat) (i % 7) - 3.0f;
+        b[i] = (gfloat) (i % 5) + 1.0f;
+    }
+}
+
+static void
+teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->a);
+    g_object_unref (fixture->b);
+    g_object_unref (fixture->out);
+}
+
+static void
+test_set (Fixture *fixture, gconstpointer unused)
+{
+    gfloat *out;
+
+    g_assert (ufo_op_set (fixture->out, 2.5f, NULL, NULL) == NULL);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (out[i], ==, 2.5f);
+}
+
+static void
+test_elementwise (Fixture *fixture, gconstpointer unused)
+{
+    gfloat *a, *b, *out;
+
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+    b = ufo_buffer_get_host_array (fixture->b, NULL);
+
+    ufo_op_add2 (fixture->a, fixture->b, 0.5f, fixture->out, NULL, NULL);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (fabs (out[i] - (a[i] + 0.5f * b[i])), <, 1e-6);
+
+    ufo_op_mul (fixture->a, fixture->b, fixture->out, NULL, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (out[i], ==, a[i] * b[i]);
+
+    ufo_op_inv (fixture->b, NULL, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (fabs (b[i] - 1.0f / ((gfloat) (i % 5) + 1.0f)), <, 1e-6);
+}
+
+static void
+test_posc (Fixture *fixture, gconstpointer unused)
+{
+    gfloat *a, *out;
+
+    ufo_op_POSC (fixture->a, fixture->out, NULL, NULL);
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (out[i], ==, a[i] > 0.0f ? a[i] : 0.0f);
+}
+
+static void
+test_gradient_magnitudes (Fixture *fixture, gconstpointer unused)
+{
+    gfloat *out;
+
+    /* A constant image has no gradient, also not at the clamped borders */
+    ufo_op_set (fixture->a, 1.0f, NULL, NULL);
+    ufo_op_gradient_magnitudes (fixture->a, fixture->out, NULL, NULL);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (out[i], ==, 0.0f);
+}
+
+static void
+test_norms (Fixture *fixture, gconstpointer unused)
+{
+    gfloat *a;
+    gdouble l1 = 0.0;
+    gdouble l2 = 0.0;
+
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++) {
+        l1 += fabs (a[i]);
+        l2 += a[i] * a[i];
+    }
+
+    g_assert_cmpfloat (fabs (ufo_op_l1_norm (fixture->a, NULL, NULL) - l1) / l1, <, 1e-5);
+    g_assert_cmpfloat (fabs (ufo_op_l2_norm (fixture->a, NULL, NULL) - sqrt (l2)) / sqrt (l2), <, 1e-5);
+    g_assert_cmpfloat (ufo_op_euclidean_distance (fixture->a, fixture->a, NULL, NULL), ==, 0.0f);
+}
+
+static void
+test_expr_values (Fixture *fixture, gconstpointer unused)
+{
+    UfoOpExpr *expr;
+    gfloat *a, *b, *out;
+
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+    b = ufo_buffer_get_host_array (fixture->b, NULL);
+
+    /* max (a, -b) / b + sqrt (|a|) - min (a, b) * inv (a) */
+    expr = ufo_op_expr_sub (ufo_op_expr_add (ufo_op_expr_div (ufo_op_expr_max (ufo_op_expr_buffer (fixture->a),
+                                                                                ufo_op_expr_neg (ufo_op_expr_buffer (fixture->b))),
+                                                              ufo_op_expr_buffer (fixture->b)),
+                                             ufo_op_expr_sqrt (ufo_op_expr_abs (ufo_op_expr_buffer (fixture->a)))),
+                            ufo_op_expr_mul (ufo_op_expr_min (ufo_op_expr_buffer (fixture->a),
+                                                              ufo_op_expr_buffer (fixture->b)),
+                                             ufo_op_expr_inv (ufo_op_expr_buffer (fixture->a))));
+
+    g_assert (ufo_op_expr_eval (expr, fixture->out, NULL, NULL) == NULL);
+    ufo_op_expr_free (expr);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++) {
+        gfloat inv = a[i] != 0.0f ? 1.0f / a[i] : 0.0f;
+        gfloat expected = fmaxf (a[i], -b[i]) / b[i] + sqrtf (fabsf (a[i])) - fminf (a[i], b[i]) * inv;
+
+        g_assert_cmpfloat (fabs (out[i] - expected), <, 1e-5);
+    }
+}
+
+static void
+test_expr_broadcast (Fixture *fixture, gconstpointer unused)
+{
+    /* Not a multiple of the host chunk size to cover the remainder */
+    UfoRequisition requisition = { .n_dims = 1, .dims[0] = 1333 };
+    UfoBuffer *odd;
+    UfoOpExpr *expr;
+    gfloat *b, *out;
+
+    /* Scalar-only expressions fill the output */
+    odd = ufo_buffer_new (&requisition, NULL);
+    expr = ufo_op_expr_mul (ufo_op_expr_scalar (2.0f), ufo_op_expr_scalar (1.25f));
+    ufo_op_expr_eval (expr, odd, NULL, NULL);
+    ufo_op_expr_free (expr);
+    out = ufo_buffer_get_host_array (odd, NULL);
+
+    for (guint i = 0; i < requisition.dims[0]; i++)
+        g_assert_cmpfloat (out[i], ==, 2.5f);
+
+    g_object_unref (odd);
+
+    /* Scalars are applied to every element of a buffer */
+    b = ufo_buffer_get_host_array (fixture->b, NULL);
+    expr = ufo_op_expr_add (ufo_op_expr_scalar (0.5f),
+                            ufo_op_expr_mul (ufo_op_expr_scalar (3.0f), ufo_op_expr_buffer (fixture->b)));
+    ufo_op_expr_eval (expr, fixture->out, NULL, NULL);
+    ufo_op_expr_free (expr);
+    out = ufo_buffer_get_host_array (fixture->out, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++)
+        g_assert_cmpfloat (out[i], ==, 0.5f + 3.0f * b[i]);
+}
+
+static void
+test_expr_aliasing (Fixture *fixture, gconstpointer unused)
+{
+    UfoOpExpr *expr;
+    gfloat *a, *b;
+
+    /* a = a + 0.5 * (b - a), evaluated twice with the same expression */
+    expr = ufo_op_expr_add (ufo_op_expr_buffer (fixture->a),
+                            ufo_op_expr_mul (ufo_op_expr_scalar (0.5f),
+                                             ufo_op_expr_sub (ufo_op_expr_buffer (fixture->b),
+                                                              ufo_op_expr_buffer (fixture->a))));
+    ufo_op_expr_eval (expr, fixture->a, NULL, NULL);
+    ufo_op_expr_eval (expr, fixture->a, NULL, NULL);
+    ufo_op_expr_free (expr);
+
+    a = ufo_buffer_get_host_array (fixture->a, NULL);
+    b = ufo_buffer_get_host_array (fixture->b, NULL);
+
+    for (guint i = 0; i < WIDTH * HEIGHT; i++) {
+        gfloat x = (gfloat) (i % 7) - 3.0f;
+
+        x = x + 0.5f * (b[i] - x);
+        x = x + 0.5f * (b[i] - x);
+        g_assert_cmpfloat (fabs (a[i] - x), <, 1e-6);
+    }
+}
+
+static void
+test_expr_size_mismatch (Fixture *fixture, gconstpointer unused)
+{
+    UfoRequisition requisition = {
+        .n_dims = 1,
+        .dims[0] = WIDTH,
+    };
+
+    if (g_test_trap_fork (0, G_TEST_TRAP_SILENCE_STDERR)) {
+        UfoBuffer *small;
+        UfoOpExpr *expr;
+
+        g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+        small = ufo_buffer_new (&requisition, NULL);
+        expr = ufo_op_expr_add (ufo_op_expr_buffer (fixture->a), ufo_op_expr_buffer (small));
+        g_assert (ufo_op_expr_eval (expr, fixture->out, NULL, NULL) == NULL);
+        exit (0);
+    }
+
+    g_test_trap_assert_passed ();
+    g_test_trap_assert_stderr ("*same size*");
+}
+
+static void
+test_expr_invalid_arguments (Fixture *fixture, gconstpointer unused)
+{
+    if (g_test_trap_fork (0, G_TEST_TRAP_SILENCE_STDERR)) {
+        g_log_set_always_fatal (G_LOG_LEVEL_ERROR);
+        g_assert (ufo_op_expr_eval (NULL, fixture->out, NULL, NULL) == NULL);
+        g_assert (ufo_op_expr_buffer (NULL) == NULL);
+        exit (0);
+    }
+
+    g_test_trap_assert_passed ();
+    g_test_trap_assert_stderr ("*CRITICAL*");
+}
+
+static void
+test_device_reductions (void)
+{
+    /* Not a multiple of any work group size */
+    UfoRequisition requisition = { .n_dims = 1, .dims[0] = 100003 };
+    UfoResources *resources;
+    UfoBuffer *x;
+    UfoBuffer *y;
+    GList *queues;
+    gpointer queue;
+    gfloat *hx, *hy;
+    gdouble l1 = 0.0;
+    gdouble l2 = 0.0;
+    gdouble distance = 0.0;
+    GError *error = NULL;
+
+    resources = ufo_resources_new (&error);
+    g_assert_no_error (error);
+
+    queues = ufo_resources_get_cmd_queues (resources);
+    g_assert (queues != NULL);
+    queue = queues->data;
+
+    x = ufo_buffer_new (&requisition, ufo_resources_get_context (resources));
+    y = ufo_buffer_new (&requisition, ufo_resources_get_context (resources));
+    hx = ufo_buffer_get_host_array (x, NULL);
+    hy = ufo_buffer_get_host_array (y, NULL);
+
+    for (guint i = 0; i < requisition.dims[0]; i++) {
+        hx[i] = (gfloat) (i % 11) - 5.0f;
+        hy[i] = (gfloat) (i % 3);
+        l1 += fabs (hx[i]);
+        l2 += hx[i] * hx[i];
+        distance += (hx[i] - hy[i]) * (hx[i] - hy[i]);
+    }
+
+    /* Move the data so that the reductions run on the device */
+    ufo_buffer_get_device_array (x, queue);
+    ufo_buffer_get_device_array (y, queue);
+    g_assert (ufo_buffer_get_location (x) == UFO_BUFFER_LOCATION_DEVICE);
+
+    /* Run twice to also use the cached partial sums buffer */
+    for (guint i = 0; i < 2; i++) {
+        g_assert_cmpfloat (fabs (ufo_op_l1_norm (x, resources, queue) - l1) / l1, <, 1e-5);
+        g_assert_cmpfloat (fabs (ufo_op_l2_norm (x, resources, queue) - sqrt (l2)) / sqrt (l2), <, 1e-5);
+        g_assert_cmpfloat (fabs (ufo_op_euclidean_distance (x, y, resources, queue) - sqrt (distance)) / sqrt (distance), <, 1e-5);
+    }
+
+    g_list_free (queues);
+    g_object_unref (x);
+    g_object_unref (y);
+    g_object_unref (resources);
+}
+
+void
+test_add_basic_ops (void)
+{
+    g_test_add ("/no-opencl/basic-ops/set",
+                Fixture, NULL,
+                setup, test_set, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/elementwise",
+                Fixture, NULL,
+                setup, test_elementwise, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/posc",
+                Fixture, NULL,
+                setup, test_posc, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/gradient-magnitudes",
+                Fixture, NULL,
+                setup, test_gradient_magnitudes, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/norms",
+                Fixture, NULL,
+                setup, test_norms, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/expr-values",
+                Fixture, NULL,
+                setup, test_expr_values, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/expr-broadcast",
+                Fixture, NULL,
+                setup, test_expr_broadcast, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/expr-aliasing",
+                Fixture, NULL,
+                setup, test_expr_aliasing, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/expr-size-mismatch",
+                Fixture, NULL,
+                setup, test_expr_size_mismatch, teardown);
+
+    g_test_add ("/no-opencl/basic-ops/expr-invalid-arguments",
+                Fixture, NULL,
+                setup, test_expr_invalid_arguments, teardown);
+
+    g_test_add_func ("/opencl/basic-ops/reductions",
+                     test_device_reductions);
+}
@@ -166,6 +166,41 @@ test_copy_metadata (Fixture *fixture,
     g_object_unref (copy);
 }
 
+static void
+test_copy_timestamp (Fixture *fixture,
+                     gconstpointer unused)
+{
+    UfoBuffer *first;
+    UfoBuffer *second;
+    UfoBuffer *out;
+
+    UfoRequisition requisition = {
+        .n_dims = 2,
+        .dims[0] = 8,
+        .dims[1] = 8,
+    };
+
+    first = ufo_buffer_new (&requisition, NULL);
+    second = ufo_buffer_new (&requisition, NULL);
+    out = ufo_buffer_new (&requisition, NULL);
+
+    /* Inputs without a timestamp do not reset it */
+    ufo_buffer_set_timestamp (first, 200);
+    ufo_buffer_copy_metadata (first, out);
+    ufo_buffer_copy_metadata (fixture->buffer, out);
+    g_assert (ufo_buffer_get_timestamp (out) == 200);
+
+    /* The oldest input wins, regardless of the order */
+    ufo_buffer_set_timestamp (second, 100);
+    ufo_buffer_copy_metadata (second, out);
+    ufo_buffer_copy_metadata (first, out);
+    g_assert (ufo_buffer_get_timestamp (out) == 100);
+
+    g_object_unref (first);
+    g_object_unref (second);
+    g_object_unref (out);
+}
+
 static void
 test_location (Fixture *fixture,
                gconstpointer unused)
@@ -202,6 +237,10 @@ test_add_buffer (void)
                 Fixture, NULL,
                 setup, test_copy_metadata, teardown);
 
+    g_test_add ("/no-opencl/buffer/metadata/timestamp",
+                Fixture, NULL,
+                setup, test_copy_timestamp, teardown);
+
     g_test_add ("/no-opencl/buffer/location",
                 Fixture, NULL,
                 setup, test_location, teardown);
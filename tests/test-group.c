@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <ufo/ufo.h>
+#include "test-suite.h"
+
+typedef struct {
+    UfoGroup *group;
+    UfoNode *first;
+    UfoNode *second;
+} Fixture;
+
+static void
+fixture_setup (Fixture *fixture, gconstpointer data)
+{
+    GList *targets = NULL;
+
+    fixture->first = ufo_dummy_task_new ();
+    fixture->second = ufo_dummy_task_new ();
+    targets = g_list_append (targets, fixture->first);
+    targets = g_list_append (targets, fixture->second);
+
+    fixture->group = ufo_group_new (targets, NULL, UFO_SEND_SCATTER);
+    g_list_free (targets);
+}
+
+static void
+fixture_teardown (Fixture *fixture, gconstpointer data)
+{
+    g_object_unref (fixture->group);
+    g_object_unref (fixture->first);
+    g_object_unref (fixture->second);
+}
+
+static void
+test_target_done (Fixture *fixture, gconstpointer data)
+{
+    g_assert (!ufo_group_is_done (fixture->group));
+
+    ufo_group_set_target_done (fixture->group, UFO_TASK (fixture->first));
+    g_assert (!ufo_group_is_done (fixture->group));
+
+    ufo_group_set_target_done (fixture->group, UFO_TASK (fixture->second));
+    g_assert (ufo_group_is_done (fixture->group));
+}
+
+static void
+test_abort (Fixture *fixture, gconstpointer data)
+{
+    UfoRequisition requisition = { .n_dims = 1, .dims = { 16, 0, 0 } };
+
+    ufo_group_abort (fixture->group);
+
+    g_assert (ufo_group_pop_input_buffer (fixture->group, UFO_TASK (fixture->first)) == UFO_END_OF_STREAM);
+    g_assert (ufo_group_pop_output_buffer (fixture->group, &requisition) == NULL);
+}
+
+/*
+ * Push @n_items numbered buffers into a single-target group of depth 2 that
+ * is never drained and return the numbers the consumer finds afterwards.
+ */
+static void
+fill_bounded_queue (Fixture *fixture,
+                    UfoOverflowPolicy policy,
+                    guint n_items,
+                    gfloat *received)
+{
+    UfoRequisition requisition = { .n_dims = 1, .dims = { 16, 0, 0 } };
+    UfoTask *target;
+    UfoGroup *group;
+    GList *targets;
+
+    target = UFO_TASK (fixture->first);
+    targets = g_list_append (NULL, target);
+    group = ufo_group_new (targets, NULL, UFO_SEND_SCATTER);
+    g_list_free (targets);
+
+    ufo_group_set_queue_depth (group, 2);
+    ufo_group_set_overflow_policy (group, target, policy);
+
+    for (guint i = 0; i < n_items; i++) {
+        UfoBuffer *buffer;
+
+        buffer = ufo_group_pop_output_buffer (group, &requisition);
+        g_assert (buffer != NULL);
+        ufo_buffer_get_host_array (buffer, NULL)[0] = (gfloat) i;
+        ufo_group_push_output_buffer (group, buffer);
+    }
+
+    for (guint i = 0; i < 2; i++) {
+        UfoBuffer *buffer;
+
+        buffer = ufo_group_pop_input_buffer (group, target);
+        received[i] = ufo_buffer_get_host_array (buffer, NULL)[0];
+        ufo_group_push_input_buffer (group, target, buffer);
+    }
+
+    g_object_unref (group);
+}
+
+static void
+test_drop_oldest (Fixture *fixture, gconstpointer data)
+{
+    UfoProfiler *profiler;
+    gfloat received[2];
+
+    fill_bounded_queue (fixture, UFO_OVERFLOW_DROP_OLDEST, 5, received);
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (fixture->first));
+
+    /* The newest items survive in order */
+    g_assert_cmpfloat (received[0], ==, 3.0f);
+    g_assert_cmpfloat (received[1], ==, 4.0f);
+    g_assert_cmpuint (ufo_profiler_get_num_dropped (profiler), ==, 3);
+}
+
+static void
+test_drop_newest (Fixture *fixture, gconstpointer data)
+{
+    UfoProfiler *profiler;
+    gfloat received[2];
+
+    fill_bounded_queue (fixture, UFO_OVERFLOW_DROP_NEWEST, 5, received);
+    profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (fixture->first));
+
+    /* The first items that fit survive, everything after is discarded */
+    g_assert_cmpfloat (received[0], ==, 0.0f);
+    g_assert_cmpfloat (received[1], ==, 1.0f);
+    g_assert_cmpuint (ufo_profiler_get_num_dropped (profiler), ==, 3);
+}
+
+void
+test_add_group (void)
+{
+    g_test_add ("/no-opencl/group/target-done",
+                Fixture, NULL,
+                fixture_setup, test_target_done, fixture_teardown);
+
+    g_test_add ("/no-opencl/group/abort",
+                Fixture, NULL,
+                fixture_setup, test_abort, fixture_teardown);
+
+    g_test_add ("/no-opencl/group/drop-oldest",
+                Fixture, NULL,
+                fixture_setup, test_drop_oldest, fixture_teardown);
+
+    g_test_add ("/no-opencl/group/drop-newest",
+                Fixture, NULL,
+                fixture_setup, test_drop_newest, fixture_teardown);
+}
@@ -55,6 +55,74 @@ test_copy (void)
     g_object_unref (copy);
 }
 
+static void
+test_synthetic_generator (void)
+{
+    UfoNode *node;
+    UfoTask *task;
+    UfoRequisition requisition;
+    GError *error = NULL;
+    guint n_items = 0;
+
+    node = ufo_synthetic_task_new ();
+    task = UFO_TASK (node);
+    g_object_set (node, "mode", "generator", "number", 5, "width", 8, "height", 4, NULL);
+
+    g_assert (ufo_task_get_mode (task) == (UFO_TASK_MODE_GENERATOR | UFO_TASK_MODE_CPU));
+    g_assert_cmpuint (ufo_task_get_num_inputs (task), ==, 0);
+
+    ufo_task_setup (task, NULL, &error);
+    g_assert_no_error (error);
+
+    ufo_task_get_requisition (task, NULL, &requisition);
+    g_assert_cmpuint (requisition.n_dims, ==, 2);
+    g_assert_cmpuint (requisition.dims[0], ==, 8);
+    g_assert_cmpuint (requisition.dims[1], ==, 4);
+
+    while (ufo_task_generate (task, NULL, &requisition))
+        n_items++;
+
+    g_assert_cmpuint (n_items, ==, 5);
+
+    /* The final call that ends the stream is not a generated item */
+    g_assert (ufo_profiler_get_num_durations (ufo_task_node_get_profiler (UFO_TASK_NODE (node)),
+                                              UFO_PROFILER_HISTOGRAM_GENERATE) == 5);
+
+    /* A new run starts from the beginning */
+    ufo_task_setup (task, NULL, &error);
+    g_assert_no_error (error);
+    g_assert (ufo_task_generate (task, NULL, &requisition));
+
+    g_object_unref (node);
+}
+
+static void
+test_synthetic_copy (void)
+{
+    UfoNode *node;
+    UfoNode *copy;
+    GError *error = NULL;
+    gchar *mode;
+    gchar *jitter;
+    gdouble cpu_time;
+
+    node = ufo_synthetic_task_new ();
+    g_object_set (node, "mode", "sink", "cpu-time", 20.0, "jitter", "exponential", NULL);
+    copy = ufo_node_copy (node, &error);
+    g_assert_no_error (error);
+
+    g_object_get (copy, "mode", &mode, "cpu-time", &cpu_time, "jitter", &jitter, NULL);
+    g_assert_cmpstr (mode, ==, "sink");
+    g_assert_cmpstr (jitter, ==, "exponential");
+    g_assert_cmpfloat (cpu_time, ==, 20.0);
+    g_assert_cmpuint (ufo_task_get_num_inputs (UFO_TASK (copy)), ==, 1);
+
+    g_free (mode);
+    g_free (jitter);
+    g_object_unref (copy);
+    g_object_unref (node);
+}
+
 void
 test_add_node (void)
 {
@@ -63,4 +131,10 @@ test_add_node (void)
 
     g_test_add_func ("/no-opencl/node/copy",
                      test_copy);
+
+    g_test_add_func ("/no-opencl/node/synthetic/generator",
+                     test_synthetic_generator);
+
+    g_test_add_func ("/no-opencl/node/synthetic/copy",
+                     test_synthetic_copy);
 }
@@ -62,6 +62,136 @@ test_timer_elapsed (Fixture *fixture, gconstpointer data)
                                     UFO_PROFILER_TIMER_IO) >= 0.001);
 }
 
+static void
+test_dropped (Fixture *fixture, gconstpointer data)
+{
+    g_assert (ufo_profiler_get_num_dropped (fixture->profiler) == 0);
+
+    ufo_profiler_count_dropped (fixture->profiler);
+    ufo_profiler_count_dropped (fixture->profiler);
+
+    g_assert (ufo_profiler_get_num_dropped (fixture->profiler) == 2);
+}
+
+static void
+test_trace_events (Fixture *fixture, gconstpointer data)
+{
+    GList *events;
+    GList *it;
+    gdouble last = 0.0;
+    guint n_events = 0;
+
+    ufo_profiler_trace_event (fixture->profiler, UFO_TRACE_EVENT_PROCESS | UFO_TRACE_EVENT_BEGIN);
+    g_assert (ufo_profiler_get_trace_events (fixture->profiler) == NULL);
+
+    ufo_profiler_enable_tracing (fixture->profiler, TRUE);
+
+    for (guint i = 0; i < 1000; i++) {
+        ufo_profiler_trace_event (fixture->profiler, UFO_TRACE_EVENT_PROCESS | UFO_TRACE_EVENT_BEGIN);
+        ufo_profiler_trace_event (fixture->profiler, UFO_TRACE_EVENT_PROCESS | UFO_TRACE_EVENT_END);
+    }
+
+    events = ufo_profiler_get_trace_events (fixture->profiler);
+
+    for (it = g_list_first (events); it != NULL; it = g_list_next (it)) {
+        UfoTraceEvent *event = (UfoTraceEvent *) it->data;
+
+        g_assert (event->timestamp >= last);
+        g_assert ((event->type & UFO_TRACE_EVENT_TIME_MASK) ==
+                  (n_events % 2 == 0 ? UFO_TRACE_EVENT_BEGIN : UFO_TRACE_EVENT_END));
+        last = event->timestamp;
+        n_events++;
+    }
+
+    g_assert_cmpuint (n_events, ==, 2000);
+}
+
+static void
+test_queue_stats (Fixture *fixture, gconstpointer data)
+{
+    UfoTwoWayQueue *queue;
+    UfoTwoWayQueueStats stats;
+    gint item = 0;
+
+    queue = ufo_two_way_queue_new (NULL);
+    ufo_two_way_queue_insert (queue, &item);
+
+    for (guint i = 0; i < 3; i++) {
+        ufo_two_way_queue_producer_push (queue, ufo_two_way_queue_producer_pop (queue));
+        g_assert (ufo_two_way_queue_consumer_pop (queue) == &item);
+        ufo_two_way_queue_consumer_push (queue, &item);
+    }
+
+    /* A reclaimed item was never delivered and is not counted */
+    ufo_two_way_queue_producer_push (queue, ufo_two_way_queue_producer_pop (queue));
+    g_assert (ufo_two_way_queue_producer_reclaim (queue) == &item);
+    g_assert (ufo_two_way_queue_producer_reclaim (queue) == NULL);
+
+    ufo_two_way_queue_get_stats (queue, &stats);
+    ufo_two_way_queue_free (queue);
+
+    g_assert (stats.n_items == 3);
+    g_assert_cmpuint (stats.occupancy, ==, 0);
+    g_assert_cmpuint (stats.max_occupancy, ==, 1);
+
+    g_assert (!ufo_profiler_get_queue_stats (fixture->profiler, &item, &stats));
+    ufo_profiler_set_queue_stats (fixture->profiler, &item, &stats);
+    stats.n_items = 0;
+    g_assert (ufo_profiler_get_queue_stats (fixture->profiler, &item, &stats));
+    g_assert (stats.n_items == 3);
+}
+
+static void
+test_histogram (Fixture *fixture, gconstpointer data)
+{
+    gdouble p50;
+    gdouble p99;
+
+    g_assert (ufo_profiler_get_percentile (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS, 50.0) == 0.0);
+
+    for (guint i = 1; i <= 100; i++)
+        ufo_profiler_record_duration (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS, i * 1e-3);
+
+    g_assert (ufo_profiler_get_num_durations (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS) == 100);
+    g_assert (ufo_profiler_get_num_durations (fixture->profiler, UFO_PROFILER_HISTOGRAM_GENERATE) == 0);
+
+    p50 = ufo_profiler_get_percentile (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS, 50.0);
+    p99 = ufo_profiler_get_percentile (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS, 99.0);
+
+    g_assert_cmpfloat (ABS (p50 - 50e-3), <=, 50e-3 / 16);
+    g_assert_cmpfloat (ABS (p99 - 99e-3), <=, 99e-3 / 16);
+    g_assert_cmpfloat (ABS (ufo_profiler_get_percentile (fixture->profiler, UFO_PROFILER_HISTOGRAM_PROCESS, 100.0) - 0.1), <, 1e-9);
+}
+
+static void
+test_memory (Fixture *fixture, gconstpointer data)
+{
+    UfoRequisition requisition = { .n_dims = 1, .dims[0] = 256 };
+    UfoBuffer *buffer;
+    gsize current;
+    gsize peak;
+    gsize total;
+
+    ufo_profiler_get_total_memory (NULL, &total, NULL);
+
+    buffer = ufo_buffer_new (&requisition, NULL);
+    ufo_buffer_set_profiler (buffer, fixture->profiler);
+    ufo_profiler_get_memory (fixture->profiler, NULL, &current, NULL);
+    g_assert_cmpuint (current, ==, 0);
+
+    ufo_buffer_get_host_array (buffer, NULL);
+    ufo_profiler_get_memory (fixture->profiler, NULL, &current, &peak);
+    g_assert_cmpuint (current, ==, 256 * sizeof (gfloat));
+    g_assert_cmpuint (peak, ==, 256 * sizeof (gfloat));
+
+    ufo_profiler_get_total_memory (NULL, &current, NULL);
+    g_assert_cmpuint (current, ==, total + 256 * sizeof (gfloat));
+
+    g_object_unref (buffer);
+    ufo_profiler_get_memory (fixture->profiler, NULL, &current, &peak);
+    g_assert_cmpuint (current, ==, 0);
+    g_assert_cmpuint (peak, ==, 256 * sizeof (gfloat));
+}
 
 void
 test_add_profiler (void)
@@ -72,4 +202,39 @@ test_add_profiler (void)
                 fixture_setup,
                 test_timer_elapsed,
                 fixture_teardown);
+
+    g_test_add ("/no-opencl/profiler/dropped",
+                Fixture,
+                NULL,
+                fixture_setup,
+                test_dropped,
+                fixture_teardown);
+
+    g_test_add ("/no-opencl/profiler/queue-stats",
+                Fixture,
+                NULL,
+                fixture_setup,
+                test_queue_stats,
+                fixture_teardown);
+
+    g_test_add ("/no-opencl/profiler/histogram",
+                Fixture,
+                NULL,
+                fixture_setup,
+                test_histogram,
+                fixture_teardown);
+
+    g_test_add ("/no-opencl/profiler/memory",
+                Fixture,
+                NULL,
+                fixture_setup,
+                test_memory,
+                fixture_teardown);
+
+    g_test_add ("/no-opencl/profiler/trace",
+                Fixture,
+                NULL,
+                fixture_setup,
+                test_trace_events,
+                fixture_teardown);
 }
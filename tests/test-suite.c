@@ -42,8 +42,10 @@ int main(int argc, char *argv[])
     g_log_set_handler ("Ufo", G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG, ignore_log, NULL);
     g_log_set_handler ("ocl", G_LOG_LEVEL_MESSAGE | G_LOG_LEVEL_INFO | G_LOG_LEVEL_DEBUG, ignore_log, NULL);
 
+    test_add_basic_ops ();
     test_add_buffer ();
     test_add_graph ();
+    test_add_group ();
     test_add_profiler ();
     test_add_node ();
 
@@ -20,8 +20,10 @@
 #ifndef TEST_SUITE_H
 #define TEST_SUITE_H
 
+void test_add_basic_ops (void);
 void test_add_buffer (void);
 void test_add_graph (void);
+void test_add_group (void);
 void test_add_node (void);
 void test_add_profiler (void);
 void test_add_remote_node (void);
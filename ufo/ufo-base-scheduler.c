@@ -28,7 +28,9 @@
 #include <CL/cl.h>
 #endif
 
+#include <string.h>
 #include <ufo/ufo-base-scheduler.h>
+#include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-task-iface.h>
 #include "ufo-priv.h"
@@ -58,9 +60,15 @@ G_DEFINE_TYPE_WITH_CODE (UfoBaseScheduler, ufo_base_scheduler, G_TYPE_OBJECT,
 struct _UfoBaseSchedulerPrivate {
     GError          *construct_error;
     UfoResources    *resources;
+    GCancellable    *cancellable;
+    gboolean         own_cancellable;   /* FALSE if set by the caller */
     GList           *gpu_nodes;
     gboolean         expand;
     gboolean         trace;
+    gboolean         low_latency;
+    gchar           *metrics_file;
+    guint            metrics_port;
+    gdouble          metrics_interval;
     gboolean         ran;
     gdouble          time;
 };
@@ -69,6 +77,10 @@ enum {
     PROP_0,
     PROP_EXPAND,
     PROP_ENABLE_TRACING,
+    PROP_LOW_LATENCY,
+    PROP_METRICS_FILE,
+    PROP_METRICS_PORT,
+    PROP_METRICS_INTERVAL,
     PROP_TIME,
     N_PROPERTIES,
 };
@@ -101,17 +113,216 @@ enable_tracing (UfoTaskGraph *graph)
         ufo_profiler_enable_tracing (profiler, TRUE);
     }
 
+    ufo_start_tracing (nodes);
     g_list_free (nodes);
 }
 
+static void
+select_queues (UfoBaseScheduler *scheduler,
+               UfoTaskGraph *graph)
+{
+    UfoResources *resources;
+    GList *nodes;
+    GList *gpu_nodes;
+    GList *it;
+    gboolean uses_gpu;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+    uses_gpu = ufo_any_task_uses_gpu (nodes);
+    g_list_free (nodes);
+
+    /* Do not initialize OpenCL just to select queues nobody is going to use */
+    if (!uses_gpu)
+        return;
+
+    /* Only pay for OpenCL profiling if somebody is going to look at it */
+    resources = ufo_base_scheduler_get_resources (scheduler);
+    gpu_nodes = ufo_resources_get_gpu_nodes (resources);
+
+    g_list_for (gpu_nodes, it) {
+        ufo_gpu_node_set_profiling (UFO_GPU_NODE (it->data), scheduler->priv->trace);
+    }
+
+    g_list_free (gpu_nodes);
+}
+
 static void
 write_tracing_data (UfoTaskGraph *graph)
 {
     GList *nodes;
 
     nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
-    ufo_write_profile_events (nodes);
-    ufo_write_opencl_events (nodes);
+    ufo_stop_tracing (nodes);
+    g_list_free (nodes);
+}
+
+static gdouble
+get_producer_blocked (UfoNode *producer,
+                      UfoNode *consumer)
+{
+    UfoTwoWayQueueStats stats;
+
+    if (!ufo_profiler_get_queue_stats (ufo_task_node_get_profiler (UFO_TASK_NODE (consumer)),
+                                       producer, &stats))
+        return 0.0;
+
+    return stats.producer_blocked;
+}
+
+/*
+ * The statistics below are only logged as debug messages, which the default
+ * handler shows if G_MESSAGES_DEBUG selects them. Collecting them walks all
+ * nodes and histograms, so skip that work otherwise.
+ */
+static gboolean
+debug_enabled (void)
+{
+    const gchar *domains;
+
+    domains = g_getenv ("G_MESSAGES_DEBUG");
+
+    if (domains == NULL)
+        return FALSE;
+
+#ifdef G_LOG_DOMAIN
+    if (strstr (domains, G_LOG_DOMAIN) != NULL)
+        return TRUE;
+#endif
+
+    return strstr (domains, "all") != NULL;
+}
+
+/*
+ * Log the statistics of all edges. A node that keeps its producers waiting
+ * but is not kept waiting by its own consumers limits the throughput of the
+ * graph.
+ */
+static void
+log_queue_stats (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+    UfoNode *bottleneck = NULL;
+    gdouble max_score = 0.0;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoNode *node;
+        UfoProfiler *profiler;
+        GList *predecessors;
+        GList *successors;
+        GList *jt;
+        gdouble score = 0.0;
+
+        node = UFO_NODE (it->data);
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (node));
+        predecessors = ufo_graph_get_predecessors (UFO_GRAPH (graph), node);
+        successors = ufo_graph_get_successors (UFO_GRAPH (graph), node);
+
+        g_list_for (predecessors, jt) {
+            UfoTwoWayQueueStats stats;
+
+            if (!ufo_profiler_get_queue_stats (profiler, jt->data, &stats))
+                continue;
+
+            g_debug ("%s-%p -> %s-%p: %" G_GUINT64_FORMAT " items, max occupancy %u, "
+                     "producer blocked %.3f s, consumer blocked %.3f s",
+                     G_OBJECT_TYPE_NAME (jt->data), jt->data,
+                     G_OBJECT_TYPE_NAME (node), (gpointer) node,
+                     stats.n_items, stats.max_occupancy,
+                     stats.producer_blocked, stats.consumer_blocked);
+
+            score += stats.producer_blocked;
+        }
+
+        g_list_for (successors, jt) {
+            score -= get_producer_blocked (node, UFO_NODE (jt->data));
+        }
+
+        if (score > max_score) {
+            max_score = score;
+            bottleneck = node;
+        }
+
+        g_list_free (predecessors);
+        g_list_free (successors);
+    }
+
+    if (bottleneck != NULL)
+        g_debug ("Producers waited %.3f s longer for %s-%p than it waited for its consumers",
+                 max_score, G_OBJECT_TYPE_NAME (bottleneck), (gpointer) bottleneck);
+
+    g_list_free (nodes);
+}
+
+static void
+log_durations (UfoTaskGraph *graph)
+{
+    static const gchar *names[] = { "process", "generate", "latency" };
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoProfiler *profiler;
+
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (it->data));
+
+        for (guint i = 0; i < UFO_PROFILER_HISTOGRAM_LAST; i++) {
+            guint64 n_durations;
+
+            n_durations = ufo_profiler_get_num_durations (profiler, i);
+
+            if (n_durations == 0)
+                continue;
+
+            g_debug ("%s-%p %s: %" G_GUINT64_FORMAT " items, p50=%.3f ms p90=%.3f ms p99=%.3f ms max=%.3f ms",
+                     G_OBJECT_TYPE_NAME (it->data), it->data, names[i], n_durations,
+                     ufo_profiler_get_percentile (profiler, i, 50.0) * 1e3,
+                     ufo_profiler_get_percentile (profiler, i, 90.0) * 1e3,
+                     ufo_profiler_get_percentile (profiler, i, 99.0) * 1e3,
+                     ufo_profiler_get_percentile (profiler, i, 100.0) * 1e3);
+        }
+    }
+
+    g_list_free (nodes);
+}
+
+static void
+log_memory (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoProfiler *profiler;
+        GList *devices;
+        GList *jt;
+
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (it->data));
+        devices = ufo_profiler_get_memory_devices (profiler);
+
+        g_list_for (devices, jt) {
+            gsize current;
+            gsize peak;
+
+            ufo_profiler_get_memory (profiler, jt->data, &current, &peak);
+
+            if (jt->data == NULL)
+                g_debug ("%s-%p host memory: peak %zu bytes, %zu bytes still allocated",
+                         G_OBJECT_TYPE_NAME (it->data), it->data, peak, current);
+            else
+                g_debug ("%s-%p device %p memory: peak %zu bytes, %zu bytes still allocated",
+                         G_OBJECT_TYPE_NAME (it->data), it->data, jt->data, peak, current);
+        }
+
+        g_list_free (devices);
+    }
+
     g_list_free (nodes);
 }
 
@@ -135,6 +346,8 @@ ufo_base_scheduler_run (UfoBaseScheduler *scheduler,
     if (scheduler->priv->trace)
         enable_tracing (graph);
 
+    select_queues (scheduler, graph);
+
 #ifdef WITH_PYTHON
     PyEval_InitThreads();
 #endif
@@ -143,12 +356,84 @@ ufo_base_scheduler_run (UfoBaseScheduler *scheduler,
     (*klass->run)(scheduler, graph, error);
     scheduler->priv->time = g_timer_elapsed (timer, NULL);
 
+    if (g_cancellable_is_cancelled (scheduler->priv->cancellable)) {
+        if (error == NULL || *error == NULL)
+            g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                                 "Execution was aborted");
+
+        /* A cancellable of the caller stays cancelled for the caller to see */
+        if (scheduler->priv->own_cancellable)
+            g_cancellable_reset (scheduler->priv->cancellable);
+    }
+
+    if (debug_enabled ()) {
+        log_queue_stats (graph);
+        log_durations (graph);
+        log_memory (graph);
+    }
+
     if (scheduler->priv->trace)
         write_tracing_data (graph);
 
     g_timer_destroy (timer);
 }
 
+/**
+ * ufo_base_scheduler_abort:
+ * @scheduler: A #UfoBaseScheduler
+ *
+ * Stop a running ufo_base_scheduler_run() as soon as possible. All threads
+ * blocked on data transfers are woken up and the run returns with a
+ * %G_IO_ERROR_CANCELLED error. This function can be called from any thread.
+ */
+void
+ufo_base_scheduler_abort (UfoBaseScheduler *scheduler)
+{
+    g_return_if_fail (UFO_IS_BASE_SCHEDULER (scheduler));
+    g_cancellable_cancel (scheduler->priv->cancellable);
+}
+
+/**
+ * ufo_base_scheduler_set_cancellable:
+ * @scheduler: A #UfoBaseScheduler
+ * @cancellable: A #GCancellable
+ *
+ * Use @cancellable to abort runs of @scheduler instead of the internal one.
+ * Cancelling @cancellable has the same effect as calling
+ * ufo_base_scheduler_abort().
+ */
+void
+ufo_base_scheduler_set_cancellable (UfoBaseScheduler *scheduler,
+                                    GCancellable *cancellable)
+{
+    UfoBaseSchedulerPrivate *priv;
+
+    g_return_if_fail (UFO_IS_BASE_SCHEDULER (scheduler));
+    g_return_if_fail (G_IS_CANCELLABLE (cancellable));
+    priv = scheduler->priv;
+
+    g_object_ref (cancellable);
+    g_object_unref (priv->cancellable);
+    priv->cancellable = cancellable;
+    priv->own_cancellable = FALSE;
+}
+
+/**
+ * ufo_base_scheduler_get_cancellable:
+ * @scheduler: A #UfoBaseScheduler
+ *
+ * Get the #GCancellable that implementations of #UfoBaseSchedulerClass.run
+ * must watch to stop early.
+ *
+ * Returns: (transfer none): A #GCancellable.
+ */
+GCancellable *
+ufo_base_scheduler_get_cancellable (UfoBaseScheduler *scheduler)
+{
+    g_return_val_if_fail (UFO_IS_BASE_SCHEDULER (scheduler), NULL);
+    return scheduler->priv->cancellable;
+}
+
 /**
  * ufo_base_scheduler_set_resources:
  * @scheduler: A #UfoBaseScheduler object
@@ -243,6 +528,23 @@ ufo_base_scheduler_set_property (GObject *object,
             priv->trace = g_value_get_boolean (value);
             break;
 
+        case PROP_LOW_LATENCY:
+            priv->low_latency = g_value_get_boolean (value);
+            break;
+
+        case PROP_METRICS_FILE:
+            g_free (priv->metrics_file);
+            priv->metrics_file = g_value_dup_string (value);
+            break;
+
+        case PROP_METRICS_PORT:
+            priv->metrics_port = g_value_get_uint (value);
+            break;
+
+        case PROP_METRICS_INTERVAL:
+            priv->metrics_interval = g_value_get_double (value);
+            break;
+
         default:
             G_OBJECT_WARN_INVALID_PROPERTY_ID(object, property_id, pspec);
             break;
@@ -266,6 +568,22 @@ ufo_base_scheduler_get_property (GObject *object,
             g_value_set_boolean (value, priv->trace);
             break;
 
+        case PROP_LOW_LATENCY:
+            g_value_set_boolean (value, priv->low_latency);
+            break;
+
+        case PROP_METRICS_FILE:
+            g_value_set_string (value, priv->metrics_file);
+            break;
+
+        case PROP_METRICS_PORT:
+            g_value_set_uint (value, priv->metrics_port);
+            break;
+
+        case PROP_METRICS_INTERVAL:
+            g_value_set_double (value, priv->metrics_interval);
+            break;
+
         case PROP_TIME:
             g_value_set_double (value, priv->time);
             break;
@@ -288,6 +606,11 @@ ufo_base_scheduler_dispose (GObject *object)
         priv->resources = NULL;
     }
 
+    if (priv->cancellable != NULL) {
+        g_object_unref (priv->cancellable);
+        priv->cancellable = NULL;
+    }
+
     G_OBJECT_CLASS (ufo_base_scheduler_parent_class)->dispose (object);
 }
 
@@ -299,6 +622,7 @@ ufo_base_scheduler_finalize (GObject *object)
     priv = UFO_BASE_SCHEDULER_GET_PRIVATE (object);
 
     g_clear_error (&priv->construct_error);
+    g_free (priv->metrics_file);
 
     G_OBJECT_CLASS (ufo_base_scheduler_parent_class)->finalize (object);
 }
@@ -363,6 +687,62 @@ ufo_base_scheduler_class_init (UfoBaseSchedulerClass *klass)
                               FALSE,
                               G_PARAM_READWRITE);
 
+    /**
+     * UfoBaseScheduler:low-latency:
+     *
+     * Optimize for the latency of a single item rather than throughput. Edges
+     * hold at most one item, queues are polled before a thread goes to sleep
+     * and each task thread is pinned to a CPU. Schedulers that do not support
+     * this mode ignore it.
+     */
+    properties[PROP_LOW_LATENCY] =
+        g_param_spec_boolean ("low-latency",
+                              "Minimize per-item latency",
+                              "Minimize per-item latency",
+                              FALSE,
+                              G_PARAM_READWRITE);
+
+    /**
+     * UfoBaseScheduler:metrics-file:
+     *
+     * Periodically replace this file with live metrics of the running graph
+     * in the Prometheus text format. Schedulers that do not support live
+     * metrics ignore it.
+     */
+    properties[PROP_METRICS_FILE] =
+        g_param_spec_string ("metrics-file",
+                             "File to write live metrics to",
+                             "File to write live metrics to",
+                             NULL,
+                             G_PARAM_READWRITE);
+
+    /**
+     * UfoBaseScheduler:metrics-port:
+     *
+     * Serve live metrics over HTTP on this port of localhost, 0 disables the
+     * server. Schedulers that do not support live metrics ignore it.
+     */
+    properties[PROP_METRICS_PORT] =
+        g_param_spec_uint ("metrics-port",
+                           "Local port to serve live metrics on",
+                           "Local port to serve live metrics on",
+                           0, G_MAXUINT16, 0,
+                           G_PARAM_READWRITE);
+
+    /**
+     * UfoBaseScheduler:metrics-interval:
+     *
+     * Seconds between two samples of the live metrics written to
+     * #UfoBaseScheduler:metrics-file or served on
+     * #UfoBaseScheduler:metrics-port.
+     */
+    properties[PROP_METRICS_INTERVAL] =
+        g_param_spec_double ("metrics-interval",
+                             "Interval between metrics samples",
+                             "Interval between metrics samples in seconds",
+                             0.01, G_MAXDOUBLE, 1.0,
+                             G_PARAM_READWRITE);
+
     properties[PROP_TIME] =
         g_param_spec_double ("time",
                              "Finished execution time",
@@ -384,8 +764,14 @@ ufo_base_scheduler_init (UfoBaseScheduler *scheduler)
     scheduler->priv = priv = UFO_BASE_SCHEDULER_GET_PRIVATE (scheduler);
     priv->expand = TRUE;
     priv->trace = FALSE;
+    priv->low_latency = FALSE;
+    priv->metrics_file = NULL;
+    priv->metrics_port = 0;
+    priv->metrics_interval = 1.0;
     priv->ran = FALSE;
     priv->time = 0.0;
     priv->gpu_nodes = NULL;
     priv->resources = NULL;
+    priv->cancellable = g_cancellable_new ();
+    priv->own_cancellable = TRUE;
 }
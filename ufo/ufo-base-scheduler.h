@@ -24,6 +24,7 @@
 #error "Only <ufo/ufo.h> can be included directly."
 #endif
 
+#include <gio/gio.h>
 #include <ufo/ufo-task-graph.h>
 
 G_BEGIN_DECLS
@@ -75,6 +76,10 @@ struct _UfoBaseSchedulerClass {
 void            ufo_base_scheduler_run              (UfoBaseScheduler   *scheduler,
                                                      UfoTaskGraph       *task_graph,
                                                      GError            **error);
+void            ufo_base_scheduler_abort            (UfoBaseScheduler   *scheduler);
+void            ufo_base_scheduler_set_cancellable  (UfoBaseScheduler   *scheduler,
+                                                     GCancellable       *cancellable);
+GCancellable   *ufo_base_scheduler_get_cancellable  (UfoBaseScheduler   *scheduler);
 void            ufo_base_scheduler_set_resources    (UfoBaseScheduler   *scheduler,
                                                      UfoResources       *resources);
 UfoResources   *ufo_base_scheduler_get_resources    (UfoBaseScheduler   *scheduler);
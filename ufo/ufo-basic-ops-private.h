@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_BASIC_OPS_PRIVATE_H
+#define UFO_BASIC_OPS_PRIVATE_H
+
+#include <ufo/ufo-buffer.h>
+
+/* Helpers shared by the basic operations and fused expressions */
+
+gboolean    ufo_op_is_on_host       (UfoBuffer  *buffer);
+gboolean    ufo_op_use_host         (gpointer    command_queue,
+                                     UfoBuffer  *arg1,
+                                     UfoBuffer  *arg2);
+gpointer    ufo_op_completed_event  (gpointer    command_queue);
+
+#endif
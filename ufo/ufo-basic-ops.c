@@ -24,11 +24,367 @@
 #endif
 
 #include <math.h>
+#include <unistd.h>
 #include <ufo/ufo-basic-ops.h>
+#include "ufo-basic-ops-private.h"
+/**
+ * SECTION:ufo-basic-ops
+ * @Short_description: Basic arithmetic on buffers
+ * @Title: Basic operations
+ *
+ * The ufo_op_* functions compute element-wise arithmetic, gradients and norms
+ * of #UfoBuffer objects. They run as OpenCL kernels on the given command
+ * queue. If the command queue is %NULL or all inputs currently live on the
+ * host, they are computed on the host with all available cores instead. In
+ * that case they return an already completed event, or %NULL if there is no
+ * command queue.
+ */
+
 #define OPS_FILENAME "ufo-basic-ops.cl"
+#define HOST_MIN_ELEMENTS_PER_THREAD    65536
+
+/*
+ * Host implementations of the basic operations. They are used if there is no
+ * command queue or if all inputs are only available on the host. Results
+ * match the OpenCL kernels, including their clamp-to-edge border handling.
+ */
+
+typedef enum {
+    HOST_OP_SET,
+    HOST_OP_INV,
+    HOST_OP_MUL,
+    HOST_OP_ADD,
+    HOST_OP_ADD2,
+    HOST_OP_DEDUCTION,
+    HOST_OP_DEDUCTION2,
+    HOST_OP_GRADIENT_MAGNITUDE,
+    HOST_OP_GRADIENT_DIRECTION,
+    HOST_OP_POSC,
+    HOST_OP_DESCENT_GRAD,
+} HostOpType;
+
+typedef struct {
+    HostOpType      type;
+    const gfloat   *arg1;
+    const gfloat   *arg2;
+    gfloat         *out;
+    gfloat          value;
+    gsize           width;
+    gsize           height;
+} HostOp;
+
+typedef struct {
+    HostOp     *op;
+    gsize       first_row;
+    gsize       last_row;
+    GMutex     *lock;
+    GCond      *finished;
+    guint      *n_remaining;
+} HostJob;
+
+static GThreadPool *host_pool = NULL;
+static guint host_n_threads = 1;
+
+static inline gfloat
+clamped (const gfloat *data, gsize width, gsize height, gssize x, gssize y)
+{
+    x = CLAMP (x, 0, (gssize) width - 1);
+    y = CLAMP (y, 0, (gssize) height - 1);
+    return data[y * width + x];
+}
+
+static void
+host_op_rows (HostOp *op,
+              gsize first_row,
+              gsize last_row)
+{
+    const gsize w = op->width;
+    const gsize h = op->height;
+    const gfloat *a = op->arg1 + first_row * w;
+    const gfloat *b = op->arg2 != NULL ? op->arg2 + first_row * w : NULL;
+    gfloat *out = op->out + first_row * w;
+    const gsize n = (last_row - first_row) * w;
+
+    switch (op->type) {
+        case HOST_OP_SET:
+            for (gsize i = 0; i < n; i++)
+                out[i] = op->value;
+            break;
+
+        case HOST_OP_INV:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] != 0.0f ? 1.0f / a[i] : 0.0f;
+            break;
+
+        case HOST_OP_MUL:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] * b[i];
+            break;
+
+        case HOST_OP_ADD:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] + b[i];
+            break;
+
+        case HOST_OP_ADD2:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] + op->value * b[i];
+            break;
+
+        case HOST_OP_DEDUCTION:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] - b[i];
+            break;
+
+        case HOST_OP_DEDUCTION2:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] - op->value * b[i];
+            break;
+
+        case HOST_OP_POSC:
+            for (gsize i = 0; i < n; i++)
+                out[i] = a[i] > 0.0f ? a[i] : 0.0f;
+            break;
+
+        case HOST_OP_GRADIENT_MAGNITUDE:
+            for (gssize y = first_row; y < (gssize) last_row; y++) {
+                for (gssize x = 0; x < (gssize) w; x++) {
+                    const gfloat c = op->arg1[y * w + x];
+                    const gfloat d1 = clamped (op->arg1, w, h, x + 1, y) - c;
+                    const gfloat d2 = clamped (op->arg1, w, h, x - 1, y) - c;
+                    const gfloat d3 = clamped (op->arg1, w, h, x, y + 1) - c;
+                    const gfloat d4 = clamped (op->arg1, w, h, x, y - 1) - c;
+
+                    op->out[y * w + x] = sqrtf ((d1 * d1 + d2 * d2 + d3 * d3 + d4 * d4) / 2.0f);
+                }
+            }
+            break;
+
+        case HOST_OP_GRADIENT_DIRECTION:
+            for (gssize y = first_row; y < (gssize) last_row; y++) {
+                for (gssize x = 0; x < (gssize) w; x++) {
+                    const gssize nx[5] = { x, x + 1, x - 1, x, x };
+                    const gssize ny[5] = { y, y, y, y + 1, y - 1 };
+                    gfloat v[5];
+                    gfloat m[5];
+                    gfloat direction = 0.0f;
+
+                    for (guint k = 0; k < 5; k++) {
+                        v[k] = clamped (op->arg1, w, h, nx[k], ny[k]);
+                        m[k] = clamped (op->arg2, w, h, nx[k], ny[k]);
+                    }
+
+                    if (m[0] != 0.0f)
+                        direction += (4 * v[0] - v[1] - v[2] - v[3] - v[4]) / m[0];
+
+                    for (guint k = 1; k < 5; k++) {
+                        if (m[k] != 0.0f)
+                            direction += (v[0] - v[k]) / m[k];
+                    }
+
+                    op->out[y * w + x] = direction;
+                }
+            }
+            break;
+
+        case HOST_OP_DESCENT_GRAD:
+            for (gssize y = first_row; y < (gssize) last_row; y++) {
+                for (gssize x = 0; x < (gssize) w; x++) {
+                    const gfloat eps = 1e-8f;
+                    const gfloat v0 = clamped (op->arg1, w, h, x, y);
+                    const gfloat v1 = clamped (op->arg1, w, h, x - 1, y);
+                    const gfloat v2 = clamped (op->arg1, w, h, x, y - 1);
+                    const gfloat v3 = clamped (op->arg1, w, h, x + 1, y);
+                    const gfloat v4 = clamped (op->arg1, w, h, x, y + 1);
+                    const gfloat v5 = clamped (op->arg1, w, h, x + 1, y - 1);
+                    const gfloat v6 = clamped (op->arg1, w, h, x - 1, y + 1);
+                    gfloat t1, t2;
+                    gfloat part0, part1, part2;
+
+                    t1 = v0 - v1;
+                    t2 = v0 - v2;
+                    part0 = (t1 + t2) / sqrtf (eps + t1 * t1 + t2 * t2);
+                    t1 = v3 - v0;
+                    t2 = v3 - v5;
+                    part1 = t1 / sqrtf (eps + t1 * t1 + t2 * t2);
+                    t1 = v4 - v0;
+                    t2 = v4 - v6;
+                    part2 = t1 / sqrtf (eps + t1 * t1 + t2 * t2);
+
+                    op->out[y * w + x] = part0 - part1 - part2;
+                }
+            }
+            break;
+    }
+}
+
+static void
+run_host_job (HostJob *job, gpointer unused)
+{
+    host_op_rows (job->op, job->first_row, job->last_row);
+
+    g_mutex_lock (job->lock);
+
+    if (--(*job->n_remaining) == 0)
+        g_cond_signal (job->finished);
+
+    g_mutex_unlock (job->lock);
+}
+
+static gpointer
+create_host_pool (gpointer unused)
+{
+    host_n_threads = MAX (1, (guint) sysconf (_SC_NPROCESSORS_ONLN));
+    host_pool = g_thread_pool_new ((GFunc) run_host_job, NULL, host_n_threads, FALSE, NULL);
+    return NULL;
+}
+
+/*
+ * Split the rows of @op across the cores. Small problems are computed by the
+ * calling thread because handing them over costs more than it saves.
+ */
+static void
+run_on_host (HostOp *op)
+{
+    static GOnce pool_once = G_ONCE_INIT;
+    HostJob *jobs;
+    GMutex *lock;
+    GCond *finished;
+    gsize rows_per_job;
+    guint n_jobs;
+    guint n_remaining;
+
+    g_once (&pool_once, create_host_pool, NULL);
+
+    n_jobs = (guint) MIN (op->height, MAX (1, op->width * op->height / HOST_MIN_ELEMENTS_PER_THREAD));
+    n_jobs = MIN (n_jobs, host_n_threads);
+
+    if (n_jobs <= 1 || host_pool == NULL) {
+        host_op_rows (op, 0, op->height);
+        return;
+    }
+
+    jobs = g_new0 (HostJob, n_jobs);
+    lock = g_mutex_new ();
+    finished = g_cond_new ();
+    rows_per_job = (op->height + n_jobs - 1) / n_jobs;
+    n_remaining = n_jobs;
+
+    for (guint i = 0; i < n_jobs; i++) {
+        jobs[i].op = op;
+        jobs[i].first_row = MIN (i * rows_per_job, op->height);
+        jobs[i].last_row = MIN ((i + 1) * rows_per_job, op->height);
+        jobs[i].lock = lock;
+        jobs[i].finished = finished;
+        jobs[i].n_remaining = &n_remaining;
+    }
+
+    g_mutex_lock (lock);
+
+    for (guint i = 0; i < n_jobs; i++)
+        g_thread_pool_push (host_pool, &jobs[i], NULL);
+
+    while (n_remaining > 0)
+        g_cond_wait (finished, lock);
+
+    g_mutex_unlock (lock);
+
+    g_cond_free (finished);
+    g_mutex_free (lock);
+    g_free (jobs);
+}
+
+gboolean
+ufo_op_is_on_host (UfoBuffer *buffer)
+{
+    UfoBufferLocation location;
+
+    location = ufo_buffer_get_location (buffer);
+    return location == UFO_BUFFER_LOCATION_HOST || location == UFO_BUFFER_LOCATION_INVALID;
+}
+
+/* Compute on the host if there is no queue or no input is on the device */
+gboolean
+ufo_op_use_host (gpointer command_queue,
+                 UfoBuffer *arg1,
+                 UfoBuffer *arg2)
+{
+    if (command_queue == NULL)
+        return TRUE;
+
+    return ufo_op_is_on_host (arg1) && (arg2 == NULL || ufo_op_is_on_host (arg2));
+}
+
+/*
+ * Run @type on the host. Element-wise operations treat the data as one long
+ * row, stencils use the first two dimensions. Like the kernels, the size is
+ * taken from @arg1, or from @out if there is no input. Returns %FALSE if
+ * another buffer is too small.
+ */
+static gboolean
+operation_on_host (HostOpType type,
+                   UfoBuffer *arg1,
+                   UfoBuffer *arg2,
+                   gfloat value,
+                   UfoBuffer *out,
+                   gpointer command_queue)
+{
+    UfoRequisition requisition;
+    UfoBuffer *sizing;
+    HostOp op;
+
+    sizing = arg1 != NULL ? arg1 : out;
+    ufo_buffer_get_requisition (sizing, &requisition);
+
+    if (ufo_buffer_get_size (out) < ufo_buffer_get_size (sizing) ||
+        (arg2 != NULL && ufo_buffer_get_size (arg2) < ufo_buffer_get_size (sizing))) {
+        g_warning ("Buffers are smaller than the first argument, operation skipped");
+        return FALSE;
+    }
+
+    op.type = type;
+    op.arg1 = arg1 != NULL ? ufo_buffer_get_host_array (arg1, command_queue) : NULL;
+    op.arg2 = arg2 != NULL ? ufo_buffer_get_host_array (arg2, command_queue) : NULL;
+    op.out = ufo_buffer_get_host_array (out, command_queue);
+    op.value = value;
+    op.width = requisition.n_dims > 0 ? requisition.dims[0] : 1;
+    op.height = 1;
+
+    for (guint i = 1; i < requisition.n_dims; i++)
+        op.height *= requisition.dims[i];
+
+    if (type == HOST_OP_SET)
+        op.arg1 = op.out;
+
+    run_on_host (&op);
+    return TRUE;
+}
+
+/*
+ * Return a completed event for an operation that ran on the host, so that
+ * callers can wait on or release the result regardless of where it ran.
+ */
+gpointer
+ufo_op_completed_event (gpointer command_queue)
+{
+    cl_context context;
+    cl_event event;
+    cl_int errcode;
+
+    if (command_queue == NULL)
+        return NULL;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (command_queue, CL_QUEUE_CONTEXT,
+                                                      sizeof (cl_context), &context, NULL));
+    event = clCreateUserEvent (context, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+    UFO_RESOURCES_CHECK_CLERR (clSetUserEventStatus (event, CL_COMPLETE));
+    return event;
+}
 
 static cl_event
 operation (const gchar *kernel_name,
+           HostOpType host_op,
            UfoBuffer *arg1,
            UfoBuffer *arg2,
            UfoBuffer *out,
@@ -37,6 +393,7 @@ operation (const gchar *kernel_name,
 
 static cl_event
 operation2 (const gchar *kernel_name,
+            HostOpType host_op,
             UfoBuffer *arg1,
             UfoBuffer *arg2,
             gfloat modifier,
@@ -49,11 +406,12 @@ operation2 (const gchar *kernel_name,
  * @arg: A #UfoBuffer
  * @value: Value to fill @arg with
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
- * Fill a buffer with a value using OpenCL.
+ * Fill a buffer with a value.
  *
- * Returns: (transfer full): Event of the set operation
+ * Returns: (transfer full) (allow-none): Event of the set operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_set (UfoBuffer *arg,
@@ -66,24 +424,27 @@ ufo_op_set (UfoBuffer *arg,
     cl_mem d_arg;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    if (ufo_op_use_host (command_queue, arg, NULL)) {
+        if (!operation_on_host (HOST_OP_SET, NULL, NULL, value, arg, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
 
     ufo_buffer_get_requisition (arg, &requisition);
     d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_set", &error);
+    kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "operation_set", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(gfloat), (void *) &value));
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       requisition.n_dims, NULL, requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  requisition.n_dims, requisition.dims, (gpointer *) &event);
 
     return event;
 }
@@ -92,11 +453,12 @@ ufo_op_set (UfoBuffer *arg,
  * ufo_op_inv:
  * @arg: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * Invert @arg.
  *
- * Returns: (transfer full): Event of the invert operation
+ * Returns: (transfer full) (allow-none): Event of the invert operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_inv (UfoBuffer *arg,
@@ -108,25 +470,28 @@ ufo_op_inv (UfoBuffer *arg,
     cl_kernel kernel;
     cl_mem d_arg;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
+
+    if (ufo_op_use_host (command_queue, arg, NULL)) {
+        if (!operation_on_host (HOST_OP_INV, arg, NULL, 0.0f, arg, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
 
     ufo_buffer_get_requisition (arg, &requisition);
 
     d_arg = ufo_buffer_get_device_image (arg, command_queue);
-    kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_inv", &error);
+    kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "operation_inv", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg));
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel(command_queue, kernel,
-                                                      requisition.n_dims, NULL, requisition.dims,
-                                                      NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  requisition.n_dims, requisition.dims, (gpointer *) &event);
 
     return event;
 }
@@ -137,11 +502,12 @@ ufo_op_inv (UfoBuffer *arg,
  * @arg2: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * out = arg1 * arg2
  *
- * Returns: (transfer full): Event of the mul operation
+ * Returns: (transfer full) (allow-none): Event of the mul operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_mul (UfoBuffer *arg1,
@@ -150,7 +516,7 @@ ufo_op_mul (UfoBuffer *arg1,
             UfoResources *resources,
             gpointer command_queue)
 {
-    return operation ("operation_mul", arg1, arg2, out, resources, command_queue);
+    return operation ("operation_mul", HOST_OP_MUL, arg1, arg2, out, resources, command_queue);
 }
 
 /**
@@ -159,11 +525,12 @@ ufo_op_mul (UfoBuffer *arg1,
  * @arg2: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * out = arg1 + arg2
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_add (UfoBuffer *arg1,
@@ -172,7 +539,7 @@ ufo_op_add (UfoBuffer *arg1,
             UfoResources *resources,
             gpointer command_queue)
 {
-    return operation ("operation_add", arg1, arg2, out, resources, command_queue);
+    return operation ("operation_add", HOST_OP_ADD, arg1, arg2, out, resources, command_queue);
 }
 
 /**
@@ -182,11 +549,12 @@ ufo_op_add (UfoBuffer *arg1,
  * @modifier: Scalar value
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * @out = @arg1 + @modifier * @arg2
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_add2 (UfoBuffer *arg1,
@@ -196,7 +564,7 @@ ufo_op_add2 (UfoBuffer *arg1,
              UfoResources *resources,
              gpointer command_queue)
 {
-    return operation2 ("operation_add2", arg1, arg2, modifier, out, resources, command_queue);
+    return operation2 ("operation_add2", HOST_OP_ADD2, arg1, arg2, modifier, out, resources, command_queue);
 }
 
 /**
@@ -205,11 +573,12 @@ ufo_op_add2 (UfoBuffer *arg1,
  * @arg2: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * @out = @arg1 - @arg2
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_deduction (UfoBuffer *arg1,
@@ -218,7 +587,7 @@ ufo_op_deduction (UfoBuffer *arg1,
                   UfoResources *resources,
                   gpointer command_queue)
 {
-    return operation ("operation_deduction", arg1, arg2, out, resources, command_queue);
+    return operation ("operation_deduction", HOST_OP_DEDUCTION, arg1, arg2, out, resources, command_queue);
 }
 
 /**
@@ -228,11 +597,12 @@ ufo_op_deduction (UfoBuffer *arg1,
  * @modifier: Scalar value
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * @out = @arg1 - @modifier * @arg2
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_deduction2 (UfoBuffer *arg1,
@@ -242,7 +612,7 @@ ufo_op_deduction2 (UfoBuffer *arg1,
                    UfoResources *resources,
                    gpointer command_queue)
 {
-    return operation2 ("operation_deduction2", arg1, arg2, modifier, out, resources, command_queue);
+    return operation2 ("operation_deduction2", HOST_OP_DEDUCTION2, arg1, arg2, modifier, out, resources, command_queue);
 }
 
 /**
@@ -253,11 +623,12 @@ ufo_op_deduction2 (UfoBuffer *arg1,
  * @n: n ?
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * @out = @arg1 - @modifier * @arg2
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_mul_rows (UfoBuffer *arg1,
@@ -271,7 +642,6 @@ ufo_op_mul_rows (UfoBuffer *arg1,
     cl_event event;
     UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg1, &arg1_requisition);
     ufo_buffer_get_requisition (arg2, &arg2_requisition);
@@ -290,17 +660,31 @@ ufo_op_mul_rows (UfoBuffer *arg1,
         return NULL;
     }
 
+    if (ufo_op_use_host (command_queue, arg1, arg2)) {
+        HostOp op;
+        gsize width = out_requisition.dims[0];
+
+        op.type = HOST_OP_MUL;
+        op.arg1 = ufo_buffer_get_host_array (arg1, command_queue) + offset * width;
+        op.arg2 = ufo_buffer_get_host_array (arg2, command_queue) + offset * width;
+        op.out = ufo_buffer_get_host_array (out, command_queue) + offset * width;
+        op.value = 0.0f;
+        op.width = width;
+        op.height = n;
+        run_on_host (&op);
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
     cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
     cl_mem d_out  = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "op_mulRows", &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "op_mulRows", &error);
 
     if (error != NULL) {
         g_error ("Error: %s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
@@ -309,16 +693,15 @@ ufo_op_mul_rows (UfoBuffer *arg1,
     UfoRequisition operation_requisition = out_requisition;
     operation_requisition.dims[1] = n;
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       operation_requisition.n_dims, NULL, operation_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  operation_requisition.n_dims, operation_requisition.dims, (gpointer *) &event);
 
     return event;
 }
 
 static cl_event
 operation (const gchar *kernel_name,
+           HostOpType host_op,
            UfoBuffer *arg1,
            UfoBuffer *arg2,
            UfoBuffer *out,
@@ -328,45 +711,49 @@ operation (const gchar *kernel_name,
     UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg1, &arg1_requisition);
     ufo_buffer_get_requisition (arg2, &arg2_requisition);
     ufo_buffer_get_requisition (out, &out_requisition);
 
-    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
-         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
-        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
-         arg1_requisition.dims[1] != out_requisition.dims[1])) {
+    if (arg1_requisition.dims[0] != arg2_requisition.dims[0] ||
+        arg1_requisition.dims[0] != out_requisition.dims[0] ||
+        arg1_requisition.dims[1] != arg2_requisition.dims[1] ||
+        arg1_requisition.dims[1] != out_requisition.dims[1]) {
         g_error ("Incorrect volume size.");
         return NULL;
     }
 
+    if (ufo_op_use_host (command_queue, arg1, arg2)) {
+        if (!operation_on_host (host_op, arg1, arg2, 0.0f, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
     cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, kernel_name, &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg1));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_arg2));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg1_requisition.n_dims, NULL, arg1_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg1_requisition.n_dims, arg1_requisition.dims, (gpointer *) &event);
 
     return event;
 }
 
 static cl_event
 operation2 (const gchar *kernel_name,
+            HostOpType host_op,
             UfoBuffer *arg1,
             UfoBuffer *arg2,
             gfloat modifier,
@@ -377,40 +764,43 @@ operation2 (const gchar *kernel_name,
     UfoRequisition arg1_requisition, arg2_requisition, out_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg1, &arg1_requisition);
     ufo_buffer_get_requisition (arg2, &arg2_requisition);
     ufo_buffer_get_requisition (out, &out_requisition);
 
-    if ((arg1_requisition.dims[0] != arg2_requisition.dims[0] &&
-         arg1_requisition.dims[0] != out_requisition.dims[0]) ||
-        (arg1_requisition.dims[1] != arg2_requisition.dims[1] &&
-         arg1_requisition.dims[1] != out_requisition.dims[1])) {
+    if (arg1_requisition.dims[0] != arg2_requisition.dims[0] ||
+        arg1_requisition.dims[0] != out_requisition.dims[0] ||
+        arg1_requisition.dims[1] != arg2_requisition.dims[1] ||
+        arg1_requisition.dims[1] != out_requisition.dims[1]) {
         g_error ("Incorrect volume size.");
         return NULL;
     }
 
+    if (ufo_op_use_host (command_queue, arg1, arg2)) {
+        if (!operation_on_host (host_op, arg1, arg2, modifier, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg1 = ufo_buffer_get_device_image (arg1, command_queue);
     cl_mem d_arg2 = ufo_buffer_get_device_image (arg2, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, kernel_name, &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, kernel_name, &error);
 
     if (error) {
         g_error ("%s\n", error->message);
         return NULL;
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg1));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_arg2));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 2, sizeof(gfloat), (void *) &modifier));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 3, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg1_requisition.n_dims, NULL, arg1_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg1_requisition.n_dims, arg1_requisition.dims, (gpointer *) &event);
 
     return event;
 }
@@ -420,11 +810,12 @@ operation2 (const gchar *kernel_name,
  * @arg: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * Compute magnitude of gradients
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_gradient_magnitudes (UfoBuffer *arg,
@@ -435,28 +826,31 @@ ufo_op_gradient_magnitudes (UfoBuffer *arg,
     UfoRequisition arg_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg, &arg_requisition);
     ufo_buffer_resize (out, &arg_requisition);
 
+    if (ufo_op_use_host (command_queue, arg, NULL)) {
+        if (!operation_on_host (HOST_OP_GRADIENT_MAGNITUDE, arg, NULL, 0.0f, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_gradient_magnitude", &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "operation_gradient_magnitude", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg_requisition.n_dims, arg_requisition.dims, (gpointer *) &event);
 
     return event;
 }
@@ -467,11 +861,12 @@ ufo_op_gradient_magnitudes (UfoBuffer *arg,
  * @magnitudes: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * Compute magnitude of gradients
  *
- * Returns: (transfer full): Event of the add operation
+ * Returns: (transfer full) (allow-none): Event of the add operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_gradient_directions (UfoBuffer *arg,
@@ -483,39 +878,329 @@ ufo_op_gradient_directions (UfoBuffer *arg,
     UfoRequisition arg_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg, &arg_requisition);
     ufo_buffer_resize (out, &arg_requisition);
 
+    if (ufo_op_use_host (command_queue, arg, magnitudes)) {
+        if (!operation_on_host (HOST_OP_GRADIENT_DIRECTION, arg, magnitudes, 0.0f, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
     cl_mem d_magnitudes = ufo_buffer_get_device_image (magnitudes, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "operation_gradient_direction", &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "operation_gradient_direction", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_magnitudes));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg_requisition.n_dims, arg_requisition.dims, (gpointer *) &event);
 
     return event;
 }
 
+#define REDUCE_MAX_LOCAL_SIZE   256
+#define REDUCE_MAX_GROUPS       64
+
+typedef enum {
+    REDUCE_ABS,
+    REDUCE_SQUARES,
+    REDUCE_SQUARED_DIFFERENCES,
+} ReduceOp;
+
+static const gchar *reduce_kernel_names[] = {
+    [REDUCE_ABS] = "reduce_abs",
+    [REDUCE_SQUARES] = "reduce_squares",
+    [REDUCE_SQUARED_DIFFERENCES] = "reduce_squared_differences",
+};
+
+static gsize
+get_num_elements (UfoBuffer *buffer)
+{
+    UfoRequisition requisition;
+    gsize n = 1;
+
+    ufo_buffer_get_requisition (buffer, &requisition);
+
+    for (guint i = 0; i < requisition.n_dims; i++)
+        n *= requisition.dims[i];
+
+    return n;
+}
+
+/*
+ * Host fallback for data that is not on the device. Independent accumulators
+ * allow the compiler to vectorize the loops without relaxing float semantics.
+ */
+static gfloat
+reduce_on_host (ReduceOp op,
+                const gfloat *arg1,
+                const gfloat *arg2,
+                gsize offset,
+                gsize n)
+{
+    gfloat acc[8] = { 0.0f };
+    gfloat sum = 0.0f;
+    gsize i = 0;
+
+    arg1 += offset;
+    arg2 += offset;
+
+    switch (op) {
+        case REDUCE_ABS:
+            for (; i + 8 <= n; i += 8)
+                for (guint j = 0; j < 8; j++)
+                    acc[j] += fabsf (arg1[i + j]);
+
+            for (; i < n; i++)
+                sum += fabsf (arg1[i]);
+            break;
+
+        case REDUCE_SQUARES:
+            for (; i + 8 <= n; i += 8)
+                for (guint j = 0; j < 8; j++)
+                    acc[j] += arg1[i + j] * arg1[i + j];
+
+            for (; i < n; i++)
+                sum += arg1[i] * arg1[i];
+            break;
+
+        case REDUCE_SQUARED_DIFFERENCES:
+            for (; i + 8 <= n; i += 8) {
+                for (guint j = 0; j < 8; j++) {
+                    const gfloat diff = arg1[i + j] - arg2[i + j];
+                    acc[j] += diff * diff;
+                }
+            }
+
+            for (; i < n; i++)
+                sum += (arg1[i] - arg2[i]) * (arg1[i] - arg2[i]);
+            break;
+    }
+
+    for (guint j = 0; j < 8; j++)
+        sum += acc[j];
+
+    return sum;
+}
+
+/*
+ * Partial sums buffers of the maximum size are pooled per #UfoResources and
+ * released together with it. Reductions wait for their result, so a buffer
+ * goes back to the pool as soon as the result was read.
+ */
+typedef struct {
+    GSList  *buffers;
+} ReducePool;
+
+static GStaticMutex reduce_pool_lock = G_STATIC_MUTEX_INIT;
+
+static void
+free_reduce_pool (ReducePool *pool)
+{
+    GSList *it;
+
+    for (it = pool->buffers; it != NULL; it = g_slist_next (it))
+        UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (it->data));
+
+    g_slist_free (pool->buffers);
+    g_free (pool);
+}
+
+/* Must be called with reduce_pool_lock held */
+static ReducePool *
+get_reduce_pool (UfoResources *resources)
+{
+    ReducePool *pool;
+
+    pool = g_object_get_data (G_OBJECT (resources), "ufo-reduce-pool");
+
+    if (pool == NULL) {
+        pool = g_new0 (ReducePool, 1);
+        g_object_set_data_full (G_OBJECT (resources), "ufo-reduce-pool", pool, (GDestroyNotify) free_reduce_pool);
+    }
+
+    return pool;
+}
+
+static cl_mem
+take_partial_buffer (UfoResources *resources,
+                     cl_context context)
+{
+    ReducePool *pool;
+    cl_mem partial = NULL;
+    cl_int errcode;
+
+    g_static_mutex_lock (&reduce_pool_lock);
+    pool = get_reduce_pool (resources);
+
+    if (pool->buffers != NULL) {
+        partial = pool->buffers->data;
+        pool->buffers = g_slist_delete_link (pool->buffers, pool->buffers);
+    }
+
+    g_static_mutex_unlock (&reduce_pool_lock);
+
+    if (partial == NULL) {
+        partial = clCreateBuffer (context, CL_MEM_READ_WRITE, REDUCE_MAX_GROUPS * sizeof (gfloat), NULL, &errcode);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+    }
+
+    return partial;
+}
+
+static void
+return_partial_buffer (UfoResources *resources,
+                       cl_mem partial)
+{
+    ReducePool *pool;
+
+    g_static_mutex_lock (&reduce_pool_lock);
+    pool = get_reduce_pool (resources);
+    pool->buffers = g_slist_prepend (pool->buffers, partial);
+    g_static_mutex_unlock (&reduce_pool_lock);
+}
+
+/* Largest power of two work group size that @kernel supports on @device */
+static gsize
+get_reduce_local_size (cl_kernel kernel,
+                       cl_device_id device)
+{
+    gsize max_local_size;
+    gsize local_size = 1;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_local_size, NULL));
+
+    while (local_size * 2 <= MIN (max_local_size, REDUCE_MAX_LOCAL_SIZE))
+        local_size *= 2;
+
+    return local_size;
+}
+
+static void
+set_reduce_args (cl_kernel kernel,
+                 cl_mem d_arg1,
+                 cl_mem d_arg2,
+                 cl_uint offset,
+                 cl_uint n,
+                 cl_mem d_partial,
+                 gsize local_size)
+{
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &d_arg1));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof (cl_mem), &d_arg2));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2, sizeof (cl_uint), &offset));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 3, sizeof (cl_uint), &n));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 4, sizeof (cl_mem), &d_partial));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 5, local_size * sizeof (gfloat), NULL));
+}
+
+/*
+ * Two-stage reduction: every work group writes a partial sum, which a single
+ * work group adds up. Only the final scalar is read back.
+ */
+static gfloat
+reduce_on_device (ReduceOp op,
+                  cl_mem d_arg1,
+                  cl_mem d_arg2,
+                  gsize offset,
+                  gsize n,
+                  UfoResources *resources,
+                  cl_command_queue command_queue)
+{
+    cl_kernel kernel;
+    cl_kernel sum_kernel;
+    cl_device_id device;
+    cl_context context;
+    cl_mem d_partial;
+    gsize local_size;
+    gsize sum_local_size;
+    gsize global_size;
+    gsize n_groups;
+    gfloat result;
+    GError *error = NULL;
+
+    kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, reduce_kernel_names[op], &error);
+
+    if (error == NULL)
+        sum_kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "reduce_sum", &error);
+
+    if (error != NULL) {
+        g_error ("%s\n", error->message);
+        return 0.0f;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (command_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL));
+    local_size = get_reduce_local_size (kernel, device);
+    sum_local_size = get_reduce_local_size (sum_kernel, device);
+
+    n_groups = CLAMP ((n + local_size - 1) / local_size, 1, REDUCE_MAX_GROUPS);
+    global_size = n_groups * local_size;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (command_queue, CL_QUEUE_CONTEXT,
+                                                      sizeof (cl_context), &context, NULL));
+    d_partial = take_partial_buffer (resources, context);
+
+    set_reduce_args (kernel, d_arg1, d_arg2, (cl_uint) offset, (cl_uint) n, d_partial, local_size);
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel, 1, NULL, &global_size, &local_size,
+                                                       0, NULL, NULL));
+
+    /* A single group reads all partial sums and stores the total in the first one */
+    set_reduce_args (sum_kernel, d_partial, d_partial, 0, (cl_uint) n_groups, d_partial, sum_local_size);
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, sum_kernel, 1, NULL, &sum_local_size, &sum_local_size,
+                                                       0, NULL, NULL));
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueReadBuffer (command_queue, d_partial, CL_TRUE, 0,
+                                                    sizeof (gfloat), &result, 0, NULL, NULL));
+
+    return_partial_buffer (resources, d_partial);
+
+    return result;
+}
+
+static gfloat
+reduce (ReduceOp op,
+        UfoBuffer *arg1,
+        UfoBuffer *arg2,
+        gsize offset,
+        gsize n,
+        UfoResources *resources,
+        gpointer command_queue)
+{
+    if (n == 0)
+        return 0.0f;
+
+    if (ufo_op_use_host (command_queue, arg1, arg2)) {
+        return reduce_on_host (op,
+                               ufo_buffer_get_host_array (arg1, command_queue),
+                               ufo_buffer_get_host_array (arg2, command_queue),
+                               offset, n);
+    }
+
+    return reduce_on_device (op,
+                             ufo_buffer_get_device_array (arg1, command_queue),
+                             ufo_buffer_get_device_array (arg2, command_queue),
+                             offset, n, resources, command_queue);
+}
+
 /**
  * ufo_op_l1_norm:
  * @arg: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
+ *
+ * Compute the sum of absolute values. The reduction runs on the device unless
+ * the data is only available on the host.
  *
  * Returns: L1 norm.
  */
@@ -524,20 +1209,7 @@ ufo_op_l1_norm (UfoBuffer *arg,
                 UfoResources *resources,
                 gpointer command_queue)
 {
-    UfoRequisition arg_requisition;
-    gfloat *values;
-    gfloat norm = 0;
-
-    ufo_buffer_get_requisition (arg, &arg_requisition);
-    values = ufo_buffer_get_host_array (arg, command_queue);
-
-    for (guint i = 0; i < arg_requisition.dims[0]; ++i) {
-        for (guint j = 0; j < arg_requisition.dims[1]; ++j) {
-            norm += (gfloat) fabs (values[i * arg_requisition.dims[1] + j]);
-        }
-    }
-
-    return norm;
+    return reduce (REDUCE_ABS, arg, arg, 0, get_num_elements (arg), resources, command_queue);
 }
 
 /**
@@ -545,7 +1217,11 @@ ufo_op_l1_norm (UfoBuffer *arg,
  * @arg1: A #UfoBuffer
  * @arg2: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
+ *
+ * Compute the euclidean distance. If the buffers differ in size, the smaller
+ * one is padded with zeros. The reduction runs on the device unless the data
+ * is only available on the host.
  *
  * Returns: Euclidean distance between @arg1 and @arg2.
  */
@@ -555,51 +1231,34 @@ ufo_op_euclidean_distance (UfoBuffer *arg1,
                            UfoResources *resources,
                            gpointer command_queue)
 {
-    UfoRequisition arg1_requisition, arg2_requisition;
-    guint length;
-    gfloat diff;
-    gfloat norm = 0;
-    guint length1 = 0;
-    guint length2 = 0;
-    gfloat *values1;
-    gfloat *values2;
+    gsize length;
+    gsize length1;
+    gsize length2;
+    gfloat norm;
 
-    ufo_buffer_get_requisition (arg1, &arg1_requisition);
-    ufo_buffer_get_requisition (arg2, &arg2_requisition);
-
-    for (guint i = 0; i < arg1_requisition.n_dims; ++i)
-        length1 += (guint)arg1_requisition.dims[i];
-
-    for (guint i = 0; i < arg2_requisition.n_dims; ++i)
-        length2 += (guint)arg2_requisition.dims[i];
+    length1 = get_num_elements (arg1);
+    length2 = get_num_elements (arg2);
 
     if (length2 != length1)
         g_warning ("Sizes of buffers are not the same. Zero-padding applied.");
 
-    length = length2 < length1 ? length2 : length1;
-    values1 = ufo_buffer_get_host_array (arg1, command_queue);
-    values2 = ufo_buffer_get_host_array (arg2, command_queue);
-
-    for (guint i = 0; i < length; ++i) {
-        diff = values1[i] - values2[i];
-        norm += powf (diff, 2);
-    }
+    length = MIN (length1, length2);
+    norm = reduce (REDUCE_SQUARED_DIFFERENCES, arg1, arg2, 0, length, resources, command_queue);
 
-    for (guint i = length; i < length2; ++i)
-        norm += powf (values2[i], 2);
+    if (length1 > length)
+        norm += reduce (REDUCE_SQUARES, arg1, arg1, length, length1 - length, resources, command_queue);
 
-    for (guint i = length; i < length1; ++i)
-        norm += powf (values1[i], 2);
+    if (length2 > length)
+        norm += reduce (REDUCE_SQUARES, arg2, arg2, length, length2 - length, resources, command_queue);
 
-    norm = sqrtf(norm);
-    return norm;
+    return sqrtf (norm);
 }
 
 /**
  * ufo_op_l2_norm:
  * @arg: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
  * Returns: L2 norm.
  */
@@ -608,7 +1267,7 @@ ufo_op_l2_norm (UfoBuffer *arg,
                 UfoResources *resources,
                 gpointer command_queue)
 {
-    return ufo_op_euclidean_distance (arg, arg, resources, command_queue);
+    return sqrtf (reduce (REDUCE_SQUARES, arg, arg, 0, get_num_elements (arg), resources, command_queue));
 }
 
 /**
@@ -616,9 +1275,10 @@ ufo_op_l2_norm (UfoBuffer *arg,
  * @arg: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
- * Returns: (transfer full): Event of the POSC operation
+ * Returns: (transfer full) (allow-none): Event of the POSC operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_POSC (UfoBuffer *arg,
@@ -629,28 +1289,31 @@ ufo_op_POSC (UfoBuffer *arg,
     UfoRequisition arg_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg, &arg_requisition);
     ufo_buffer_resize (out, &arg_requisition);
 
+    if (ufo_op_use_host (command_queue, arg, NULL)) {
+        if (!operation_on_host (HOST_OP_POSC, arg, NULL, 0.0f, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "POSC", &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "POSC", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg_requisition.n_dims, arg_requisition.dims, (gpointer *) &event);
 
     return event;
 }
@@ -660,9 +1323,10 @@ ufo_op_POSC (UfoBuffer *arg,
  * @arg: A #UfoBuffer
  * @out: A #UfoBuffer
  * @resources: #UfoResources object
- * @command_queue: A valid cl_command_queue
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
  *
- * Returns: (transfer full): Event of the POSC operation
+ * Returns: (transfer full) (allow-none): Event of the POSC operation or %NULL
+ *  without @command_queue
  */
 gpointer
 ufo_op_gradient_descent (UfoBuffer *arg,
@@ -673,28 +1337,31 @@ ufo_op_gradient_descent (UfoBuffer *arg,
     UfoRequisition arg_requisition;
     cl_event event;
     GError *error = NULL;
-    static GStaticMutex mutex = G_STATIC_MUTEX_INIT;
 
     ufo_buffer_get_requisition (arg, &arg_requisition);
     ufo_buffer_resize (out, &arg_requisition);
 
+    if (ufo_op_use_host (command_queue, arg, NULL)) {
+        if (!operation_on_host (HOST_OP_DESCENT_GRAD, arg, NULL, 0.0f, out, command_queue))
+            return NULL;
+
+        return ufo_op_completed_event (command_queue);
+    }
+
     cl_mem d_arg = ufo_buffer_get_device_image (arg, command_queue);
     cl_mem d_out = ufo_buffer_get_device_image (out, command_queue);
 
-    cl_kernel kernel = ufo_resources_get_cached_kernel (resources, OPS_FILENAME, "descent_grad", &error);
+    cl_kernel kernel = ufo_resources_get_thread_kernel (resources, OPS_FILENAME, "descent_grad", &error);
 
     if (error) {
         g_error ("%s\n", error->message);
     }
 
-    g_static_mutex_lock (&mutex);
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 0, sizeof(void *), (void *) &d_arg));
     UFO_RESOURCES_CHECK_CLERR (clSetKernelArg(kernel, 1, sizeof(void *), (void *) &d_out));
 
-    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (command_queue, kernel,
-                                                       arg_requisition.n_dims, NULL, arg_requisition.dims,
-                                                       NULL, 0, NULL, &event));
-    g_static_mutex_unlock (&mutex);
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel,
+                                  arg_requisition.n_dims, arg_requisition.dims, (gpointer *) &event);
 
     return event;
 }
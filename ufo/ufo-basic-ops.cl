@@ -323,4 +323,75 @@ void descent_grad (__read_only image2d_t arg_r,
 
   float value = part[0] - part[1] - part[2];
   write_imagef(out, coord_w, value);
-}
\ No newline at end of file
+}
+
+/*
+ * First stage of a reduction: each work item sums a strided part of the input
+ * and each work group reduces these sums in local memory to one partial sum.
+ * The local work size must be a power of two.
+ */
+#define REDUCE_PARTIAL(VALUE)                                       \
+  const uint lid = get_local_id(0);                                 \
+  float sum = 0.0f;                                                 \
+                                                                    \
+  for (uint i = get_global_id(0); i < n; i += get_global_size(0))   \
+    sum += VALUE;                                                   \
+                                                                    \
+  scratch[lid] = sum;                                               \
+  barrier(CLK_LOCAL_MEM_FENCE);                                     \
+                                                                    \
+  for (uint s = get_local_size(0) / 2; s > 0; s >>= 1) {            \
+    if (lid < s)                                                    \
+      scratch[lid] += scratch[lid + s];                             \
+    barrier(CLK_LOCAL_MEM_FENCE);                                   \
+  }                                                                 \
+                                                                    \
+  if (lid == 0)                                                     \
+    partial[get_group_id(0)] = scratch[0];
+
+__kernel
+void reduce_abs (__global const float *arg1,
+                 __global const float *arg2,
+                 const uint offset,
+                 const uint n,
+                 __global float *partial,
+                 __local float *scratch)
+{
+  REDUCE_PARTIAL(fabs(arg1[offset + i]))
+}
+
+__kernel
+void reduce_squares (__global const float *arg1,
+                     __global const float *arg2,
+                     const uint offset,
+                     const uint n,
+                     __global float *partial,
+                     __local float *scratch)
+{
+  REDUCE_PARTIAL(arg1[offset + i] * arg1[offset + i])
+}
+
+__kernel
+void reduce_squared_differences (__global const float *arg1,
+                                 __global const float *arg2,
+                                 const uint offset,
+                                 const uint n,
+                                 __global float *partial,
+                                 __local float *scratch)
+{
+  REDUCE_PARTIAL((arg1[offset + i] - arg2[offset + i]) * (arg1[offset + i] - arg2[offset + i]))
+}
+
+/*
+ * Second stage of a reduction, run with a single work group.
+ */
+__kernel
+void reduce_sum (__global const float *arg1,
+                 __global const float *arg2,
+                 const uint offset,
+                 const uint n,
+                 __global float *partial,
+                 __local float *scratch)
+{
+  REDUCE_PARTIAL(arg1[offset + i])
+}
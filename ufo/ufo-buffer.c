@@ -26,7 +26,9 @@
 
 #include <ufo/ufo-buffer.h>
 #include <ufo/ufo-resources.h>
+#include <ufo/ufo-profiler.h>
 #include "compat.h"
+#include "ufo-trace.h"
 
 /**
  * SECTION:ufo-buffer
@@ -93,6 +95,17 @@ enum {
     N_PROPERTIES
 };
 
+typedef struct {
+    gpointer            device;         /* NULL for host memory */
+    gsize               n_bytes;
+} Allocation;
+
+typedef struct {
+    UfoProfiler        *profiler;
+    gpointer            device;
+    gsize               n_bytes;
+} View;
+
 struct _UfoBufferPrivate {
     UfoRequisition      requisition;
     gfloat             *host_array;
@@ -101,11 +114,18 @@ struct _UfoBufferPrivate {
     cl_mem              device_image;
     cl_context          context;
     cl_command_queue    last_queue;
+    cl_command_queue    upload_queue;
+    cl_command_queue    download_queue;
     gsize               size;           /* size of buffer in bytes */
     UfoBufferLocation      location;
     UfoBufferLocation      last_location;
     GHashTable         *metadata;
     GList              *sub_device_arrays;
+    gint64              timestamp;
+    UfoProfiler        *profiler;       /* Owner of the allocations */
+    Allocation          host_alloc;
+    Allocation          array_alloc;
+    Allocation          image_alloc;
 };
 
 static void
@@ -131,6 +151,103 @@ compute_required_size (UfoRequisition *requisition)
     return size;
 }
 
+/* Replace what @allocation accounted to the owner so far with @n_bytes */
+static void
+account (UfoBufferPrivate *priv,
+         Allocation *allocation,
+         gpointer device,
+         gsize n_bytes)
+{
+    if (allocation->n_bytes > 0)
+        ufo_profiler_record_allocation (priv->profiler, allocation->device, -((gssize) allocation->n_bytes));
+
+    allocation->device = device;
+    allocation->n_bytes = n_bytes;
+
+    if (n_bytes > 0)
+        ufo_profiler_record_allocation (priv->profiler, device, (gssize) n_bytes);
+}
+
+/*
+ * Memory objects belong to a context, they are charged to the device of the
+ * last used queue or the first device of the context.
+ */
+static cl_device_id
+get_device (UfoBufferPrivate *priv)
+{
+    cl_device_id device = NULL;
+    cl_device_id *devices;
+    gsize size;
+
+    if (priv->last_queue != NULL) {
+        UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (priv->last_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL));
+        return device;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetContextInfo (priv->context, CL_CONTEXT_DEVICES, 0, NULL, &size));
+
+    if (size >= sizeof (cl_device_id)) {
+        devices = g_malloc0 (size);
+        UFO_RESOURCES_CHECK_CLERR (clGetContextInfo (priv->context, CL_CONTEXT_DEVICES, size, devices, NULL));
+        device = devices[0];
+        g_free (devices);
+    }
+
+    return device;
+}
+
+static void
+check_device_alloc (UfoBufferPrivate *priv,
+                    cl_device_id device,
+                    cl_int err)
+{
+    gsize total;
+    gsize own;
+
+    if (err == CL_SUCCESS)
+        return;
+
+    ufo_profiler_get_total_memory (device, &total, NULL);
+    own = 0;
+
+    if (priv->profiler != NULL)
+        ufo_profiler_get_memory (priv->profiler, device, &own, NULL);
+
+    g_warning ("Could not allocate %zu bytes on device %p, %zu bytes are allocated on it, "
+               "%zu of them by the owner of this buffer", priv->size, (gpointer) device, total, own);
+}
+
+static void CL_CALLBACK
+release_view (cl_mem mem,
+              void *user_data)
+{
+    View *view = user_data;
+
+    ufo_profiler_record_allocation (view->profiler, view->device, -((gssize) view->n_bytes));
+
+    if (view->profiler != NULL)
+        g_object_unref (view->profiler);
+
+    g_free (view);
+}
+
+/* Views are released by the caller, so they are accounted until destruction */
+static void
+account_view (UfoBufferPrivate *priv,
+              cl_mem mem,
+              gsize n_bytes)
+{
+    View *view;
+
+    view = g_new0 (View, 1);
+    view->profiler = priv->profiler != NULL ? g_object_ref (priv->profiler) : NULL;
+    view->device = get_device (priv);
+    view->n_bytes = n_bytes;
+
+    ufo_profiler_record_allocation (view->profiler, view->device, (gssize) n_bytes);
+    UFO_RESOURCES_CHECK_CLERR (clSetMemObjectDestructorCallback (mem, release_view, view));
+}
+
 static void
 alloc_host_mem (UfoBufferPrivate *priv)
 {
@@ -138,24 +255,33 @@ alloc_host_mem (UfoBufferPrivate *priv)
         g_free (priv->host_array);
 
     priv->host_array = g_malloc0 (priv->size);
+    account (priv, &priv->host_alloc, NULL, priv->size);
 }
 
 static void
 alloc_device_array (UfoBufferPrivate *priv)
 {
+    cl_device_id device;
     cl_int err;
     cl_mem mem;
 
-    if (priv->device_array != NULL)
+    if (priv->device_array != NULL) {
         UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_array));
+        account (priv, &priv->array_alloc, NULL, 0);
+    }
 
+    device = get_device (priv);
     mem = clCreateBuffer (priv->context,
                           CL_MEM_READ_WRITE,
                           priv->size,
                           NULL, &err);
 
+    check_device_alloc (priv, device, err);
     UFO_RESOURCES_CHECK_CLERR (err);
     priv->device_array = mem;
+
+    if (mem != NULL)
+        account (priv, &priv->array_alloc, device, priv->size);
 }
 
 #if 0
@@ -208,6 +334,7 @@ alloc_device_image (UfoBufferPrivate *priv)
 {
     cl_image_format format;
     cl_mem_flags flags;
+    cl_device_id device;
     cl_int err;
     gsize width, height, depth;
     cl_mem mem = NULL;
@@ -215,8 +342,12 @@ alloc_device_image (UfoBufferPrivate *priv)
     g_assert ((priv->requisition.n_dims == 2) ||
               (priv->requisition.n_dims == 3));
 
-    if (priv->device_image != NULL)
+    if (priv->device_image != NULL) {
         UFO_RESOURCES_CHECK_CLERR (clReleaseMemObject (priv->device_image));
+        account (priv, &priv->image_alloc, NULL, 0);
+    }
+
+    device = get_device (priv);
 
     format.image_channel_order = CL_INTENSITY;
     format.image_channel_data_type = CL_FLOAT;
@@ -239,9 +370,11 @@ alloc_device_image (UfoBufferPrivate *priv)
                                NULL, &err);
     }
 
+    check_device_alloc (priv, device, err);
     UFO_RESOURCES_CHECK_CLERR (err);
     g_assert (mem != NULL);
     priv->device_image = mem;
+    account (priv, &priv->image_alloc, device, priv->size);
 }
 #endif
 
@@ -364,6 +497,29 @@ set_region_from_requisition (size_t region[3],
         region[2] = 1;
 }
 
+/*
+ * Wait for a transfer and write it to the trace if its queue is traced. It is
+ * attributed to the task whose process or generate call is running.
+ */
+static void
+finish_transfer (cl_command_queue queue,
+                 cl_event event,
+                 const gchar *name)
+{
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+
+    if (ufo_trace_is_tracing_queue (queue)) {
+        cl_ulong start;
+        cl_ulong end;
+
+        UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_START, sizeof (cl_ulong), &start, NULL));
+        UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_END, sizeof (cl_ulong), &end, NULL));
+        ufo_trace_write_device_event (name, queue, ufo_trace_get_current_source (), start, end);
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+}
+
 static void
 transfer_host_to_host (UfoBufferPrivate *src_priv,
                        UfoBufferPrivate *dst_priv,
@@ -379,6 +535,7 @@ transfer_host_to_device (UfoBufferPrivate *src_priv,
                          UfoBufferPrivate *dst_priv,
                          cl_command_queue queue)
 {
+    cl_event event;
     cl_int errcode;
 
     errcode = clEnqueueWriteBuffer (queue,
@@ -386,9 +543,10 @@ transfer_host_to_device (UfoBufferPrivate *src_priv,
                                     CL_TRUE,
                                     0, src_priv->size,
                                     src_priv->host_array,
-                                    0, NULL, NULL);
+                                    0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    finish_transfer (queue, event, "write_buffer");
 }
 
 static void
@@ -412,8 +570,7 @@ transfer_host_to_image (UfoBufferPrivate *src_priv,
                                    0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    finish_transfer (queue, event, "write_image");
 }
 
 static void
@@ -432,8 +589,7 @@ transfer_device_to_device (UfoBufferPrivate *src_priv,
                                    0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    finish_transfer (queue, event, "copy_buffer");
 }
 
 static void
@@ -441,6 +597,7 @@ transfer_device_to_host (UfoBufferPrivate *src_priv,
                          UfoBufferPrivate *dst_priv,
                          cl_command_queue queue)
 {
+    cl_event event;
     cl_int errcode;
 
     errcode = clEnqueueReadBuffer (queue,
@@ -448,9 +605,10 @@ transfer_device_to_host (UfoBufferPrivate *src_priv,
                                    CL_TRUE,
                                    0, src_priv->size,
                                    dst_priv->host_array,
-                                   0, NULL, NULL);
+                                   0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    finish_transfer (queue, event, "read_buffer");
 }
 
 static void
@@ -472,8 +630,7 @@ transfer_device_to_image (UfoBufferPrivate *src_priv,
                                           0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    finish_transfer (queue, event, "copy_buffer_to_image");
 }
 
 static void
@@ -495,8 +652,7 @@ transfer_image_to_image (UfoBufferPrivate *src_priv,
                                   0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    finish_transfer (queue, event, "copy_image");
 }
 
 static void
@@ -504,6 +660,7 @@ transfer_image_to_host (UfoBufferPrivate *src_priv,
                         UfoBufferPrivate *dst_priv,
                         cl_command_queue queue)
 {
+    cl_event event;
     cl_int errcode;
     size_t region[3];
     size_t origin[] = { 0, 0, 0 };
@@ -516,9 +673,10 @@ transfer_image_to_host (UfoBufferPrivate *src_priv,
                                   origin, region,
                                   0, 0,
                                   dst_priv->host_array,
-                                  0, NULL, NULL);
+                                  0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    finish_transfer (queue, event, "read_image");
 }
 
 static void
@@ -540,8 +698,7 @@ transfer_image_to_device (UfoBufferPrivate *src_priv,
                                           0, NULL, &event);
 
     UFO_RESOURCES_CHECK_CLERR (errcode);
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    finish_transfer (queue, event, "copy_image_to_buffer");
 }
 
 
@@ -653,6 +810,10 @@ ufo_buffer_resize (UfoBuffer *buffer,
         priv->device_image = NULL;
     }
 
+    account (priv, &priv->host_alloc, NULL, 0);
+    account (priv, &priv->array_alloc, NULL, 0);
+    account (priv, &priv->image_alloc, NULL, 0);
+
     priv->size = compute_required_size (requisition);
     copy_requisition (requisition, &priv->requisition);
 }
@@ -714,6 +875,30 @@ update_last_queue (UfoBufferPrivate *priv,
         priv->last_queue = queue;
 }
 
+static cl_command_queue
+get_transfer_queue (UfoBufferPrivate *priv,
+                    cl_command_queue transfer_queue,
+                    cl_command_queue pending_queue)
+{
+    cl_event event;
+
+    if (transfer_queue == NULL)
+        return priv->last_queue;
+
+    /*
+     * Commands on different queues are not ordered with respect to each other.
+     * Make the transfer wait until everything that was enqueued on the
+     * previously used queue, e.g. a kernel writing the data, has finished.
+     */
+    if (pending_queue != NULL && pending_queue != transfer_queue) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueMarker (pending_queue, &event));
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueWaitForEvents (transfer_queue, 1, &event));
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+    }
+
+    return transfer_queue;
+}
+
 static void
 update_location (UfoBufferPrivate *priv,
                  UfoBufferLocation new_location)
@@ -747,6 +932,9 @@ ufo_buffer_set_host_array (UfoBuffer *buffer, gpointer array, gboolean free_data
     priv->free = free_data;
     priv->host_array = array;
 
+    /* Memory that we do not free is not ours to account for */
+    account (priv, &priv->host_alloc, NULL, free_data ? priv->size : 0);
+
     update_location (priv, UFO_BUFFER_LOCATION_HOST);
 }
 
@@ -763,20 +951,22 @@ gfloat *
 ufo_buffer_get_host_array (UfoBuffer *buffer, gpointer cmd_queue)
 {
     UfoBufferPrivate *priv;
+    cl_command_queue pending_queue;
 
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
     priv = buffer->priv;
 
+    pending_queue = priv->last_queue;
     update_last_queue (priv, cmd_queue);
 
     if (priv->host_array == NULL)
         alloc_host_mem (priv);
 
     if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
-        transfer_device_to_host (priv, priv, priv->last_queue);
+        transfer_device_to_host (priv, priv, get_transfer_queue (priv, priv->download_queue, pending_queue));
 
     if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_image)
-        transfer_image_to_host (priv, priv, priv->last_queue);
+        transfer_image_to_host (priv, priv, get_transfer_queue (priv, priv->download_queue, pending_queue));
 
     update_location (priv, UFO_BUFFER_LOCATION_HOST);
 
@@ -798,17 +988,19 @@ gpointer
 ufo_buffer_get_device_array (UfoBuffer *buffer, gpointer cmd_queue)
 {
     UfoBufferPrivate *priv;
+    cl_command_queue pending_queue;
 
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
     priv = buffer->priv;
 
+    pending_queue = priv->last_queue;
     update_last_queue (priv, cmd_queue);
 
     if (priv->device_array == NULL)
         alloc_device_array (priv);
 
     if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
-        transfer_host_to_device (priv, priv, priv->last_queue);
+        transfer_host_to_device (priv, priv, get_transfer_queue (priv, priv->upload_queue, pending_queue));
 
     if (priv->location == UFO_BUFFER_LOCATION_DEVICE_IMAGE && priv->device_array)
         transfer_image_to_device (priv, priv, priv->last_queue);
@@ -858,6 +1050,7 @@ ufo_buffer_get_device_array_with_offset (UfoBuffer *buffer,
     region.origin = offset;
     region.size = size - offset;
 
+    /* Sub buffers share the memory of @device_array and are not accounted */
     sub_buffer = clCreateSubBuffer (device_array, mem_flags, CL_BUFFER_CREATE_TYPE_REGION,
                                     &region, &errcode);
 
@@ -913,6 +1106,7 @@ ufo_buffer_get_device_array_view (UfoBuffer *buffer,
 
     mem = clCreateBuffer (priv->context, CL_MEM_READ_WRITE, size, NULL, &errcode);
     UFO_RESOURCES_CHECK_CLERR (errcode);
+    account_view (priv, mem, size);
 
     if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array) {
         if (priv->requisition.n_dims == 1) {
@@ -970,8 +1164,7 @@ ufo_buffer_get_device_array_view (UfoBuffer *buffer,
                                                             src_row_pitch, src_slice_pitch,
                                                             dst_row_pitch, dst_slice_pitch,
                                                             0, NULL, &event));
-        UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+        finish_transfer (cmd_queue, event, "copy_buffer_rect");
     }
 
     return mem;
@@ -993,17 +1186,19 @@ ufo_buffer_get_device_image (UfoBuffer *buffer,
                              gpointer cmd_queue)
 {
     UfoBufferPrivate *priv;
+    cl_command_queue pending_queue;
 
     g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
     priv = buffer->priv;
 
+    pending_queue = priv->last_queue;
     update_last_queue (priv, cmd_queue);
 
     if (priv->device_image == NULL)
         alloc_device_image (priv);
 
     if (priv->location == UFO_BUFFER_LOCATION_HOST && priv->host_array)
-        transfer_host_to_image (priv, priv, priv->last_queue);
+        transfer_host_to_image (priv, priv, get_transfer_queue (priv, priv->upload_queue, pending_queue));
 
     if (priv->location == UFO_BUFFER_LOCATION_DEVICE && priv->device_array)
         transfer_device_to_image (priv, priv, priv->last_queue);
@@ -1013,6 +1208,77 @@ ufo_buffer_get_device_image (UfoBuffer *buffer,
     return priv->device_image;
 }
 
+/**
+ * ufo_buffer_set_transfer_queues:
+ * @buffer: A #UfoBuffer
+ * @upload_queue: (allow-none): A cl_command_queue used for host-to-device
+ * transfers or %NULL
+ * @download_queue: (allow-none): A cl_command_queue used for device-to-host
+ * transfers or %NULL
+ *
+ * Use dedicated command queues for transfers between host and device memory
+ * instead of the queue passed to ufo_buffer_get_host_array() and
+ * ufo_buffer_get_device_array(). Transfers wait for all commands that were
+ * enqueued on the last used queue. If a queue is %NULL, the last used queue is
+ * used for the respective direction.
+ */
+void
+ufo_buffer_set_transfer_queues (UfoBuffer *buffer,
+                                gpointer upload_queue,
+                                gpointer download_queue)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    buffer->priv->upload_queue = upload_queue;
+    buffer->priv->download_queue = download_queue;
+}
+
+/**
+ * ufo_buffer_set_profiler:
+ * @buffer: A #UfoBuffer
+ * @profiler: (allow-none) (type Ufo.Profiler): A #UfoProfiler or %NULL
+ *
+ * Account host and device memory allocated by @buffer to the node of
+ * @profiler, see ufo_profiler_get_memory(). Memory that was allocated before
+ * is moved to @profiler. Sub buffers returned by
+ * ufo_buffer_get_device_array_with_offset() share the memory of @buffer and
+ * are not accounted separately.
+ */
+void
+ufo_buffer_set_profiler (UfoBuffer *buffer,
+                         gpointer profiler)
+{
+    UfoBufferPrivate *priv;
+    Allocation allocations[3];
+
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    g_return_if_fail (profiler == NULL || UFO_IS_PROFILER (profiler));
+
+    priv = buffer->priv;
+
+    if (profiler == priv->profiler)
+        return;
+
+    allocations[0] = priv->host_alloc;
+    allocations[1] = priv->array_alloc;
+    allocations[2] = priv->image_alloc;
+
+    account (priv, &priv->host_alloc, NULL, 0);
+    account (priv, &priv->array_alloc, NULL, 0);
+    account (priv, &priv->image_alloc, NULL, 0);
+
+    if (profiler != NULL)
+        g_object_ref (profiler);
+
+    if (priv->profiler != NULL)
+        g_object_unref (priv->profiler);
+
+    priv->profiler = profiler;
+
+    account (priv, &priv->host_alloc, allocations[0].device, allocations[0].n_bytes);
+    account (priv, &priv->array_alloc, allocations[1].device, allocations[1].n_bytes);
+    account (priv, &priv->image_alloc, allocations[2].device, allocations[2].n_bytes);
+}
+
 /**
  * ufo_buffer_get_location:
  * @buffer: A #UfoBuffer
@@ -1189,7 +1455,9 @@ ufo_buffer_set_metadata (UfoBuffer *buffer,
  * @src: Source buffer
  * @dst: Destination buffer
  *
- * Copies meta data content from @src to @dst.
+ * Copies meta data content from @src to @dst. The timestamp of @dst becomes
+ * the earliest non-zero timestamp of both, so copying from several inputs
+ * keeps the time at which the oldest of them entered the pipeline.
  */
 void
 ufo_buffer_copy_metadata (UfoBuffer *src,
@@ -1212,6 +1480,9 @@ ufo_buffer_copy_metadata (UfoBuffer *src,
     }
 
     g_list_free (keys);
+
+    if (priv->timestamp != 0 && (dst->priv->timestamp == 0 || priv->timestamp < dst->priv->timestamp))
+        dst->priv->timestamp = priv->timestamp;
 }
 
 /**
@@ -1231,6 +1502,38 @@ ufo_buffer_get_metadata_keys (UfoBuffer *buffer)
     return g_hash_table_get_keys (buffer->priv->metadata);
 }
 
+/**
+ * ufo_buffer_set_timestamp:
+ * @buffer: A #UfoBuffer
+ * @timestamp: Monotonic time in microseconds as returned by
+ *  g_get_monotonic_time()
+ *
+ * Set the time at which the data item in @buffer entered the pipeline. The
+ * timestamp is propagated with ufo_buffer_copy_metadata().
+ */
+void
+ufo_buffer_set_timestamp (UfoBuffer *buffer,
+                          gint64 timestamp)
+{
+    g_return_if_fail (UFO_IS_BUFFER (buffer));
+    buffer->priv->timestamp = timestamp;
+}
+
+/**
+ * ufo_buffer_get_timestamp:
+ * @buffer: A #UfoBuffer
+ *
+ * Get the time at which the data item in @buffer entered the pipeline.
+ *
+ * Returns: Monotonic time in microseconds or 0 if no timestamp was set.
+ */
+gint64
+ufo_buffer_get_timestamp (UfoBuffer *buffer)
+{
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), 0);
+    return buffer->priv->timestamp;
+}
+
 /**
  * ufo_buffer_max:
  * @buffer: A #UfoBuffer
@@ -1359,6 +1662,13 @@ ufo_buffer_finalize (GObject *gobject)
     free_cl_mem (&priv->device_array);
     free_cl_mem (&priv->device_image);
 
+    account (priv, &priv->host_alloc, NULL, 0);
+    account (priv, &priv->array_alloc, NULL, 0);
+    account (priv, &priv->image_alloc, NULL, 0);
+
+    if (priv->profiler != NULL)
+        g_object_unref (priv->profiler);
+
     g_hash_table_destroy (priv->metadata);
 
     G_OBJECT_CLASS(ufo_buffer_parent_class)->finalize(gobject);
@@ -1379,6 +1689,8 @@ ufo_buffer_init (UfoBuffer *buffer)
     UfoBufferPrivate *priv;
     buffer->priv = priv = UFO_BUFFER_GET_PRIVATE(buffer);
     priv->last_queue = NULL;
+    priv->upload_queue = NULL;
+    priv->download_queue = NULL;
     priv->device_array = NULL;
     priv->device_image = NULL;
     priv->host_array = NULL;
@@ -1389,6 +1701,11 @@ ufo_buffer_init (UfoBuffer *buffer)
     priv->requisition.n_dims = 0;
     priv->metadata = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
     priv->sub_device_arrays = NULL;
+    priv->timestamp = 0;
+    priv->profiler = NULL;
+    priv->host_alloc.n_bytes = 0;
+    priv->array_alloc.n_bytes = 0;
+    priv->image_alloc.n_bytes = 0;
 }
 
 static void
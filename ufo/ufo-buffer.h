@@ -145,6 +145,11 @@ gpointer    ufo_buffer_get_device_array_with_offset
 UfoBufferLocation
             ufo_buffer_get_location         (UfoBuffer      *buffer);
 void        ufo_buffer_discard_location     (UfoBuffer      *buffer);
+void        ufo_buffer_set_transfer_queues  (UfoBuffer      *buffer,
+                                             gpointer        upload_queue,
+                                             gpointer        download_queue);
+void        ufo_buffer_set_profiler         (UfoBuffer      *buffer,
+                                             gpointer        profiler);
 void        ufo_buffer_convert              (UfoBuffer      *buffer,
                                              UfoBufferDepth  depth);
 void        ufo_buffer_convert_from_data    (UfoBuffer      *buffer,
@@ -158,6 +163,9 @@ void        ufo_buffer_set_metadata         (UfoBuffer      *buffer,
 void        ufo_buffer_copy_metadata        (UfoBuffer      *src,
                                              UfoBuffer      *dst);
 GList      *ufo_buffer_get_metadata_keys    (UfoBuffer      *buffer);
+void        ufo_buffer_set_timestamp        (UfoBuffer      *buffer,
+                                             gint64          timestamp);
+gint64      ufo_buffer_get_timestamp        (UfoBuffer      *buffer);
 
 gfloat      ufo_buffer_max                  (UfoBuffer      *buffer,
                                              gpointer        cmd_queue);
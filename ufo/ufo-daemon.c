@@ -46,11 +46,16 @@ struct _UfoDaemonPrivate {
     UfoResources *resources;
     UfoTaskGraph *task_graph;
     GThread *scheduler_thread;
+    GCancellable *cancellable;
     gpointer socket;
     UfoNode *input_task;
     UfoNode *output_task;
     UfoBuffer *input;
     gchar *listen_address;
+    gchar *device_selection;
+    gchar *device_partition;
+    gchar *metrics_file;
+    guint metrics_port;
     GThread *thread;
     GMutex *startstop_lock;
     GMutex *started_lock;
@@ -232,6 +237,7 @@ handle_replicate_json (UfoDaemon *daemon, UfoMessage *request)
     }
 
     scheduler = ufo_scheduler_new ();
+    ufo_base_scheduler_set_cancellable (scheduler, priv->cancellable);
     ufo_base_scheduler_run (scheduler, graph, NULL);
     g_object_unref (scheduler);
 
@@ -262,6 +268,11 @@ handle_stream_json (UfoDaemon *daemon, UfoMessage *request)
     if (error != NULL)
         goto handle_error;
 
+    g_object_set (priv->resources,
+                  "device-selection", priv->device_selection,
+                  "device-partition", priv->device_partition,
+                  NULL);
+
     /* Setup local task graph */
     priv->task_graph = UFO_TASK_GRAPH (ufo_task_graph_new ());
     ufo_task_graph_read_from_data (priv->task_graph, priv->manager, json, &error);
@@ -442,7 +453,13 @@ run_scheduler (UfoDaemon *daemon)
     g_message ("Run scheduler ...");
     scheduler = ufo_scheduler_new ();
 
+    g_object_set (scheduler,
+                  "metrics-file", priv->metrics_file,
+                  "metrics-port", priv->metrics_port,
+                  NULL);
+
     ufo_base_scheduler_set_resources (scheduler, priv->resources);
+    ufo_base_scheduler_set_cancellable (scheduler, priv->cancellable);
     ufo_base_scheduler_run (scheduler, priv->task_graph, NULL);
 
     unref_and_free ((GObject **) &priv->input_task);
@@ -521,6 +538,9 @@ ufo_daemon_start (UfoDaemon *daemon, GError **error)
         return;
     }
 
+    /* A previous stop cancelled it, which would abort every new run at once */
+    g_cancellable_reset (priv->cancellable);
+
     ufo_messenger_connect (priv->messenger, priv->listen_address, UFO_MESSENGER_SERVER, &tmp_error);
 
     if (tmp_error != NULL) {
@@ -550,6 +570,9 @@ ufo_daemon_stop (UfoDaemon *daemon, GError **error)
 
     g_mutex_lock (priv->startstop_lock);
 
+    /* Do not wait for a running graph to drain its inputs */
+    g_cancellable_cancel (priv->cancellable);
+
     /* HACK we can't call _disconnect() as this has to be run from the
      * thread running the daemon which might be blocking on recv
      * - we thus send a TERMINATE message to that thread
@@ -591,6 +614,57 @@ daemon_stop_unlock:
     g_mutex_unlock (priv->startstop_lock);
 }
 
+/**
+ * ufo_daemon_set_devices:
+ * @daemon: A #UfoDaemon
+ * @selection: (allow-none): Device indices as accepted by
+ *      UfoResources:device-selection or %NULL
+ * @partition: (allow-none): Sub-device partitioning as accepted by
+ *      UfoResources:device-partition or %NULL
+ *
+ * Restrict the OpenCL devices that are used to execute task graphs received by
+ * @daemon. This must be called before ufo_daemon_start().
+ */
+void
+ufo_daemon_set_devices (UfoDaemon *daemon,
+                        const gchar *selection,
+                        const gchar *partition)
+{
+    UfoDaemonPrivate *priv;
+
+    g_return_if_fail (UFO_IS_DAEMON (daemon));
+    priv = UFO_DAEMON_GET_PRIVATE (daemon);
+
+    g_free (priv->device_selection);
+    g_free (priv->device_partition);
+    priv->device_selection = g_strdup (selection);
+    priv->device_partition = g_strdup (partition);
+}
+
+/**
+ * ufo_daemon_set_metrics:
+ * @daemon: A #UfoDaemon
+ * @filename: (allow-none): File for live metrics or %NULL
+ * @port: Local port to serve live metrics on or 0
+ *
+ * Export live metrics of the task graphs executed by @daemon. See
+ * UfoBaseScheduler:metrics-file and UfoBaseScheduler:metrics-port.
+ */
+void
+ufo_daemon_set_metrics (UfoDaemon *daemon,
+                        const gchar *filename,
+                        guint port)
+{
+    UfoDaemonPrivate *priv;
+
+    g_return_if_fail (UFO_IS_DAEMON (daemon));
+    priv = UFO_DAEMON_GET_PRIVATE (daemon);
+
+    g_free (priv->metrics_file);
+    priv->metrics_file = g_strdup (filename);
+    priv->metrics_port = port;
+}
+
 void ufo_daemon_wait_finish (UfoDaemon *daemon)
 {
     UfoDaemonPrivate *priv = UFO_DAEMON_GET_PRIVATE (daemon);
@@ -616,6 +690,11 @@ ufo_daemon_dispose (GObject *object)
     if (priv->manager != NULL)
         g_object_unref (priv->manager);
 
+    if (priv->cancellable != NULL) {
+        g_object_unref (priv->cancellable);
+        priv->cancellable = NULL;
+    }
+
     G_OBJECT_CLASS (ufo_daemon_parent_class)->dispose (object);
 }
 
@@ -626,6 +705,9 @@ ufo_daemon_finalize (GObject *object)
     g_mutex_free (priv->startstop_lock);
     g_cond_free (priv->started_cond);
     g_free (priv->listen_address);
+    g_free (priv->device_selection);
+    g_free (priv->device_partition);
+    g_free (priv->metrics_file);
 
     G_OBJECT_CLASS (ufo_daemon_parent_class)->finalize (object);
 }
@@ -655,4 +737,9 @@ ufo_daemon_init (UfoDaemon *self)
     priv->stopped_cond = g_cond_new ();
     priv->has_started = FALSE;
     priv->has_stopped = FALSE;
+    priv->cancellable = g_cancellable_new ();
+    priv->device_selection = NULL;
+    priv->device_partition = NULL;
+    priv->metrics_file = NULL;
+    priv->metrics_port = 0;
 }
@@ -66,6 +66,12 @@ void         ufo_daemon_start             (UfoDaemon    *daemon,
                                            GError      **error);
 void         ufo_daemon_stop              (UfoDaemon    *daemon,
                                            GError      **error);
+void         ufo_daemon_set_devices       (UfoDaemon    *daemon,
+                                           const gchar  *selection,
+                                           const gchar  *partition);
+void         ufo_daemon_set_metrics       (UfoDaemon    *daemon,
+                                           const gchar  *filename,
+                                           guint         port);
 void         ufo_daemon_wait_finish       (UfoDaemon    *daemon);
 GType        ufo_daemon_get_type          (void);
 
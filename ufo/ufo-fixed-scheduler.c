@@ -505,6 +505,23 @@ setup_tasks (UfoGraph *graph,
     return data;
 }
 
+/* Store the statistics of each connection in the profiler of its consumer */
+static void
+collect_queue_stats (ProcessData *pdata)
+{
+    GList *it;
+
+    g_list_for (pdata->connections, it) {
+        Connection *connection;
+        UfoTwoWayQueueStats stats;
+
+        connection = (Connection *) it->data;
+        ufo_two_way_queue_get_stats (connection->queue, &stats);
+        ufo_profiler_set_queue_stats (ufo_task_node_get_profiler (UFO_TASK_NODE (connection->to)),
+                                      connection->from, &stats);
+    }
+}
+
 static void
 ufo_fixed_scheduler_run (UfoBaseScheduler *scheduler,
                          UfoTaskGraph *task_graph,
@@ -558,6 +575,7 @@ ufo_fixed_scheduler_run (UfoBaseScheduler *scheduler,
     join_threads (threads);
 #endif
 
+    collect_queue_stats (pdata);
     g_list_free (threads);
 }
 
@@ -21,40 +21,177 @@
 #include <string.h>
 #include <ufo/ufo-resources.h>
 #include <ufo/ufo-gpu-node.h>
+#include "ufo-trace.h"
 
 G_DEFINE_TYPE (UfoGpuNode, ufo_gpu_node, UFO_TYPE_NODE)
 
 #define UFO_GPU_NODE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_GPU_NODE, UfoGpuNodePrivate))
 
 
+typedef struct {
+    cl_command_queue compute;
+    cl_command_queue upload;
+    cl_command_queue download;
+} QueueSet;
+
 struct _UfoGpuNodePrivate {
     cl_context context;
     cl_device_id device;
-    cl_command_queue cmd_queue;
+    QueueSet queues[2];     /* Indexed by profiling flag */
+    gboolean profiling;
 };
 
+static void
+create_queue_set (UfoGpuNodePrivate *priv,
+                  QueueSet *set,
+                  cl_command_queue_properties queue_properties)
+{
+    cl_int errcode;
+
+    set->compute = clCreateCommandQueue (priv->context, priv->device, queue_properties, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    /*
+     * Transfers get their own queues, so that the copy engines can move data
+     * while kernels of other tasks are executed on the compute queue.
+     */
+    set->upload = clCreateCommandQueue (priv->context, priv->device, queue_properties, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+
+    set->download = clCreateCommandQueue (priv->context, priv->device, queue_properties, &errcode);
+    UFO_RESOURCES_CHECK_CLERR (errcode);
+}
+
+/*
+ * Estimate the offset between host and device clock from the time a marker
+ * was enqueued. The error is bounded by the duration of the enqueue call.
+ */
+static void
+register_queue (UfoGpuNodePrivate *priv,
+                cl_command_queue queue,
+                const gchar *kind)
+{
+    cl_event event;
+    cl_ulong queued;
+    guint64 before;
+    guint64 after;
+    gchar *device_name;
+    gchar *queue_name;
+    gsize size;
+
+    before = ufo_trace_now ();
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueMarker (queue, &event));
+    after = ufo_trace_now ();
+
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_QUEUED, sizeof (cl_ulong), &queued, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (event));
+
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (priv->device, CL_DEVICE_NAME, 0, NULL, &size));
+    device_name = g_malloc0 (size + 1);
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (priv->device, CL_DEVICE_NAME, size, device_name, NULL));
+
+    queue_name = g_strdup_printf ("%s-%p", kind, (gpointer) queue);
+    ufo_trace_register_queue (queue, priv->device, device_name, queue_name,
+                              (gint64) (before + (after - before) / 2) - (gint64) queued);
+
+    g_free (queue_name);
+    g_free (device_name);
+}
+
+static void
+register_queue_set (UfoGpuNodePrivate *priv,
+                    QueueSet *set)
+{
+    register_queue (priv, set->compute, "compute");
+    register_queue (priv, set->upload, "upload");
+    register_queue (priv, set->download, "download");
+}
+
+static void
+release_queue_set (QueueSet *set)
+{
+    if (set->compute == NULL)
+        return;
+
+    ufo_trace_unregister_queue (set->compute);
+    ufo_trace_unregister_queue (set->upload);
+    ufo_trace_unregister_queue (set->download);
+
+    g_debug ("Release cmd_queue=%p", (gpointer) set->compute);
+    UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (set->compute));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (set->upload));
+    UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (set->download));
+    set->compute = set->upload = set->download = NULL;
+}
+
 UfoNode *
 ufo_gpu_node_new (gpointer context, gpointer device)
 {
     UfoGpuNode *node;
-    cl_int errcode;
-    cl_command_queue_properties queue_properties;
 
     g_return_val_if_fail (context != NULL && device != NULL, NULL);
 
-    queue_properties = CL_QUEUE_PROFILING_ENABLE;
-
     node = UFO_GPU_NODE (g_object_new (UFO_TYPE_GPU_NODE, NULL));
     node->priv->context = context;
     node->priv->device = device;
-    node->priv->cmd_queue = clCreateCommandQueue (context, device, queue_properties, &errcode);
 
-    UFO_RESOURCES_CHECK_CLERR (errcode);
+    /* Profiling queues are only created on request, see ufo_gpu_node_set_profiling() */
+    create_queue_set (node->priv, &node->priv->queues[FALSE], 0);
+
     UFO_RESOURCES_CHECK_CLERR (clRetainContext (context));
 
     return UFO_NODE (node);
 }
 
+/**
+ * ufo_gpu_node_set_profiling:
+ * @node: A #UfoGpuNode
+ * @enable: %TRUE if subsequently requested queues must support profiling
+ *
+ * Select whether the command queues returned by ufo_gpu_node_get_cmd_queue()
+ * and friends are created with %CL_QUEUE_PROFILING_ENABLE. Profiling adds
+ * overhead to each command on some platforms and is therefore disabled by
+ * default. Both sets of queues are kept alive once created, so queues that were
+ * handed out before remain valid. Enabling profiling also estimates the offset
+ * between the host and device clocks, so that OpenCL commands can be shown on
+ * the host timeline of a trace.
+ */
+void
+ufo_gpu_node_set_profiling (UfoGpuNode *node,
+                            gboolean enable)
+{
+    UfoGpuNodePrivate *priv;
+
+    g_return_if_fail (UFO_IS_GPU_NODE (node));
+    priv = node->priv;
+    enable = enable ? TRUE : FALSE;
+
+    if (priv->queues[enable].compute == NULL)
+        create_queue_set (priv, &priv->queues[enable], CL_QUEUE_PROFILING_ENABLE);
+
+    /* Estimated anew for each run, device clocks may drift */
+    if (enable)
+        register_queue_set (priv, &priv->queues[TRUE]);
+
+    priv->profiling = enable;
+}
+
+/**
+ * ufo_gpu_node_get_profiling:
+ * @node: A #UfoGpuNode
+ *
+ * Check whether the selected command queues of @node support profiling.
+ *
+ * Returns: %TRUE if profiling is enabled.
+ */
+gboolean
+ufo_gpu_node_get_profiling (UfoGpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_GPU_NODE (node), FALSE);
+    return node->priv->profiling;
+}
+
 /**
  * ufo_gpu_node_get_cmd_queue:
  * @node: A #UfoGpuNode
@@ -67,7 +204,42 @@ gpointer
 ufo_gpu_node_get_cmd_queue (UfoGpuNode *node)
 {
     g_return_val_if_fail (UFO_IS_GPU_NODE (node), NULL);
-    return node->priv->cmd_queue;
+    return node->priv->queues[node->priv->profiling].compute;
+}
+
+/**
+ * ufo_gpu_node_get_upload_queue:
+ * @node: A #UfoGpuNode
+ *
+ * Get the command queue that is used to transfer data from the host to the
+ * device associated with @node. It is distinct from the compute queue returned
+ * by ufo_gpu_node_get_cmd_queue().
+ *
+ * Returns: (transfer none): A cl_command_queue object for host-to-device
+ * transfers.
+ */
+gpointer
+ufo_gpu_node_get_upload_queue (UfoGpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_GPU_NODE (node), NULL);
+    return node->priv->queues[node->priv->profiling].upload;
+}
+
+/**
+ * ufo_gpu_node_get_download_queue:
+ * @node: A #UfoGpuNode
+ *
+ * Get the command queue that is used to transfer data from the device
+ * associated with @node to the host.
+ *
+ * Returns: (transfer none): A cl_command_queue object for device-to-host
+ * transfers.
+ */
+gpointer
+ufo_gpu_node_get_download_queue (UfoGpuNode *node)
+{
+    g_return_val_if_fail (UFO_IS_GPU_NODE (node), NULL);
+    return node->priv->queues[node->priv->profiling].download;
 }
 
 /**
@@ -112,9 +284,15 @@ ufo_gpu_node_copy_real (UfoNode *node,
                         GError **error)
 {
     UfoGpuNode *orig;
+    UfoNode *copy;
 
     orig = UFO_GPU_NODE (node);
-    return ufo_gpu_node_new (orig->priv->context, orig->priv->device);
+    copy = ufo_gpu_node_new (orig->priv->context, orig->priv->device);
+
+    if (orig->priv->profiling)
+        ufo_gpu_node_set_profiling (UFO_GPU_NODE (copy), TRUE);
+
+    return copy;
 }
 
 static gboolean
@@ -122,7 +300,7 @@ ufo_gpu_node_equal_real (UfoNode *n1,
                          UfoNode *n2)
 {
     g_return_val_if_fail (UFO_IS_GPU_NODE (n1) && UFO_IS_GPU_NODE (n2), FALSE);
-    return UFO_GPU_NODE (n1)->priv->cmd_queue == UFO_GPU_NODE (n2)->priv->cmd_queue;
+    return UFO_GPU_NODE (n1)->priv->queues[FALSE].compute == UFO_GPU_NODE (n2)->priv->queues[FALSE].compute;
 }
 
 static void
@@ -132,10 +310,9 @@ ufo_gpu_node_finalize (GObject *object)
 
     priv = UFO_GPU_NODE_GET_PRIVATE (object);
 
-    if (priv->cmd_queue != NULL) {
-        g_debug ("Release cmd_queue=%p", (gpointer) priv->cmd_queue);
-        UFO_RESOURCES_CHECK_CLERR (clReleaseCommandQueue (priv->cmd_queue));
-        priv->cmd_queue = NULL;
+    if (priv->queues[FALSE].compute != NULL) {
+        release_queue_set (&priv->queues[FALSE]);
+        release_queue_set (&priv->queues[TRUE]);
 
         UFO_RESOURCES_CHECK_CLERR (clReleaseContext (priv->context));
     }
@@ -161,5 +338,6 @@ ufo_gpu_node_init (UfoGpuNode *self)
 {
     UfoGpuNodePrivate *priv;
     self->priv = priv = UFO_GPU_NODE_GET_PRIVATE (self);
-    priv->cmd_queue = NULL;
+    memset (priv->queues, 0, sizeof (priv->queues));
+    priv->profiling = FALSE;
 }
@@ -77,7 +77,13 @@ typedef enum {
 
 UfoNode  *ufo_gpu_node_new              (gpointer        context,
                                          gpointer        device);
+void      ufo_gpu_node_set_profiling    (UfoGpuNode     *node,
+                                         gboolean        enable);
+gboolean  ufo_gpu_node_get_profiling    (UfoGpuNode     *node);
 gpointer  ufo_gpu_node_get_cmd_queue    (UfoGpuNode     *node);
+gpointer  ufo_gpu_node_get_upload_queue (UfoGpuNode     *node);
+gpointer  ufo_gpu_node_get_download_queue
+                                        (UfoGpuNode     *node);
 GValue   *ufo_gpu_node_get_info         (UfoGpuNode     *node,
                                          UfoGpuNodeInfo  info);
 GType     ufo_gpu_node_get_type         (void);
@@ -429,6 +429,42 @@ join_threads (GList *threads)
     }
 }
 
+/*
+ * All children of a group share its output queue, so each consumer task gets
+ * the statistics of that queue for every task of the producing group.
+ */
+static void
+collect_queue_stats (GList *groups)
+{
+    GList *it;
+
+    g_list_for (groups, it) {
+        TaskGroup *group;
+        GList *jt;
+
+        group = ufo_node_get_label (UFO_NODE (it->data));
+
+        g_list_for (group->parents, jt) {
+            TaskGroup *parent;
+            UfoTwoWayQueueStats stats;
+            GList *kt;
+
+            parent = (TaskGroup *) jt->data;
+            ufo_two_way_queue_get_stats (parent->queue, &stats);
+
+            g_list_for (group->tasks, kt) {
+                UfoProfiler *profiler;
+                GList *lt;
+
+                profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (kt->data));
+
+                g_list_for (parent->tasks, lt)
+                    ufo_profiler_set_queue_stats (profiler, lt->data, &stats);
+            }
+        }
+    }
+}
+
 static void
 ufo_group_scheduler_run (UfoBaseScheduler *scheduler,
                          UfoTaskGraph *task_graph,
@@ -492,6 +528,8 @@ ufo_group_scheduler_run (UfoBaseScheduler *scheduler,
     join_threads (threads);
 #endif
 
+    collect_queue_stats (groups);
+
 cleanup_run:
     g_list_free (tasks);
     g_list_free (groups);
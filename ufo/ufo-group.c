@@ -31,12 +31,19 @@ struct _UfoGroupPrivate {
     guint            n_targets;
     UfoTwoWayQueue  **queues;
     gint            *n_expected;
+    UfoOverflowPolicy *policies;
+    UfoBuffer      **spares;
+    guint64         *n_bytes;
+    gint            *done;
+    gint             aborted;
     gint             n_received;
     gboolean        *ready;
     UfoSendPattern   pattern;
     guint            current;
+    guint            depth;
     cl_context       context;
     GList           *buffers;
+    UfoProfiler     *profiler;
 };
 
 enum {
@@ -48,7 +55,9 @@ enum {
 /**
  * ufo_group_new:
  * @targets: (element-type UfoNode): A list of #UfoNode targets
- * @context: A cl_context on which the targets should operate on.
+ * @context: (allow-none): A cl_context on which the targets should operate
+ * on or %NULL if none of them uses OpenCL, in which case the buffers of the
+ * group only have host memory.
  * @pattern: Pattern to distribute data among the @targets
  *
  * Create a new #UfoGroup.
@@ -70,10 +79,16 @@ ufo_group_new (GList *targets,
     priv->n_targets = g_list_length (targets);
     priv->queues = g_new0 (UfoTwoWayQueue *, priv->n_targets);
     priv->n_expected = g_new0 (gint, priv->n_targets);
+    priv->policies = g_new0 (UfoOverflowPolicy, priv->n_targets);
+    priv->spares = g_new0 (UfoBuffer *, priv->n_targets);
+    priv->n_bytes = g_new0 (guint64, priv->n_targets);
+    priv->done = g_new0 (gint, priv->n_targets);
+    priv->aborted = FALSE;
     priv->pattern = pattern;
     priv->current = 0;
     priv->context = context;
     priv->n_received = 0;
+    priv->depth = priv->n_targets + 1;
 
     for (guint i = 0; i < priv->n_targets; i++)
         priv->queues[i] = ufo_two_way_queue_new (NULL);
@@ -88,20 +103,160 @@ ufo_group_get_num_targets (UfoGroup *group)
     return group->priv->n_targets;
 }
 
+/**
+ * ufo_group_set_queue_depth:
+ * @group: A #UfoGroup
+ * @depth: Maximum number of buffers per target
+ *
+ * Limit the number of buffers that are allocated for each target of @group. By
+ * default, a producer can get ahead of each consumer by as many items as there
+ * are targets. A depth of 1 hands over every item directly and trades
+ * throughput for latency.
+ */
+void
+ufo_group_set_queue_depth (UfoGroup *group,
+                           guint depth)
+{
+    g_return_if_fail (UFO_IS_GROUP (group));
+    g_return_if_fail (depth > 0);
+    group->priv->depth = depth;
+}
+
+/**
+ * ufo_group_set_profiler:
+ * @group: A #UfoGroup
+ * @profiler: (allow-none): Profiler of the producing node or %NULL
+ *
+ * Account the memory of all buffers that @group allocates from now on to
+ * @profiler, see ufo_buffer_set_profiler().
+ */
+void
+ufo_group_set_profiler (UfoGroup *group,
+                        UfoProfiler *profiler)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+
+    if (profiler != NULL)
+        g_object_ref (profiler);
+
+    if (priv->profiler != NULL)
+        g_object_unref (priv->profiler);
+
+    priv->profiler = profiler;
+}
+
+/**
+ * ufo_group_set_spin_count:
+ * @group: A #UfoGroup
+ * @n_spins: Number of polls before blocking
+ *
+ * Make both ends of all queues in @group poll @n_spins times before they block
+ * waiting for an item. See also ufo_two_way_queue_set_spin_count().
+ */
+void
+ufo_group_set_spin_count (UfoGroup *group,
+                          guint n_spins)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+
+    for (guint i = 0; i < priv->n_targets; i++)
+        ufo_two_way_queue_set_spin_count (priv->queues[i], n_spins);
+}
+
+static void
+count_dropped (UfoGroupPrivate *priv,
+               guint pos)
+{
+    UfoTaskNode *target;
+
+    target = UFO_TASK_NODE (g_list_nth_data (priv->targets, pos));
+    ufo_profiler_count_dropped (ufo_task_node_get_profiler (target));
+}
+
+static UfoBuffer *
+get_spare_buffer (UfoGroupPrivate *priv,
+                  guint pos,
+                  UfoRequisition *requisition)
+{
+    if (priv->spares[pos] == NULL) {
+        priv->spares[pos] = ufo_buffer_new (requisition, priv->context);
+        ufo_buffer_set_profiler (priv->spares[pos], priv->profiler);
+        priv->buffers = g_list_append (priv->buffers, priv->spares[pos]);
+    }
+
+    return priv->spares[pos];
+}
+
 static UfoBuffer *
 pop_or_alloc_buffer (UfoGroupPrivate *priv,
                      guint pos,
                      UfoRequisition *requisition)
 {
-    UfoBuffer *buffer;
+    UfoBuffer *buffer = NULL;
+    UfoTwoWayQueue *queue;
+
+    queue = priv->queues[pos];
+
+    /* Nobody consumes anymore, let the producer write into the void */
+    if (g_atomic_int_get (&priv->done[pos]))
+        buffer = get_spare_buffer (priv, pos, requisition);
+
+    if (buffer == NULL && ufo_two_way_queue_get_capacity (queue) < priv->depth) {
+        UfoBuffer *fresh;
 
-    if (ufo_two_way_queue_get_capacity (priv->queues[pos]) < (priv->n_targets + 1)) {
-        buffer = ufo_buffer_new (requisition, priv->context);
-        priv->buffers = g_list_append (priv->buffers, buffer);
-        ufo_two_way_queue_insert (priv->queues[pos], buffer);
+        fresh = ufo_buffer_new (requisition, priv->context);
+        ufo_buffer_set_profiler (fresh, priv->profiler);
+        priv->buffers = g_list_append (priv->buffers, fresh);
+        ufo_two_way_queue_insert (queue, fresh);
     }
 
-    buffer = ufo_two_way_queue_producer_pop (priv->queues[pos]);
+    /*
+     * Sequential streams are counted item by item and must not lose any, so we
+     * only apply the overflow policy for the other patterns.
+     */
+    if (buffer == NULL && priv->pattern != UFO_SEND_SEQUENTIAL) {
+        switch (priv->policies[pos]) {
+            case UFO_OVERFLOW_DROP_OLDEST:
+                buffer = ufo_two_way_queue_producer_try_pop (queue);
+
+                if (buffer == NULL) {
+                    buffer = ufo_two_way_queue_producer_reclaim (queue);
+
+                    if (buffer != NULL)
+                        count_dropped (priv, pos);
+                }
+                break;
+
+            case UFO_OVERFLOW_DROP_NEWEST:
+                buffer = ufo_two_way_queue_producer_try_pop (queue);
+
+                /* Let the producer write into a scratch buffer that is
+                 * discarded in ufo_group_push_output_buffer() */
+                if (buffer == NULL)
+                    buffer = get_spare_buffer (priv, pos, requisition);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    if (buffer == NULL)
+        buffer = ufo_two_way_queue_producer_pop (queue);
+
+    /* We were woken up by ufo_group_abort() or ufo_group_set_target_done() */
+    if (buffer == UFO_END_OF_STREAM) {
+        if (g_atomic_int_get (&priv->aborted))
+            return NULL;
+
+        buffer = get_spare_buffer (priv, pos, requisition);
+    }
 
     if (ufo_buffer_cmp_dimensions (buffer, requisition))
         ufo_buffer_resize (buffer, requisition);
@@ -109,13 +264,36 @@ pop_or_alloc_buffer (UfoGroupPrivate *priv,
     return buffer;
 }
 
+static void
+push_buffer (UfoGroupPrivate *priv,
+             guint pos,
+             UfoBuffer *buffer)
+{
+    priv->n_bytes[pos] += ufo_buffer_get_size (buffer);
+    ufo_two_way_queue_producer_push (priv->queues[pos], buffer);
+}
+
+static void
+push_or_drop_buffer (UfoGroupPrivate *priv,
+                     guint pos,
+                     UfoBuffer *buffer)
+{
+    if (buffer == priv->spares[pos]) {
+        if (!g_atomic_int_get (&priv->done[pos]))
+            count_dropped (priv, pos);
+    }
+    else
+        push_buffer (priv, pos, buffer);
+}
+
 /**
  * ufo_group_pop_output_buffer:
  * @group: A #UfoGroup
  * @requisition: Size of the buffer.
  *
  * Return value: (transfer full): A newly allocated buffer or a re-used buffer
- * that must be released with ufo_group_push_output_buffer().
+ * that must be released with ufo_group_push_output_buffer(). %NULL is returned
+ * if @group was aborted with ufo_group_abort().
  */
 UfoBuffer *
 ufo_group_pop_output_buffer (UfoGroup *group,
@@ -126,6 +304,9 @@ ufo_group_pop_output_buffer (UfoGroup *group,
 
     priv = group->priv;
 
+    if (g_atomic_int_get (&priv->aborted))
+        return NULL;
+
     if ((priv->pattern == UFO_SEND_SCATTER) || (priv->pattern == UFO_SEND_SEQUENTIAL))
         pos = priv->current;
 
@@ -139,11 +320,15 @@ ufo_group_push_output_buffer (UfoGroup *group,
     UfoGroupPrivate *priv;
 
     priv = group->priv;
+
+    if (g_atomic_int_get (&priv->aborted))
+        return;
+
     priv->n_received++;
 
     /* Copy or not depending on the send pattern */
     if (priv->pattern == UFO_SEND_SCATTER) {
-        ufo_two_way_queue_producer_push (priv->queues[priv->current], buffer);
+        push_or_drop_buffer (priv, priv->current, buffer);
         priv->current = (priv->current + 1) % priv->n_targets;
     }
     else if (priv->pattern == UFO_SEND_BROADCAST) {
@@ -155,14 +340,26 @@ ufo_group_push_output_buffer (UfoGroup *group,
             UfoBuffer *copy;
 
             copy = pop_or_alloc_buffer (priv, pos, &requisition);
+
+            if (copy == NULL)
+                return;
+
+            if (copy == priv->spares[pos]) {
+                if (!g_atomic_int_get (&priv->done[pos]))
+                    count_dropped (priv, pos);
+
+                continue;
+            }
+
             ufo_buffer_copy (buffer, copy);
-            ufo_two_way_queue_producer_push (priv->queues[pos], copy);
+            ufo_buffer_set_timestamp (copy, ufo_buffer_get_timestamp (buffer));
+            push_buffer (priv, pos, copy);
         }
 
-        ufo_two_way_queue_producer_push (priv->queues[0], buffer);
+        push_or_drop_buffer (priv, 0, buffer);
     }
     else if (priv->pattern == UFO_SEND_SEQUENTIAL) {
-        ufo_two_way_queue_producer_push (priv->queues[priv->current], buffer);
+        push_or_drop_buffer (priv, priv->current, buffer);
 
         if (priv->n_expected[priv->current] == priv->n_received) {
             ufo_two_way_queue_producer_push (priv->queues[priv->current], UFO_END_OF_STREAM);
@@ -188,13 +385,39 @@ ufo_group_set_num_expected (UfoGroup *group,
     priv->n_expected[pos] = n_expected;
 }
 
+/**
+ * ufo_group_set_overflow_policy:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @policy: Policy applied when @target cannot keep up
+ *
+ * Set what happens if the producer of @group outruns @target. The policy is
+ * ignored for #UFO_SEND_SEQUENTIAL groups which always block.
+ */
+void
+ufo_group_set_overflow_policy (UfoGroup *group,
+                               UfoTask *target,
+                               UfoOverflowPolicy policy)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    if (pos >= 0)
+        priv->policies[pos] = policy;
+}
+
 /**
  * ufo_group_pop_input_buffer:
  * @group: A #UfoGroup
  * @target: The #UfoTask that is a target in @group
  *
  * Return value: (transfer full): A buffer that must be released with
- * ufo_group_push_input_buffer().
+ * ufo_group_push_input_buffer() or %UFO_END_OF_STREAM if the stream ended or
+ * @group was aborted.
  */
 UfoBuffer *
 ufo_group_pop_input_buffer (UfoGroup *group,
@@ -205,6 +428,10 @@ ufo_group_pop_input_buffer (UfoGroup *group,
     gint pos;
 
     priv = group->priv;
+
+    if (g_atomic_int_get (&priv->aborted))
+        return UFO_END_OF_STREAM;
+
     pos = g_list_index (priv->targets, target);
     input = pos >= 0 ? ufo_two_way_queue_consumer_pop (priv->queues[pos]) : NULL;
 
@@ -237,6 +464,143 @@ ufo_group_finish (UfoGroup *group)
         ufo_two_way_queue_producer_push (priv->queues[i], UFO_END_OF_STREAM);
 }
 
+/**
+ * ufo_group_set_target_done:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Tell the producer of @group that @target will not consume any more items.
+ * Items for @target are discarded from now on and a producer that is waiting
+ * for @target to release a buffer is woken up.
+ */
+void
+ufo_group_set_target_done (UfoGroup *group,
+                           UfoTask *target)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    if (pos < 0 || g_atomic_int_get (&priv->done[pos]))
+        return;
+
+    g_atomic_int_set (&priv->done[pos], TRUE);
+    ufo_two_way_queue_consumer_push (priv->queues[pos], UFO_END_OF_STREAM);
+}
+
+/**
+ * ufo_group_is_done:
+ * @group: A #UfoGroup
+ *
+ * Check if all targets of @group have been marked done with
+ * ufo_group_set_target_done(), i.e. if producing more data is pointless.
+ *
+ * Returns: %TRUE if no target consumes any more data.
+ */
+gboolean
+ufo_group_is_done (UfoGroup *group)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), FALSE);
+    priv = group->priv;
+
+    if (priv->n_targets == 0)
+        return FALSE;
+
+    for (guint i = 0; i < priv->n_targets; i++) {
+        if (!g_atomic_int_get (&priv->done[i]))
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/**
+ * ufo_group_abort:
+ * @group: A #UfoGroup
+ *
+ * Abort all data transfers in @group. Threads that are blocked waiting for
+ * input or output buffers are woken up, ufo_group_pop_input_buffer() returns
+ * %UFO_END_OF_STREAM and ufo_group_pop_output_buffer() returns %NULL from now
+ * on. This function can be called from any thread.
+ */
+void
+ufo_group_abort (UfoGroup *group)
+{
+    UfoGroupPrivate *priv;
+
+    g_return_if_fail (UFO_IS_GROUP (group));
+    priv = group->priv;
+
+    if (g_atomic_int_get (&priv->aborted))
+        return;
+
+    g_atomic_int_set (&priv->aborted, TRUE);
+
+    for (guint i = 0; i < priv->n_targets; i++) {
+        ufo_two_way_queue_producer_push (priv->queues[i], UFO_END_OF_STREAM);
+        ufo_two_way_queue_consumer_push (priv->queues[i], UFO_END_OF_STREAM);
+    }
+}
+
+/**
+ * ufo_group_get_queue_stats:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ * @stats: (out): Location for the statistics
+ *
+ * Get the statistics of the queue between the producer of @group and @target.
+ * See ufo_two_way_queue_get_stats().
+ *
+ * Returns: %TRUE if @target is a target of @group.
+ */
+gboolean
+ufo_group_get_queue_stats (UfoGroup *group,
+                           UfoTask *target,
+                           UfoTwoWayQueueStats *stats)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), FALSE);
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    if (pos < 0)
+        return FALSE;
+
+    ufo_two_way_queue_get_stats (priv->queues[pos], stats);
+    return TRUE;
+}
+
+/**
+ * ufo_group_get_num_bytes:
+ * @group: A #UfoGroup
+ * @target: The #UfoTask that is a target in @group
+ *
+ * Get the number of bytes that were passed to @target. Dropped items are not
+ * counted.
+ *
+ * Returns: Number of bytes.
+ */
+guint64
+ufo_group_get_num_bytes (UfoGroup *group,
+                         UfoTask *target)
+{
+    UfoGroupPrivate *priv;
+    gint pos;
+
+    g_return_val_if_fail (UFO_IS_GROUP (group), 0);
+    priv = group->priv;
+    pos = g_list_index (priv->targets, target);
+
+    return pos >= 0 ? priv->n_bytes[pos] : 0;
+}
+
 static void
 ufo_group_dispose(GObject *object)
 {
@@ -244,6 +608,14 @@ ufo_group_dispose(GObject *object)
 
     priv = UFO_GROUP_GET_PRIVATE (object);
     g_list_foreach (priv->buffers, (GFunc) g_object_unref, NULL);
+    g_list_free (priv->buffers);
+    priv->buffers = NULL;
+
+    if (priv->profiler != NULL) {
+        g_object_unref (priv->profiler);
+        priv->profiler = NULL;
+    }
+
     G_OBJECT_CLASS (ufo_group_parent_class)->dispose (object);
 }
 
@@ -255,13 +627,14 @@ ufo_group_finalize (GObject *object)
     priv = UFO_GROUP_GET_PRIVATE (object);
 
     g_free (priv->n_expected);
+    g_free (priv->policies);
+    g_free (priv->spares);
+    g_free (priv->n_bytes);
+    g_free (priv->done);
 
     g_list_free (priv->targets);
     priv->targets = NULL;
 
-    g_list_free (priv->buffers);
-    priv->buffers = NULL;
-
     for (guint i = 0; i < priv->n_targets; i++)
         ufo_two_way_queue_free (priv->queues[i]);
 
@@ -288,4 +661,5 @@ ufo_group_init (UfoGroup *self)
     UfoGroupPrivate *priv;
     self->priv = priv = UFO_GROUP_GET_PRIVATE (self);
     priv->buffers = NULL;
+    priv->profiler = NULL;
 }
@@ -26,6 +26,8 @@
 
 #include <ufo/ufo-task-iface.h>
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-two-way-queue.h>
+#include <ufo/ufo-profiler.h>
 
 G_BEGIN_DECLS
 
@@ -57,6 +59,23 @@ typedef enum {
     UFO_SEND_SEQUENTIAL
 } UfoSendPattern;
 
+/**
+ * UfoOverflowPolicy:
+ * @UFO_OVERFLOW_BLOCK: Block the producer until the consumer releases a buffer
+ * @UFO_OVERFLOW_DROP_OLDEST: Take back the oldest item that has not been
+ *  consumed yet and overwrite it with the new one
+ * @UFO_OVERFLOW_DROP_NEWEST: Discard the item that is currently produced
+ *
+ * The overflow policy decides what happens if a producer outruns the consumer
+ * of an edge. Dropped items are counted with ufo_profiler_count_dropped() on
+ * the profiler of the consuming node.
+ */
+typedef enum {
+    UFO_OVERFLOW_BLOCK,
+    UFO_OVERFLOW_DROP_OLDEST,
+    UFO_OVERFLOW_DROP_NEWEST
+} UfoOverflowPolicy;
+
 /**
  * UfoGroup:
  *
@@ -84,9 +103,18 @@ UfoGroup  * ufo_group_new                   (GList          *targets,
                                              gpointer        context,
                                              UfoSendPattern  pattern);
 guint       ufo_group_get_num_targets       (UfoGroup       *group);
+void        ufo_group_set_queue_depth       (UfoGroup       *group,
+                                             guint           depth);
+void        ufo_group_set_profiler          (UfoGroup       *group,
+                                             UfoProfiler    *profiler);
+void        ufo_group_set_spin_count        (UfoGroup       *group,
+                                             guint           n_spins);
 void        ufo_group_set_num_expected      (UfoGroup       *group,
                                              UfoTask        *target,
                                              gint            n_expected);
+void        ufo_group_set_overflow_policy   (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             UfoOverflowPolicy policy);
 UfoBuffer * ufo_group_pop_output_buffer     (UfoGroup       *group,
                                              UfoRequisition *requisition);
 void        ufo_group_push_output_buffer    (UfoGroup       *group,
@@ -97,6 +125,15 @@ void        ufo_group_push_input_buffer     (UfoGroup       *group,
                                              UfoTask        *target,
                                              UfoBuffer      *input);
 void        ufo_group_finish                (UfoGroup       *group);
+void        ufo_group_set_target_done       (UfoGroup       *group,
+                                             UfoTask        *target);
+gboolean    ufo_group_is_done               (UfoGroup       *group);
+void        ufo_group_abort                 (UfoGroup       *group);
+gboolean    ufo_group_get_queue_stats       (UfoGroup       *group,
+                                             UfoTask        *target,
+                                             UfoTwoWayQueueStats *stats);
+guint64     ufo_group_get_num_bytes         (UfoGroup       *group,
+                                             UfoTask        *target);
 GType       ufo_group_get_type              (void);
 
 G_END_DECLS
@@ -345,6 +345,47 @@ setup_tasks (UfoGraph *graph,
     return local;
 }
 
+/* Store the statistics of each input queue in the profiler of its consumer */
+static void
+collect_queue_stats (UfoGraph *graph,
+                     GHashTable *task_data)
+{
+    GHashTableIter iter;
+    gpointer key;
+    gpointer value;
+
+    g_hash_table_iter_init (&iter, task_data);
+
+    while (g_hash_table_iter_next (&iter, &key, &value)) {
+        TaskLocal *data;
+        GList *predecessors;
+        GList *it;
+
+        data = (TaskLocal *) value;
+
+        if (data->inputs == NULL)
+            continue;
+
+        predecessors = ufo_graph_get_predecessors (graph, UFO_NODE (key));
+
+        g_list_for (predecessors, it) {
+            UfoTwoWayQueueStats stats;
+            guint port;
+
+            port = (guint) GPOINTER_TO_INT (ufo_graph_get_edge_label (graph, UFO_NODE (it->data), UFO_NODE (key)));
+
+            if (port >= data->n_inputs || data->inputs[port] == NULL)
+                continue;
+
+            ufo_two_way_queue_get_stats (data->inputs[port], &stats);
+            ufo_profiler_set_queue_stats (ufo_task_node_get_profiler (UFO_TASK_NODE (data->task)),
+                                          it->data, &stats);
+        }
+
+        g_list_free (predecessors);
+    }
+}
+
 static void
 ufo_local_scheduler_run (UfoBaseScheduler *scheduler,
                          UfoTaskGraph *task_graph,
@@ -392,6 +433,7 @@ ufo_local_scheduler_run (UfoBaseScheduler *scheduler,
     join_threads (threads);
 #endif
 
+    collect_queue_stats (UFO_GRAPH (task_graph), task_data);
     ufo_pp_destroy (pp);
     g_list_free (threads);
     g_hash_table_destroy (task_data);
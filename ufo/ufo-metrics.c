@@ -0,0 +1,456 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <gio/gio.h>
+#include <stdarg.h>
+#include <string.h>
+#include "ufo/ufo-group.h"
+#include "ufo/ufo-profiler.h"
+#include "ufo/ufo-task-node.h"
+#include "ufo-metrics.h"
+#include "compat.h"
+
+/*
+ * Live metrics of a running graph. A sampler thread periodically reads the
+ * counters of all nodes and edges, formats them in the Prometheus text format
+ * and atomically replaces the metrics file with them. If a port is given, the
+ * last sample is also served over HTTP on localhost so that it can be scraped
+ * while the graph is running.
+ *
+ * Counters are read without synchronization. A sample may therefore be
+ * slightly inconsistent, but sampling never blocks the pipeline.
+ */
+
+typedef struct {
+    UfoTaskNode *node;
+    gchar       *name;
+    guint        last_processed;
+} NodeMetrics;
+
+typedef struct {
+    UfoTaskNode *producer;
+    UfoTaskNode *consumer;
+    const gchar *producer_name;
+    const gchar *consumer_name;
+} EdgeMetrics;
+
+struct _UfoMetrics {
+    NodeMetrics     *nodes;
+    guint            n_nodes;
+    EdgeMetrics     *edges;
+    guint            n_edges;
+    gchar           *filename;
+    gdouble          interval;
+    gint64           start_time;
+    gint64           last_time;
+
+    GMutex          *lock;          /* Protects running and text */
+    GCond           *cond;
+    gboolean         running;
+    gchar           *text;
+    GThread         *sampler;
+
+    GSocketListener *listener;
+    GCancellable    *cancellable;
+    GThread         *server;
+};
+
+static void
+append_header (GString *str,
+               const gchar *name,
+               const gchar *type,
+               const gchar *help)
+{
+    g_string_append_printf (str, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+static void
+append_edge (GString *str,
+             const gchar *name,
+             EdgeMetrics *edge,
+             const gchar *format,
+             ...)
+{
+    va_list args;
+
+    g_string_append_printf (str, "%s{producer=\"%s\",consumer=\"%s\"} ",
+                            name, edge->producer_name, edge->consumer_name);
+    va_start (args, format);
+    g_string_append_vprintf (str, format, args);
+    va_end (args);
+    g_string_append_c (str, '\n');
+}
+
+static gboolean
+get_edge_stats (EdgeMetrics *edge,
+                UfoTwoWayQueueStats *stats,
+                guint64 *n_bytes)
+{
+    UfoGroup *group;
+
+    group = ufo_task_node_get_out_group (edge->producer);
+
+    if (group == NULL || !ufo_group_get_queue_stats (group, UFO_TASK (edge->consumer), stats))
+        return FALSE;
+
+    *n_bytes = ufo_group_get_num_bytes (group, UFO_TASK (edge->consumer));
+    return TRUE;
+}
+
+/*
+ * Take a sample of all counters and return it in the Prometheus text format.
+ * Rates are computed relative to the previous sample.
+ */
+gchar *
+ufo_metrics_sample (UfoMetrics *metrics)
+{
+    GString *str;
+    UfoTwoWayQueueStats *stats;
+    guint64 *n_bytes;
+    gboolean *valid;
+    guint *processed;
+    gint64 now;
+    gdouble elapsed;
+
+    now = g_get_monotonic_time ();
+    elapsed = MAX ((now - metrics->last_time) * 1e-6, 1e-6);
+    metrics->last_time = now;
+
+    processed = g_new0 (guint, metrics->n_nodes);
+    stats = g_new0 (UfoTwoWayQueueStats, metrics->n_edges);
+    n_bytes = g_new0 (guint64, metrics->n_edges);
+    valid = g_new0 (gboolean, metrics->n_edges);
+
+    for (guint i = 0; i < metrics->n_nodes; i++)
+        g_object_get (metrics->nodes[i].node, "num-processed", &processed[i], NULL);
+
+    for (guint i = 0; i < metrics->n_edges; i++)
+        valid[i] = get_edge_stats (&metrics->edges[i], &stats[i], &n_bytes[i]);
+
+    str = g_string_new (NULL);
+
+    append_header (str, "ufo_uptime_seconds", "gauge", "Time since the graph was started");
+    g_string_append_printf (str, "ufo_uptime_seconds %.3f\n", (now - metrics->start_time) * 1e-6);
+
+    append_header (str, "ufo_items_processed_total", "counter", "Items processed by a node");
+
+    for (guint i = 0; i < metrics->n_nodes; i++)
+        g_string_append_printf (str, "ufo_items_processed_total{node=\"%s\"} %u\n",
+                                metrics->nodes[i].name, processed[i]);
+
+    append_header (str, "ufo_items_per_second", "gauge", "Items processed per second since the last sample");
+
+    for (guint i = 0; i < metrics->n_nodes; i++) {
+        g_string_append_printf (str, "ufo_items_per_second{node=\"%s\"} %.3f\n",
+                                metrics->nodes[i].name,
+                                (processed[i] - metrics->nodes[i].last_processed) / elapsed);
+        metrics->nodes[i].last_processed = processed[i];
+    }
+
+    append_header (str, "ufo_gpu_seconds_total", "counter", "GPU time of completed kernels, only recorded when tracing");
+
+    for (guint i = 0; i < metrics->n_nodes; i++)
+        g_string_append_printf (str, "ufo_gpu_seconds_total{node=\"%s\"} %.6f\n",
+                                metrics->nodes[i].name,
+                                ufo_profiler_get_gpu_time (ufo_task_node_get_profiler (metrics->nodes[i].node)));
+
+    append_header (str, "ufo_edge_items_total", "counter", "Items passed along an edge");
+
+    for (guint i = 0; i < metrics->n_edges; i++) {
+        if (valid[i])
+            append_edge (str, "ufo_edge_items_total", &metrics->edges[i], "%" G_GUINT64_FORMAT, stats[i].n_items);
+    }
+
+    append_header (str, "ufo_edge_bytes_total", "counter", "Bytes passed along an edge");
+
+    for (guint i = 0; i < metrics->n_edges; i++) {
+        if (valid[i])
+            append_edge (str, "ufo_edge_bytes_total", &metrics->edges[i], "%" G_GUINT64_FORMAT, n_bytes[i]);
+    }
+
+    append_header (str, "ufo_edge_queue_depth", "gauge", "Items waiting for the consumer");
+
+    for (guint i = 0; i < metrics->n_edges; i++) {
+        if (valid[i])
+            append_edge (str, "ufo_edge_queue_depth", &metrics->edges[i], "%u", stats[i].occupancy);
+    }
+
+    append_header (str, "ufo_edge_producer_blocked_seconds_total", "counter", "Time the producer waited for the consumer");
+
+    for (guint i = 0; i < metrics->n_edges; i++) {
+        if (valid[i])
+            append_edge (str, "ufo_edge_producer_blocked_seconds_total", &metrics->edges[i], "%.6f", stats[i].producer_blocked);
+    }
+
+    append_header (str, "ufo_edge_consumer_blocked_seconds_total", "counter", "Time the consumer waited for the producer");
+
+    for (guint i = 0; i < metrics->n_edges; i++) {
+        if (valid[i])
+            append_edge (str, "ufo_edge_consumer_blocked_seconds_total", &metrics->edges[i], "%.6f", stats[i].consumer_blocked);
+    }
+
+    g_free (processed);
+    g_free (stats);
+    g_free (n_bytes);
+    g_free (valid);
+
+    return g_string_free (str, FALSE);
+}
+
+static void
+publish (UfoMetrics *metrics)
+{
+    GError *error = NULL;
+    gchar *text;
+
+    text = ufo_metrics_sample (metrics);
+
+    if (metrics->filename != NULL && !g_file_set_contents (metrics->filename, text, -1, &error)) {
+        /* Do not repeat the warning every interval */
+        g_warning ("Could not write metrics, disabling file output: %s", error->message);
+        g_error_free (error);
+        g_free (metrics->filename);
+        metrics->filename = NULL;
+    }
+
+    g_mutex_lock (metrics->lock);
+    g_free (metrics->text);
+    metrics->text = text;
+    g_mutex_unlock (metrics->lock);
+}
+
+static gpointer
+sample_loop (UfoMetrics *metrics)
+{
+    g_mutex_lock (metrics->lock);
+
+    while (metrics->running) {
+        GTimeVal deadline;
+
+        g_get_current_time (&deadline);
+        g_time_val_add (&deadline, (glong) (metrics->interval * G_USEC_PER_SEC));
+
+        if (!g_cond_timed_wait (metrics->cond, metrics->lock, &deadline)) {
+            g_mutex_unlock (metrics->lock);
+            publish (metrics);
+            g_mutex_lock (metrics->lock);
+        }
+    }
+
+    g_mutex_unlock (metrics->lock);
+    return NULL;
+}
+
+static void
+serve_client (UfoMetrics *metrics,
+              GSocketConnection *connection)
+{
+    GInputStream *input;
+    GOutputStream *output;
+    gchar request[1024];
+    gchar *text;
+    gchar *response;
+
+    /* Do not let a silent client stall the server */
+    g_socket_set_timeout (g_socket_connection_get_socket (connection), 2);
+    input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+    output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+
+    /* Every request gets the same document, so we do not parse it */
+    if (g_input_stream_read (input, request, sizeof (request), metrics->cancellable, NULL) < 0)
+        return;
+
+    g_mutex_lock (metrics->lock);
+    text = g_strdup (metrics->text != NULL ? metrics->text : "");
+    g_mutex_unlock (metrics->lock);
+
+    response = g_strdup_printf ("HTTP/1.0 200 OK\r\n"
+                                "Content-Type: text/plain; version=0.0.4\r\n"
+                                "Content-Length: %zu\r\n"
+                                "Connection: close\r\n\r\n%s",
+                                strlen (text), text);
+
+    g_output_stream_write_all (output, response, strlen (response), NULL, metrics->cancellable, NULL);
+    g_io_stream_close (G_IO_STREAM (connection), NULL, NULL);
+    g_free (response);
+    g_free (text);
+}
+
+static gpointer
+serve_loop (UfoMetrics *metrics)
+{
+    while (!g_cancellable_is_cancelled (metrics->cancellable)) {
+        GSocketConnection *connection;
+        GError *error = NULL;
+
+        connection = g_socket_listener_accept (metrics->listener, NULL, metrics->cancellable, &error);
+
+        if (connection == NULL) {
+            if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+                g_warning ("Could not accept metrics connection: %s", error->message);
+
+            g_error_free (error);
+            break;
+        }
+
+        serve_client (metrics, connection);
+        g_object_unref (connection);
+    }
+
+    return NULL;
+}
+
+static gboolean
+listen_on_localhost (UfoMetrics *metrics,
+                     guint port,
+                     GError **error)
+{
+    GInetAddress *address;
+    GSocketAddress *socket_address;
+    gboolean success;
+
+    metrics->listener = g_socket_listener_new ();
+    address = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+    socket_address = g_inet_socket_address_new (address, (guint16) port);
+
+    success = g_socket_listener_add_address (metrics->listener, socket_address,
+                                             G_SOCKET_TYPE_STREAM, G_SOCKET_PROTOCOL_TCP,
+                                             NULL, NULL, error);
+
+    g_object_unref (socket_address);
+    g_object_unref (address);
+    return success;
+}
+
+/*
+ * Start sampling the nodes and edges of @graph every @interval seconds. The
+ * samples are written to @filename if it is not %NULL and served on @port of
+ * localhost if it is not 0. The groups of @graph must have been set up and
+ * remain valid until ufo_metrics_free() is called.
+ */
+UfoMetrics *
+ufo_metrics_new (UfoTaskGraph *graph,
+                 const gchar *filename,
+                 guint port,
+                 gdouble interval,
+                 GError **error)
+{
+    UfoMetrics *metrics;
+    GList *nodes;
+    GList *it;
+    guint n_nodes = 0;
+    guint n_edges = 0;
+
+    g_return_val_if_fail (port <= G_MAXUINT16, NULL);
+
+    metrics = g_new0 (UfoMetrics, 1);
+    metrics->filename = g_strdup (filename);
+    metrics->interval = interval;
+    metrics->lock = g_mutex_new ();
+    metrics->cond = g_cond_new ();
+    metrics->cancellable = g_cancellable_new ();
+    metrics->start_time = metrics->last_time = g_get_monotonic_time ();
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+    metrics->n_nodes = g_list_length (nodes);
+    metrics->nodes = g_new0 (NodeMetrics, metrics->n_nodes);
+
+    g_list_for (nodes, it) {
+        NodeMetrics *node = &metrics->nodes[n_nodes++];
+
+        node->node = UFO_TASK_NODE (it->data);
+        node->name = g_strdup_printf ("%s-%p", G_OBJECT_TYPE_NAME (it->data), it->data);
+        g_object_get (node->node, "num-processed", &node->last_processed, NULL);
+        n_edges += ufo_graph_get_num_successors (UFO_GRAPH (graph), UFO_NODE (it->data));
+    }
+
+    metrics->edges = g_new0 (EdgeMetrics, n_edges);
+
+    for (guint i = 0; i < metrics->n_nodes; i++) {
+        GList *successors;
+
+        successors = ufo_graph_get_successors (UFO_GRAPH (graph), UFO_NODE (metrics->nodes[i].node));
+
+        g_list_for (successors, it) {
+            EdgeMetrics *edge = &metrics->edges[metrics->n_edges++];
+
+            edge->producer = metrics->nodes[i].node;
+            edge->producer_name = metrics->nodes[i].name;
+            edge->consumer = UFO_TASK_NODE (it->data);
+            edge->consumer_name = metrics->nodes[g_list_index (nodes, it->data)].name;
+        }
+
+        g_list_free (successors);
+    }
+
+    g_list_free (nodes);
+
+    if (port > 0 && !listen_on_localhost (metrics, port, error)) {
+        ufo_metrics_free (metrics);
+        return NULL;
+    }
+
+    metrics->running = TRUE;
+    metrics->sampler = g_thread_create ((GThreadFunc) sample_loop, metrics, TRUE, NULL);
+
+    if (metrics->listener != NULL)
+        metrics->server = g_thread_create ((GThreadFunc) serve_loop, metrics, TRUE, NULL);
+
+    return metrics;
+}
+
+/*
+ * Stop sampling, write a final sample and close the server.
+ */
+void
+ufo_metrics_free (UfoMetrics *metrics)
+{
+    if (metrics->sampler != NULL) {
+        g_mutex_lock (metrics->lock);
+        metrics->running = FALSE;
+        g_cond_signal (metrics->cond);
+        g_mutex_unlock (metrics->lock);
+
+        g_thread_join (metrics->sampler);
+        publish (metrics);
+    }
+
+    if (metrics->server != NULL) {
+        g_cancellable_cancel (metrics->cancellable);
+        g_thread_join (metrics->server);
+    }
+
+    if (metrics->listener != NULL) {
+        g_socket_listener_close (metrics->listener);
+        g_object_unref (metrics->listener);
+    }
+
+    for (guint i = 0; i < metrics->n_nodes; i++)
+        g_free (metrics->nodes[i].name);
+
+    g_object_unref (metrics->cancellable);
+    g_mutex_free (metrics->lock);
+    g_cond_free (metrics->cond);
+    g_free (metrics->nodes);
+    g_free (metrics->edges);
+    g_free (metrics->filename);
+    g_free (metrics->text);
+    g_free (metrics);
+}
@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_METRICS_H
+#define UFO_METRICS_H
+
+#include <ufo/ufo-task-graph.h>
+
+typedef struct _UfoMetrics UfoMetrics;
+
+UfoMetrics     *ufo_metrics_new         (UfoTaskGraph   *graph,
+                                         const gchar    *filename,
+                                         guint           port,
+                                         gdouble         interval,
+                                         GError        **error);
+void            ufo_metrics_free        (UfoMetrics     *metrics);
+gchar          *ufo_metrics_sample      (UfoMetrics     *metrics);
+
+#endif
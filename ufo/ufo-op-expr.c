@@ -0,0 +1,615 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <math.h>
+#include <string.h>
+#include <ufo/ufo-op-expr.h>
+#include "ufo-basic-ops-private.h"
+
+/**
+ * SECTION:ufo-op-expr
+ * @Short_description: Fused elementwise operations
+ * @Title: UfoOpExpr
+ *
+ * A #UfoOpExpr describes an elementwise computation on buffers and scalars,
+ * e.g. <literal>x + 0.5 * (y - z)</literal>. Instead of launching one kernel
+ * per operation like ufo_op_add2() and friends, ufo_op_expr_eval() generates a
+ * single OpenCL kernel for the whole expression and launches it once, so each
+ * input is read and the output is written exactly once:
+ *
+ * <programlisting>
+ * UfoOpExpr *expr;
+ *
+ * expr = ufo_op_expr_add (ufo_op_expr_buffer (x),
+ *                         ufo_op_expr_mul (ufo_op_expr_scalar (0.5f),
+ *                                          ufo_op_expr_sub (ufo_op_expr_buffer (y),
+ *                                                           ufo_op_expr_buffer (z))));
+ * event = ufo_op_expr_eval (expr, x, resources, cmd_queue);
+ * ufo_op_expr_free (expr);
+ * </programlisting>
+ *
+ * The generated kernels are cached per thread by the SHA-1 of their source
+ * with ufo_resources_get_thread_kernel_from_source(). Scalar values are passed
+ * as kernel arguments and do not appear in the source, so changing them
+ * between iterations does not cause a rebuild. Scalars are broadcast to all
+ * elements, buffers must have the same size as the output. The output buffer
+ * may also appear as an operand, in which case the kernel reads it through the
+ * output argument rather than binding it twice. If there is no command queue
+ * or all operands live on the host, the expression is evaluated on the host.
+ */
+
+typedef enum {
+    OP_BUFFER,
+    OP_SCALAR,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MIN,
+    OP_MAX,
+    OP_NEG,
+    OP_INV,
+    OP_SQRT,
+    OP_ABS,
+} OpType;
+
+/**
+ * UfoOpExpr: (skip)
+ *
+ * An opaque expression tree of buffers, scalars and operations. It is not
+ * available through introspection.
+ */
+struct _UfoOpExpr {
+    OpType      type;
+    UfoBuffer  *buffer;
+    gfloat      value;
+    UfoOpExpr  *a;
+    UfoOpExpr  *b;
+};
+
+typedef struct {
+    UfoBuffer   *out;
+    GPtrArray   *buffers;
+    GArray      *scalars;
+    GString     *code;
+} Codegen;
+
+#define HOST_CHUNK_SIZE     1024
+
+static const gchar *kernel_header =
+    "float ufo_op_inv (float x)\n"
+    "{\n"
+    "    return x != 0.0f ? 1.0f / x : 0.0f;\n"
+    "}\n\n";
+
+static UfoOpExpr *
+new_node (OpType type,
+          UfoOpExpr *a,
+          UfoOpExpr *b)
+{
+    UfoOpExpr *expr;
+
+    expr = g_new0 (UfoOpExpr, 1);
+    expr->type = type;
+    expr->a = a;
+    expr->b = b;
+    return expr;
+}
+
+/**
+ * ufo_op_expr_buffer: (skip)
+ * @buffer: A #UfoBuffer
+ *
+ * Create an expression that evaluates to the elements of @buffer.
+ *
+ * Returns: (transfer full): A new #UfoOpExpr
+ */
+UfoOpExpr *
+ufo_op_expr_buffer (UfoBuffer *buffer)
+{
+    UfoOpExpr *expr;
+
+    g_return_val_if_fail (UFO_IS_BUFFER (buffer), NULL);
+
+    expr = new_node (OP_BUFFER, NULL, NULL);
+    expr->buffer = g_object_ref (buffer);
+    return expr;
+}
+
+/**
+ * ufo_op_expr_scalar: (skip)
+ * @value: Scalar value
+ *
+ * Create an expression that evaluates to @value for every element.
+ *
+ * Returns: (transfer full): A new #UfoOpExpr
+ */
+UfoOpExpr *
+ufo_op_expr_scalar (gfloat value)
+{
+    UfoOpExpr *expr;
+
+    expr = new_node (OP_SCALAR, NULL, NULL);
+    expr->value = value;
+    return expr;
+}
+
+/**
+ * ufo_op_expr_add: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for @a + @b
+ */
+UfoOpExpr *
+ufo_op_expr_add (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_ADD, a, b);
+}
+
+/**
+ * ufo_op_expr_sub: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for @a - @b
+ */
+UfoOpExpr *
+ufo_op_expr_sub (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_SUB, a, b);
+}
+
+/**
+ * ufo_op_expr_mul: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for @a * @b
+ */
+UfoOpExpr *
+ufo_op_expr_mul (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_MUL, a, b);
+}
+
+/**
+ * ufo_op_expr_div: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for @a / @b
+ */
+UfoOpExpr *
+ufo_op_expr_div (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_DIV, a, b);
+}
+
+/**
+ * ufo_op_expr_min: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for the minimum of @a and @b
+ */
+UfoOpExpr *
+ufo_op_expr_min (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_MIN, a, b);
+}
+
+/**
+ * ufo_op_expr_max: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ * @b: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for the maximum of @a and @b
+ */
+UfoOpExpr *
+ufo_op_expr_max (UfoOpExpr *a, UfoOpExpr *b)
+{
+    g_return_val_if_fail (a != NULL && b != NULL, NULL);
+    return new_node (OP_MAX, a, b);
+}
+
+/**
+ * ufo_op_expr_neg: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for -@a
+ */
+UfoOpExpr *
+ufo_op_expr_neg (UfoOpExpr *a)
+{
+    g_return_val_if_fail (a != NULL, NULL);
+    return new_node (OP_NEG, a, NULL);
+}
+
+/**
+ * ufo_op_expr_inv: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ *
+ * Like ufo_op_inv(), zero elements stay zero.
+ *
+ * Returns: (transfer full): An expression for 1 / @a
+ */
+UfoOpExpr *
+ufo_op_expr_inv (UfoOpExpr *a)
+{
+    g_return_val_if_fail (a != NULL, NULL);
+    return new_node (OP_INV, a, NULL);
+}
+
+/**
+ * ufo_op_expr_sqrt: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for the square root of @a
+ */
+UfoOpExpr *
+ufo_op_expr_sqrt (UfoOpExpr *a)
+{
+    g_return_val_if_fail (a != NULL, NULL);
+    return new_node (OP_SQRT, a, NULL);
+}
+
+/**
+ * ufo_op_expr_abs: (skip)
+ * @a: (transfer full): A #UfoOpExpr
+ *
+ * Returns: (transfer full): An expression for the absolute value of @a
+ */
+UfoOpExpr *
+ufo_op_expr_abs (UfoOpExpr *a)
+{
+    g_return_val_if_fail (a != NULL, NULL);
+    return new_node (OP_ABS, a, NULL);
+}
+
+/**
+ * ufo_op_expr_free: (skip)
+ * @expr: A #UfoOpExpr
+ *
+ * Free @expr and all its operands.
+ */
+void
+ufo_op_expr_free (UfoOpExpr *expr)
+{
+    if (expr == NULL)
+        return;
+
+    ufo_op_expr_free (expr->a);
+    ufo_op_expr_free (expr->b);
+
+    if (expr->buffer != NULL)
+        g_object_unref (expr->buffer);
+
+    g_free (expr);
+}
+
+static void
+generate (Codegen *gen,
+          UfoOpExpr *expr)
+{
+    static const gchar *binary_formats[] = {
+        [OP_ADD] = "(%s + %s)",
+        [OP_SUB] = "(%s - %s)",
+        [OP_MUL] = "(%s * %s)",
+        [OP_DIV] = "(%s / %s)",
+        [OP_MIN] = "fmin (%s, %s)",
+        [OP_MAX] = "fmax (%s, %s)",
+    };
+    static const gchar *unary_formats[] = {
+        [OP_NEG] = "(-%s)",
+        [OP_INV] = "ufo_op_inv (%s)",
+        [OP_SQRT] = "sqrt (%s)",
+        [OP_ABS] = "fabs (%s)",
+    };
+    GString *outer;
+    gchar *a;
+    guint index;
+
+    switch (expr->type) {
+        case OP_BUFFER:
+            if (expr->buffer == gen->out) {
+                g_string_append (gen->code, "out[i]");
+                break;
+            }
+
+            for (index = 0; index < gen->buffers->len; index++) {
+                if (g_ptr_array_index (gen->buffers, index) == expr->buffer)
+                    break;
+            }
+
+            if (index == gen->buffers->len)
+                g_ptr_array_add (gen->buffers, expr->buffer);
+
+            g_string_append_printf (gen->code, "b%u[i]", index);
+            break;
+
+        case OP_SCALAR:
+            g_string_append_printf (gen->code, "s%u", gen->scalars->len);
+            g_array_append_val (gen->scalars, expr->value);
+            break;
+
+        case OP_NEG:
+        case OP_INV:
+        case OP_SQRT:
+        case OP_ABS:
+            outer = gen->code;
+            gen->code = g_string_new (NULL);
+            generate (gen, expr->a);
+            a = g_string_free (gen->code, FALSE);
+            gen->code = outer;
+            g_string_append_printf (gen->code, unary_formats[expr->type], a);
+            g_free (a);
+            break;
+
+        default:
+            {
+                gchar *b;
+
+                outer = gen->code;
+                gen->code = g_string_new (NULL);
+                generate (gen, expr->a);
+                a = g_string_free (gen->code, FALSE);
+                gen->code = g_string_new (NULL);
+                generate (gen, expr->b);
+                b = g_string_free (gen->code, FALSE);
+                gen->code = outer;
+                g_string_append_printf (gen->code, binary_formats[expr->type], a, b);
+                g_free (a);
+                g_free (b);
+            }
+            break;
+    }
+}
+
+static gchar *
+generate_source (Codegen *gen)
+{
+    GString *source;
+
+    source = g_string_new (kernel_header);
+    g_string_append (source, "kernel void\nufo_op_expr (global float *out,\n            const uint n");
+
+    for (guint i = 0; i < gen->buffers->len; i++)
+        g_string_append_printf (source, ",\n            global const float *b%u", i);
+
+    for (guint i = 0; i < gen->scalars->len; i++)
+        g_string_append_printf (source, ",\n            const float s%u", i);
+
+    g_string_append_printf (source,
+                            ")\n{\n"
+                            "    const uint i = get_global_id (0);\n\n"
+                            "    if (i < n)\n"
+                            "        out[i] = %s;\n"
+                            "}\n", gen->code->str);
+
+    return g_string_free (source, FALSE);
+}
+
+/*
+ * Evaluate @expr for @n elements starting at @offset into @result. Operands
+ * are read before the caller writes @result back, so the output buffer may
+ * be an operand here as well.
+ */
+static void
+eval_on_host (UfoOpExpr *expr,
+              gpointer command_queue,
+              gsize offset,
+              gsize n,
+              gfloat *result)
+{
+    gfloat other[HOST_CHUNK_SIZE];
+    gfloat *data;
+
+    switch (expr->type) {
+        case OP_BUFFER:
+            data = ufo_buffer_get_host_array (expr->buffer, command_queue);
+            memcpy (result, data + offset, n * sizeof (gfloat));
+            return;
+
+        case OP_SCALAR:
+            for (gsize i = 0; i < n; i++)
+                result[i] = expr->value;
+            return;
+
+        default:
+            break;
+    }
+
+    eval_on_host (expr->a, command_queue, offset, n, result);
+
+    if (expr->b != NULL)
+        eval_on_host (expr->b, command_queue, offset, n, other);
+
+    for (gsize i = 0; i < n; i++) {
+        switch (expr->type) {
+            case OP_ADD:
+                result[i] += other[i];
+                break;
+            case OP_SUB:
+                result[i] -= other[i];
+                break;
+            case OP_MUL:
+                result[i] *= other[i];
+                break;
+            case OP_DIV:
+                result[i] /= other[i];
+                break;
+            case OP_MIN:
+                result[i] = fminf (result[i], other[i]);
+                break;
+            case OP_MAX:
+                result[i] = fmaxf (result[i], other[i]);
+                break;
+            case OP_NEG:
+                result[i] = -result[i];
+                break;
+            case OP_INV:
+                result[i] = result[i] != 0.0f ? 1.0f / result[i] : 0.0f;
+                break;
+            case OP_SQRT:
+                result[i] = sqrtf (result[i]);
+                break;
+            case OP_ABS:
+                result[i] = fabsf (result[i]);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/* Like the basic operations, compute on the host if no operand is on the device */
+static gboolean
+use_host (Codegen *gen,
+          gpointer command_queue)
+{
+    if (command_queue == NULL)
+        return TRUE;
+
+    for (guint i = 0; i < gen->buffers->len; i++) {
+        if (!ufo_op_is_on_host (g_ptr_array_index (gen->buffers, i)))
+            return FALSE;
+    }
+
+    return gen->buffers->len > 0 || ufo_op_is_on_host (gen->out);
+}
+
+static void
+free_codegen (Codegen *gen)
+{
+    g_ptr_array_free (gen->buffers, TRUE);
+    g_array_free (gen->scalars, TRUE);
+    g_string_free (gen->code, TRUE);
+}
+
+/**
+ * ufo_op_expr_eval: (skip)
+ * @expr: A #UfoOpExpr
+ * @out: A #UfoBuffer that receives the result
+ * @resources: #UfoResources object
+ * @command_queue: (allow-none): A cl_command_queue or %NULL to compute on the host
+ *
+ * Evaluate @expr for every element and store the result in @out. All buffers
+ * in @expr must have the same size as @out. @expr is not consumed and can be
+ * evaluated again.
+ *
+ * Returns: (transfer full) (allow-none): Event of the fused operation or %NULL
+ *  without @command_queue or if the sizes do not match
+ */
+gpointer
+ufo_op_expr_eval (UfoOpExpr *expr,
+                  UfoBuffer *out,
+                  UfoResources *resources,
+                  gpointer command_queue)
+{
+    Codegen gen;
+    cl_kernel kernel;
+    cl_mem d_out;
+    cl_event event;
+    cl_uint n;
+    gsize size;
+    gsize global_work_size;
+    gchar *source;
+    GError *error = NULL;
+
+    g_return_val_if_fail (expr != NULL && UFO_IS_BUFFER (out), NULL);
+
+    gen.out = out;
+    gen.buffers = g_ptr_array_new ();
+    gen.scalars = g_array_new (FALSE, FALSE, sizeof (gfloat));
+    gen.code = g_string_new (NULL);
+    generate (&gen, expr);
+
+    size = ufo_buffer_get_size (out);
+
+    for (guint i = 0; i < gen.buffers->len; i++) {
+        if (ufo_buffer_get_size (g_ptr_array_index (gen.buffers, i)) != size) {
+            g_warning ("Expression operands must have the same size as the output");
+            free_codegen (&gen);
+            return NULL;
+        }
+    }
+
+    n = (cl_uint) (size / sizeof (gfloat));
+
+    if (use_host (&gen, command_queue)) {
+        gfloat result[HOST_CHUNK_SIZE];
+        gfloat *data;
+
+        for (gsize offset = 0; offset < n; offset += HOST_CHUNK_SIZE) {
+            gsize chunk = MIN (HOST_CHUNK_SIZE, n - offset);
+
+            eval_on_host (expr, command_queue, offset, chunk, result);
+            data = ufo_buffer_get_host_array (out, command_queue);
+            memcpy (data + offset, result, chunk * sizeof (gfloat));
+        }
+
+        free_codegen (&gen);
+        return ufo_op_completed_event (command_queue);
+    }
+
+    source = generate_source (&gen);
+    kernel = ufo_resources_get_thread_kernel_from_source (resources, source, "ufo_op_expr", &error);
+    g_free (source);
+
+    if (error != NULL) {
+        g_error ("%s\n", error->message);
+        return NULL;
+    }
+
+    global_work_size = n;
+
+    for (guint i = 0; i < gen.buffers->len; i++) {
+        cl_mem d_arg;
+
+        d_arg = ufo_buffer_get_device_array (g_ptr_array_index (gen.buffers, i), command_queue);
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2 + i, sizeof (cl_mem), &d_arg));
+    }
+
+    for (guint i = 0; i < gen.scalars->len; i++) {
+        UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 2 + gen.buffers->len + i, sizeof (gfloat),
+                                                   &g_array_index (gen.scalars, gfloat, i)));
+    }
+
+    /* Request the output last so that it ends up on the device */
+    d_out = ufo_buffer_get_device_array (out, command_queue);
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 0, sizeof (cl_mem), &d_out));
+    UFO_RESOURCES_CHECK_CLERR (clSetKernelArg (kernel, 1, sizeof (cl_uint), &n));
+
+    ufo_resources_enqueue_kernel (resources, command_queue, kernel, 1, &global_work_size, (gpointer *) &event);
+
+    free_codegen (&gen);
+    return event;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UFO_OP_EXPR_H
+#define __UFO_OP_EXPR_H
+
+#if !defined (__UFO_H_INSIDE__) && !defined (UFO_COMPILATION)
+#error "Only <ufo/ufo.h> can be included directly."
+#endif
+
+#include <glib-object.h>
+#include <ufo/ufo-buffer.h>
+#include <ufo/ufo-resources.h>
+
+G_BEGIN_DECLS
+
+typedef struct _UfoOpExpr UfoOpExpr;
+
+UfoOpExpr  *ufo_op_expr_buffer  (UfoBuffer      *buffer);
+UfoOpExpr  *ufo_op_expr_scalar  (gfloat          value);
+UfoOpExpr  *ufo_op_expr_add     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_sub     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_mul     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_div     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_min     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_max     (UfoOpExpr      *a,
+                                 UfoOpExpr      *b);
+UfoOpExpr  *ufo_op_expr_neg     (UfoOpExpr      *a);
+UfoOpExpr  *ufo_op_expr_inv     (UfoOpExpr      *a);
+UfoOpExpr  *ufo_op_expr_sqrt    (UfoOpExpr      *a);
+UfoOpExpr  *ufo_op_expr_abs     (UfoOpExpr      *a);
+void        ufo_op_expr_free    (UfoOpExpr      *expr);
+gpointer    ufo_op_expr_eval    (UfoOpExpr      *expr,
+                                 UfoBuffer      *out,
+                                 UfoResources   *resources,
+                                 gpointer        command_queue);
+
+G_END_DECLS
+
+#endif
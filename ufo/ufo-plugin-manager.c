@@ -23,6 +23,7 @@
 #include <ufo/ufo-plugin-manager.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-dummy-task.h>
+#include <ufo/ufo-synthetic-task.h>
 #include "compat.h"
 
 /**
@@ -319,6 +320,9 @@ ufo_plugin_manager_get_task (UfoPluginManager *manager, const gchar *name, GErro
     if (!g_strcmp0 (name, "[dummy]"))
         return UFO_TASK_NODE (ufo_dummy_task_new ());
 
+    if (!g_strcmp0 (name, "synthetic"))
+        return UFO_TASK_NODE (ufo_synthetic_task_new ());
+
     gchar *module_name = ufo_transform_string ("libufofilter%s.so", name, NULL);
     gchar *func_name = ufo_transform_string ("ufo_%s_task_new", name, "_");
     node = UFO_TASK_NODE (ufo_plugin_manager_get_plugin (manager, func_name, module_name, error));
@@ -373,7 +377,7 @@ ufo_plugin_manager_get_task_from_package (UfoPluginManager   *manager,
  * @manager: A #UfoPluginManager
  *
  * Return a list with potential filter names that match shared objects in all
- * search paths.
+ * search paths and the built-in `synthetic' task.
  *
  * Return value: (element-type utf8) (transfer full): List of strings with filter names
  */
@@ -384,6 +388,7 @@ ufo_plugin_manager_get_all_task_names (UfoPluginManager *manager)
     GRegex *regex = g_regex_new ("libufofilter([A-Za-z]+).so", 0, 0, NULL);
 
     GList *result = ufo_plugin_get_all_plugin_names(manager, regex, "libufofilter*.so");
+    result = g_list_append (result, g_strdup ("synthetic"));
 
     g_regex_unref (regex);
     return result;
@@ -3,7 +3,8 @@
 
 #include <glib.h>
 
-void ufo_write_profile_events   (GList *nodes);
-void ufo_write_opencl_events    (GList *nodes);
+void     ufo_start_tracing          (GList *nodes);
+void     ufo_stop_tracing           (GList *nodes);
+gboolean ufo_any_task_uses_gpu      (GList *nodes);
 
 #endif
@@ -27,6 +27,7 @@
 
 #include <ufo/ufo-profiler.h>
 #include <ufo/ufo-resources.h>
+#include "ufo-trace.h"
 
 /**
  * SECTION:ufo-profiler
@@ -43,23 +44,75 @@
  *
  * Moreover, a profiler object is used to measure wall clock time for I/O,
  * synchronization and general CPU computation.
+ *
+ * Recorded OpenCL events are resolved and released as soon as their commands
+ * have completed. While a trace is written to disk, their timestamps go
+ * directly to the trace file, otherwise only the timestamps are kept.
  */
 
 G_DEFINE_TYPE(UfoProfiler, ufo_profiler, G_TYPE_OBJECT)
 
 #define UFO_PROFILER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_PROFILER, UfoProfilerPrivate))
 
+/* Number of pending events after which completed events are resolved */
+#define RESOLVE_THRESHOLD   256
+
+/*
+ * Durations are kept in log-bucketed histograms of nanoseconds. Values below
+ * HISTOGRAM_SUB_BUCKETS are counted exactly, larger ones fall into one of
+ * HISTOGRAM_SUB_BUCKETS linear buckets per power of two. This bounds the
+ * relative error to 1/16 with a fixed size and a constant recording cost.
+ */
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_SUB_BUCKETS   (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_N_BUCKETS     ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+    guint       counts[HISTOGRAM_N_BUCKETS];
+    guint64     n_values;
+    guint64     max;
+} Histogram;
+
+typedef struct {
+    gsize       current;
+    gsize       peak;
+} MemoryCounter;
+
+/* Allocations of all profilers per device, NULL is the host */
+static GStaticMutex memory_lock = G_STATIC_MUTEX_INIT;
+static GHashTable *total_memory = NULL;
+
 struct EventRow {
     cl_event    event;
     cl_kernel   kernel;
     cl_command_queue queue;
 };
 
+struct ResolvedRow {
+    const gchar *name;
+    cl_command_queue queue;
+    gulong      queued;
+    gulong      submitted;
+    gulong      start;
+    gulong      end;
+};
+
 struct _UfoProfilerPrivate {
+    UfoResources *resources;
     GArray  *event_array;
+    GArray  *resolved_array;
+    GHashTable *kernel_names;
+    gdouble  gpu_time;
     GTimer **timers;
     GList   *trace_events;
     gboolean trace;
+    guint    n_latencies;
+    gdouble  latency_sum;
+    gdouble  latency_max;
+    gint     n_dropped;
+    GHashTable *queue_stats;
+    Histogram *histograms;
+    GHashTable *memory;
 };
 
 enum {
@@ -67,8 +120,6 @@ enum {
     N_PROPERTIES
 };
 
-static GTimer *global_clock = NULL;
-
 
 /**
  * UfoProfilerTimer:
@@ -85,6 +136,113 @@ static GTimer *global_clock = NULL;
  * ufo_profiler_start(), ufo_profiler_stop() and ufo_profiler_elapsed().
  */
 
+static void
+get_time_stamps (cl_event event, gulong *queued, gulong *submitted, gulong *start, gulong *end)
+{
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_QUEUED, sizeof (cl_ulong), queued, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_SUBMIT, sizeof (cl_ulong), submitted, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_START, sizeof (cl_ulong), start, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_END, sizeof (cl_ulong), end, NULL));
+}
+
+static gchar *
+get_kernel_name (cl_kernel kernel)
+{
+    gsize size;
+    gchar *s;
+
+    clGetKernelInfo (kernel, CL_KERNEL_FUNCTION_NAME, 0, NULL, &size);
+    s = g_malloc0(size + 1);
+    clGetKernelInfo (kernel, CL_KERNEL_FUNCTION_NAME, size, s, NULL);
+    return s;
+}
+
+static const gchar *
+lookup_kernel_name (UfoProfilerPrivate *priv,
+                    cl_kernel kernel)
+{
+    const gchar *name;
+
+    name = g_hash_table_lookup (priv->kernel_names, kernel);
+
+    if (name == NULL) {
+        gchar *s;
+
+        /* Interned so that resolved rows can outlive the kernel */
+        s = get_kernel_name (kernel);
+        name = g_intern_string (s);
+        g_hash_table_insert (priv->kernel_names, kernel, (gpointer) name);
+        g_free (s);
+    }
+
+    return name;
+}
+
+/*
+ * Read the timestamps of completed events and release them. If @wait is
+ * %FALSE, events whose commands are still pending are kept for later.
+ */
+static void
+resolve_events (UfoProfiler *profiler,
+                gboolean wait)
+{
+    UfoProfilerPrivate *priv = profiler->priv;
+    guint n_pending = 0;
+
+    for (guint i = 0; i < priv->event_array->len; i++) {
+        struct EventRow *row;
+        struct ResolvedRow resolved;
+
+        row = &g_array_index (priv->event_array, struct EventRow, i);
+
+        if (!wait) {
+            cl_int status;
+
+            UFO_RESOURCES_CHECK_CLERR (clGetEventInfo (row->event, CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                                       sizeof (cl_int), &status, NULL));
+
+            if (status > CL_COMPLETE) {
+                g_array_index (priv->event_array, struct EventRow, n_pending++) = *row;
+                continue;
+            }
+        }
+
+        resolved.name = lookup_kernel_name (priv, row->kernel);
+        resolved.queue = row->queue;
+        get_time_stamps (row->event, &resolved.queued, &resolved.submitted, &resolved.start, &resolved.end);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (row->event));
+
+        if (resolved.end < resolved.start)
+            priv->gpu_time += (gdouble) ((G_MAXULONG - resolved.start) + resolved.end) * 1e-9;
+        else
+            priv->gpu_time += ((gdouble) (resolved.end - resolved.start)) * 1e-9;
+
+        if (!ufo_trace_write_device_event (resolved.name, resolved.queue, profiler, resolved.start, resolved.end))
+            g_array_append_val (priv->resolved_array, resolved);
+    }
+
+    g_array_set_size (priv->event_array, n_pending);
+}
+
+static void
+append_event (UfoProfiler *profiler,
+              cl_event event,
+              cl_kernel kernel,
+              cl_command_queue queue)
+{
+    UfoProfilerPrivate *priv = profiler->priv;
+    struct EventRow row;
+
+    row.event = event;
+    row.kernel = kernel;
+    row.queue = queue;
+    g_array_append_val (priv->event_array, row);
+
+    if (priv->event_array->len >= RESOLVE_THRESHOLD)
+        resolve_events (profiler, FALSE);
+}
+
 /**
  * ufo_profiler_new:
  *
@@ -106,12 +264,14 @@ ufo_profiler_new (void)
  * @work_dim: Number of working dimensions.
  * @global_work_size: Sizes of global dimensions. The array must have at least
  *      @work_dim entries.
- * @local_work_size: Sizes of local work group dimensions. The array must have
- *      at least @work_dim entries.
+ * @local_work_size: (allow-none): Sizes of local work group dimensions. The
+ *      array must have at least @work_dim entries.
  *
  * Execute the @kernel using the command queue and execution parameters. The
  * event associated with the clEnqueueNDRangeKernel() call is recorded and may
- * be used for profiling purposes later on.
+ * be used for profiling purposes later on. If @local_work_size is %NULL and
+ * resources were set with ufo_profiler_set_resources(), the kernel is launched
+ * with ufo_resources_enqueue_kernel() to use a tuned local work size.
  */
 void
 ufo_profiler_call (UfoProfiler    *profiler,
@@ -127,16 +287,25 @@ ufo_profiler_call (UfoProfiler    *profiler,
     g_return_if_fail (UFO_IS_PROFILER (profiler));
     priv = profiler->priv;
 
+    if (local_work_size == NULL && priv->resources != NULL) {
+        cl_event event;
+
+        if (!priv->trace) {
+            ufo_resources_enqueue_kernel (priv->resources, command_queue, kernel, work_dim, global_work_size, NULL);
+            return;
+        }
+
+        ufo_resources_enqueue_kernel (priv->resources, command_queue, kernel, work_dim, global_work_size, (gpointer *) &event);
+
+        append_event (profiler, event, kernel, command_queue);
+        return;
+    }
+
     if (priv->trace) {
         cl_event event;
-        struct EventRow row;
 
         cl_err = clEnqueueNDRangeKernel (command_queue, kernel, work_dim, NULL, global_work_size, local_work_size, 0, NULL, &event);
-
-        row.event = event;
-        row.kernel = kernel;
-        row.queue = command_queue;
-        g_array_append_val (priv->event_array, row);
+        append_event (profiler, event, kernel, command_queue);
     }
     else {
         cl_err = clEnqueueNDRangeKernel (command_queue, kernel, work_dim, NULL, global_work_size, local_work_size, 0, NULL, NULL);
@@ -145,6 +314,31 @@ ufo_profiler_call (UfoProfiler    *profiler,
     UFO_RESOURCES_CHECK_CLERR (cl_err);
 }
 
+/**
+ * ufo_profiler_set_resources:
+ * @profiler: A #UfoProfiler object.
+ * @resources: (allow-none): A #UfoResources object or %NULL
+ *
+ * Use @resources to look up tuned local work sizes in ufo_profiler_call().
+ */
+void
+ufo_profiler_set_resources (UfoProfiler *profiler,
+                            UfoResources *resources)
+{
+    UfoProfilerPrivate *priv;
+
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    priv = profiler->priv;
+
+    if (resources != NULL)
+        g_object_ref (resources);
+
+    if (priv->resources != NULL)
+        g_object_unref (priv->resources);
+
+    priv->resources = resources;
+}
+
 void
 ufo_profiler_register_event (UfoProfiler *profiler,
                              gpointer command_queue,
@@ -155,13 +349,8 @@ ufo_profiler_register_event (UfoProfiler *profiler,
     g_return_if_fail (UFO_IS_PROFILER (profiler));
     priv = profiler->priv;
 
-    if (priv->trace) {
-        struct EventRow row;
-        row.event = event;
-        row.kernel = kernel;
-        row.queue = command_queue;
-        g_array_append_val (priv->event_array, row);
-    }
+    if (priv->trace)
+        append_event (profiler, event, kernel, command_queue);
 }
 
 /**
@@ -196,21 +385,24 @@ ufo_profiler_stop (UfoProfiler       *profiler,
     g_timer_stop (profiler->priv->timers[timer]);
 }
 
+/**
+ * ufo_profiler_trace_event:
+ * @profiler: A #UfoProfiler object.
+ * @type: Type of the event
+ *
+ * Record a trace event if tracing is enabled. Events are stored in a fixed-size
+ * buffer of the calling thread, so this is cheap and never blocks.
+ */
 void
 ufo_profiler_trace_event (UfoProfiler *profiler,
                           UfoTraceEventType type)
 {
-    UfoTraceEvent *event;
-
     g_return_if_fail (UFO_IS_PROFILER (profiler));
+
     if (!profiler->priv->trace)
         return;
 
-    event = g_malloc0 (sizeof(UfoTraceEvent));
-    event->type = type;
-    event->thread_id = g_thread_self ();
-    event->timestamp = g_timer_elapsed (global_clock, NULL);
-    profiler->priv->trace_events = g_list_append (profiler->priv->trace_events, event);
+    ufo_trace_record (profiler, type);
 }
 
 
@@ -226,55 +418,49 @@ ufo_profiler_enable_tracing (UfoProfiler *profiler,
  * ufo_profiler_get_trace_events: (skip)
  * @profiler: A #UfoProfiler object.
  *
- * Get all events recorded with @profiler.
+ * Get all events recorded with @profiler during the last traced run. Event
+ * timestamps are in seconds of the monotonic clock.
  *
  * Returns: (element-type UfoTraceEvent): A list with #UfoTraceEvent objects.
  */
 GList *
 ufo_profiler_get_trace_events (UfoProfiler *profiler)
 {
-    g_return_val_if_fail (UFO_IS_PROFILER (profiler), NULL);
-    return profiler->priv->trace_events;
-}
-
-static void
-get_time_stamps (cl_event event, gulong *queued, gulong *submitted, gulong *start, gulong *end)
-{
-    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &event));
-    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_QUEUED, sizeof (cl_ulong), queued, NULL));
-    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_SUBMIT, sizeof (cl_ulong), submitted, NULL));
-    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_START, sizeof (cl_ulong), start, NULL));
-    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_END, sizeof (cl_ulong), end, NULL));
-}
-
-static gdouble
-gpu_elapsed (UfoProfilerPrivate *priv)
-{
-    struct EventRow *row;
-    gdouble elapsed = 0.0;
-    guint len = priv->event_array->len;
+    UfoProfilerPrivate *priv;
+    UfoTraceRecord *records;
+    guint n_records;
 
-    if (len == 0)
-        return 0.0;
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), NULL);
+    priv = profiler->priv;
 
-    for (guint i = 0; i < len; i++) {
-        gulong start, end;
+    g_list_foreach (priv->trace_events, (GFunc) g_free, NULL);
+    g_list_free (priv->trace_events);
+    priv->trace_events = NULL;
 
-        row = &g_array_index (priv->event_array, struct EventRow, i);
+    records = ufo_trace_get_records (&n_records);
 
-        UFO_RESOURCES_CHECK_CLERR (clGetEventInfo (row->event, CL_EVENT_COMMAND_QUEUE,
-                                                   sizeof (cl_command_queue), &row->queue,
-                                                   NULL));
+    for (guint i = n_records; i > 0; i--) {
+        UfoTraceEvent *event;
 
-        get_time_stamps (row->event, NULL, NULL, &start, &end);
+        if (records[i - 1].source != profiler)
+            continue;
 
-        if (end < start)
-            elapsed += (gdouble) ((G_MAXULONG - start) + end) * 1e-9;
-        else
-            elapsed += ((gdouble) (end - start)) * 1e-9;
+        event = g_new0 (UfoTraceEvent, 1);
+        event->type = records[i - 1].type;
+        event->thread_id = GUINT_TO_POINTER (records[i - 1].thread);
+        event->timestamp = records[i - 1].timestamp * 1e-9;
+        priv->trace_events = g_list_prepend (priv->trace_events, event);
     }
 
-    return elapsed;
+    g_free (records);
+    return priv->trace_events;
+}
+
+static gdouble
+gpu_elapsed (UfoProfiler *profiler)
+{
+    resolve_events (profiler, TRUE);
+    return profiler->priv->gpu_time;
 }
 
 /**
@@ -282,7 +468,8 @@ gpu_elapsed (UfoProfilerPrivate *priv)
  * @profiler: A #UfoProfiler object.
  * @timer: Which timer to start
  *
- * Get the elapsed time in seconds for @timer.
+ * Get the elapsed time in seconds for @timer. Querying the GPU timer waits
+ * for all recorded OpenCL events to complete.
  *
  * Returns: Elapsed time in seconds.
  */
@@ -293,21 +480,418 @@ ufo_profiler_elapsed (UfoProfiler       *profiler,
     g_return_val_if_fail (UFO_IS_PROFILER (profiler), 0.0);
 
     if (timer == UFO_PROFILER_TIMER_GPU)
-        return gpu_elapsed (profiler->priv);
+        return gpu_elapsed (profiler);
 
     return g_timer_elapsed (profiler->priv->timers[timer], NULL);
 }
 
-static gchar *
-get_kernel_name (cl_kernel kernel)
+/**
+ * ufo_profiler_get_gpu_time:
+ * @profiler: A #UfoProfiler object.
+ *
+ * Get the GPU time of all recorded OpenCL events that have been resolved so
+ * far. Unlike ufo_profiler_elapsed(), this does not wait for outstanding
+ * events and may be called from another thread while the node is running.
+ *
+ * Returns: GPU time in seconds.
+ */
+gdouble
+ufo_profiler_get_gpu_time (UfoProfiler *profiler)
 {
-    gsize size;
-    gchar *s;
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), 0.0);
+    return profiler->priv->gpu_time;
+}
 
-    clGetKernelInfo (kernel, CL_KERNEL_FUNCTION_NAME, 0, NULL, &size);
-    s = g_malloc0(size + 1);
-    clGetKernelInfo (kernel, CL_KERNEL_FUNCTION_NAME, size, s, NULL);
-    return s;
+/**
+ * ufo_profiler_record_latency:
+ * @profiler: A #UfoProfiler object.
+ * @latency: End-to-end latency of a single item in seconds
+ *
+ * Record the time it took a data item to travel from its generator to the node
+ * that @profiler is attached to.
+ */
+void
+ufo_profiler_record_latency (UfoProfiler *profiler,
+                             gdouble latency)
+{
+    UfoProfilerPrivate *priv;
+
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    priv = profiler->priv;
+    priv->n_latencies++;
+    priv->latency_sum += latency;
+    priv->latency_max = MAX (priv->latency_max, latency);
+    ufo_profiler_record_duration (profiler, UFO_PROFILER_HISTOGRAM_LATENCY, latency);
+}
+
+/**
+ * ufo_profiler_get_latency:
+ * @profiler: A #UfoProfiler object.
+ * @n_items: (out) (allow-none): Location for the number of recorded items
+ * @mean: (out) (allow-none): Location for the mean latency in seconds
+ * @max: (out) (allow-none): Location for the maximum latency in seconds
+ *
+ * Get a summary of the latencies recorded with ufo_profiler_record_latency().
+ */
+void
+ufo_profiler_get_latency (UfoProfiler *profiler,
+                          guint *n_items,
+                          gdouble *mean,
+                          gdouble *max)
+{
+    UfoProfilerPrivate *priv;
+
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    priv = profiler->priv;
+
+    if (n_items != NULL)
+        *n_items = priv->n_latencies;
+
+    if (mean != NULL)
+        *mean = priv->n_latencies > 0 ? priv->latency_sum / priv->n_latencies : 0.0;
+
+    if (max != NULL)
+        *max = priv->latency_max;
+}
+
+static guint
+histogram_index (guint64 value)
+{
+    guint exponent;
+
+    if (value < HISTOGRAM_SUB_BUCKETS)
+        return (guint) value;
+
+    /* Split because gulong may only have 32 bits */
+    if (value >> 32)
+        exponent = 32 + g_bit_storage ((gulong) (value >> 32)) - 1;
+    else
+        exponent = g_bit_storage ((gulong) value) - 1;
+
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+           (guint) ((value >> (exponent - HISTOGRAM_SUB_BITS)) & (HISTOGRAM_SUB_BUCKETS - 1));
+}
+
+static guint64
+histogram_value (guint index)
+{
+    guint64 lower;
+    guint shift;
+
+    if (index < HISTOGRAM_SUB_BUCKETS)
+        return index;
+
+    shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+    lower = ((guint64) (HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS)) << shift;
+
+    /* Middle of the bucket */
+    return lower + ((((guint64) 1) << shift) >> 1);
+}
+
+/**
+ * ufo_profiler_record_duration:
+ * @profiler: A #UfoProfiler object.
+ * @histogram: Which distribution to add to
+ * @duration: Duration in seconds
+ *
+ * Add @duration to a distribution. This is cheap enough to be called for
+ * every item, but must not be called concurrently for the same @histogram.
+ */
+void
+ufo_profiler_record_duration (UfoProfiler *profiler,
+                              UfoProfilerHistogram histogram,
+                              gdouble duration)
+{
+    Histogram *h;
+    guint64 value;
+
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    g_return_if_fail (histogram < UFO_PROFILER_HISTOGRAM_LAST);
+
+    h = &profiler->priv->histograms[histogram];
+    value = duration > 0.0 ? (guint64) (duration * 1e9) : 0;
+    h->counts[histogram_index (value)]++;
+    h->n_values++;
+    h->max = MAX (h->max, value);
+}
+
+/**
+ * ufo_profiler_get_num_durations:
+ * @profiler: A #UfoProfiler object.
+ * @histogram: Which distribution to query
+ *
+ * Returns: Number of durations recorded with ufo_profiler_record_duration().
+ */
+guint64
+ufo_profiler_get_num_durations (UfoProfiler *profiler,
+                                UfoProfilerHistogram histogram)
+{
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), 0);
+    g_return_val_if_fail (histogram < UFO_PROFILER_HISTOGRAM_LAST, 0);
+    return profiler->priv->histograms[histogram].n_values;
+}
+
+/**
+ * ufo_profiler_get_percentile:
+ * @profiler: A #UfoProfiler object.
+ * @histogram: Which distribution to query
+ * @percentile: Percentile between 0 and 100
+ *
+ * Get the duration below which @percentile percent of all recorded durations
+ * fall. The result is accurate to within 1/16 of its value, a @percentile of
+ * 100 returns the exact maximum.
+ *
+ * Returns: Duration in seconds or 0.0 if nothing was recorded.
+ */
+gdouble
+ufo_profiler_get_percentile (UfoProfiler *profiler,
+                             UfoProfilerHistogram histogram,
+                             gdouble percentile)
+{
+    Histogram *h;
+    guint64 rank;
+    guint64 seen = 0;
+    gdouble exact_rank;
+
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), 0.0);
+    g_return_val_if_fail (histogram < UFO_PROFILER_HISTOGRAM_LAST, 0.0);
+
+    h = &profiler->priv->histograms[histogram];
+
+    if (h->n_values == 0)
+        return 0.0;
+
+    if (percentile >= 100.0)
+        return h->max * 1e-9;
+
+    /* Nearest rank, i.e. the smallest value covering the percentile */
+    exact_rank = MAX (percentile, 0.0) / 100.0 * h->n_values;
+    rank = (guint64) exact_rank;
+
+    if (rank < exact_rank || rank == 0)
+        rank++;
+
+    for (guint i = 0; i < HISTOGRAM_N_BUCKETS; i++) {
+        seen += h->counts[i];
+
+        if (seen >= rank)
+            return MIN (histogram_value (i), h->max) * 1e-9;
+    }
+
+    return h->max * 1e-9;
+}
+
+/**
+ * ufo_profiler_count_dropped:
+ * @profiler: A #UfoProfiler object.
+ *
+ * Count an item that was dropped on its way to the node that @profiler is
+ * attached to. This function can be called from any thread.
+ */
+void
+ufo_profiler_count_dropped (UfoProfiler *profiler)
+{
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    g_atomic_int_inc (&profiler->priv->n_dropped);
+}
+
+/**
+ * ufo_profiler_get_num_dropped:
+ * @profiler: A #UfoProfiler object.
+ *
+ * Get the number of items counted with ufo_profiler_count_dropped().
+ *
+ * Returns: Number of dropped items.
+ */
+guint
+ufo_profiler_get_num_dropped (UfoProfiler *profiler)
+{
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), 0);
+    return (guint) g_atomic_int_get (&profiler->priv->n_dropped);
+}
+
+/**
+ * ufo_profiler_set_queue_stats:
+ * @profiler: A #UfoProfiler object.
+ * @source: The node that produces items for the node of @profiler
+ * @stats: Statistics of the queue between @source and the node of @profiler
+ *
+ * Store the statistics of an input edge, replacing earlier ones for @source.
+ */
+void
+ufo_profiler_set_queue_stats (UfoProfiler *profiler,
+                              gpointer source,
+                              const UfoTwoWayQueueStats *stats)
+{
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    g_hash_table_insert (profiler->priv->queue_stats, source,
+                         g_memdup (stats, sizeof (UfoTwoWayQueueStats)));
+}
+
+/**
+ * ufo_profiler_get_queue_stats:
+ * @profiler: A #UfoProfiler object.
+ * @source: The node that produces items for the node of @profiler
+ * @stats: (out): Location for the statistics
+ *
+ * Get the statistics stored with ufo_profiler_set_queue_stats().
+ *
+ * Returns: %TRUE if statistics for @source are available.
+ */
+gboolean
+ufo_profiler_get_queue_stats (UfoProfiler *profiler,
+                              gpointer source,
+                              UfoTwoWayQueueStats *stats)
+{
+    UfoTwoWayQueueStats *stored;
+
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), FALSE);
+    stored = g_hash_table_lookup (profiler->priv->queue_stats, source);
+
+    if (stored == NULL)
+        return FALSE;
+
+    *stats = *stored;
+    return TRUE;
+}
+
+/* Must be called with memory_lock held */
+static gsize
+update_memory_counter (GHashTable *counters,
+                       gpointer device,
+                       gssize n_bytes)
+{
+    MemoryCounter *counter;
+
+    counter = g_hash_table_lookup (counters, device);
+
+    if (counter == NULL) {
+        counter = g_new0 (MemoryCounter, 1);
+        g_hash_table_insert (counters, device, counter);
+    }
+
+    if (n_bytes < 0 && (gsize) -n_bytes > counter->current)
+        counter->current = 0;
+    else
+        counter->current += n_bytes;
+
+    counter->peak = MAX (counter->peak, counter->current);
+    return counter->current;
+}
+
+static void
+get_memory_counter (GHashTable *counters,
+                    gpointer device,
+                    gsize *current,
+                    gsize *peak)
+{
+    MemoryCounter *counter;
+
+    g_static_mutex_lock (&memory_lock);
+    counter = counters != NULL ? g_hash_table_lookup (counters, device) : NULL;
+
+    if (current != NULL)
+        *current = counter != NULL ? counter->current : 0;
+
+    if (peak != NULL)
+        *peak = counter != NULL ? counter->peak : 0;
+
+    g_static_mutex_unlock (&memory_lock);
+}
+
+/**
+ * ufo_profiler_record_allocation:
+ * @profiler: (allow-none): A #UfoProfiler object or %NULL
+ * @device: (allow-none): A cl_device_id or %NULL for host memory
+ * @n_bytes: Number of allocated bytes, negative if memory was released
+ *
+ * Account an allocation on @device to the node of @profiler. Allocations
+ * without a @profiler only count towards the totals returned by
+ * ufo_profiler_get_total_memory(). This may be called from any thread.
+ */
+void
+ufo_profiler_record_allocation (UfoProfiler *profiler,
+                                gpointer device,
+                                gssize n_bytes)
+{
+    gsize current = 0;
+
+    g_return_if_fail (profiler == NULL || UFO_IS_PROFILER (profiler));
+
+    g_static_mutex_lock (&memory_lock);
+
+    if (total_memory == NULL)
+        total_memory = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+    update_memory_counter (total_memory, device, n_bytes);
+
+    if (profiler != NULL)
+        current = update_memory_counter (profiler->priv->memory, device, n_bytes);
+
+    g_static_mutex_unlock (&memory_lock);
+
+    if (profiler != NULL && profiler->priv->trace)
+        ufo_trace_write_counter (device, profiler, current);
+}
+
+/**
+ * ufo_profiler_get_memory:
+ * @profiler: A #UfoProfiler object.
+ * @device: (allow-none): A cl_device_id or %NULL for host memory
+ * @current: (out) (allow-none): Location for the currently allocated bytes
+ * @peak: (out) (allow-none): Location for the maximum of allocated bytes
+ *
+ * Get the memory that buffers owned by the node of @profiler allocated on
+ * @device, see ufo_buffer_set_profiler().
+ */
+void
+ufo_profiler_get_memory (UfoProfiler *profiler,
+                         gpointer device,
+                         gsize *current,
+                         gsize *peak)
+{
+    g_return_if_fail (UFO_IS_PROFILER (profiler));
+    get_memory_counter (profiler->priv->memory, device, current, peak);
+}
+
+/**
+ * ufo_profiler_get_memory_devices:
+ * @profiler: A #UfoProfiler object.
+ *
+ * Get the devices on which memory was accounted to @profiler. Host memory is
+ * represented by a %NULL entry.
+ *
+ * Returns: (transfer container) (element-type gpointer): A list of
+ * cl_device_id objects.
+ */
+GList *
+ufo_profiler_get_memory_devices (UfoProfiler *profiler)
+{
+    GList *devices;
+
+    g_return_val_if_fail (UFO_IS_PROFILER (profiler), NULL);
+
+    g_static_mutex_lock (&memory_lock);
+    devices = g_hash_table_get_keys (profiler->priv->memory);
+    g_static_mutex_unlock (&memory_lock);
+
+    return devices;
+}
+
+/**
+ * ufo_profiler_get_total_memory:
+ * @device: (allow-none): A cl_device_id or %NULL for host memory
+ * @current: (out) (allow-none): Location for the currently allocated bytes
+ * @peak: (out) (allow-none): Location for the maximum of allocated bytes
+ *
+ * Get the memory that all buffers allocated on @device.
+ */
+void
+ufo_profiler_get_total_memory (gpointer device,
+                               gsize *current,
+                               gsize *peak)
+{
+    get_memory_counter (total_memory, device, current, peak);
 }
 
 /**
@@ -316,7 +900,9 @@ get_kernel_name (cl_kernel kernel)
  * @func: (scope call): The function to be called for an entry
  * @user_data: User parameters
  *
- * Iterates through the recorded events and calls @func for each entry.
+ * Iterates through the recorded events and calls @func for each entry. This
+ * waits for all recorded events to complete. Events that were already written
+ * to a trace file are not visited.
  */
 void
 ufo_profiler_foreach (UfoProfiler    *profiler,
@@ -324,38 +910,32 @@ ufo_profiler_foreach (UfoProfiler    *profiler,
                       gpointer        user_data)
 {
     UfoProfilerPrivate *priv;
-    GHashTable *names;
-    struct EventRow *row;
 
     g_return_if_fail (UFO_IS_PROFILER (profiler));
 
     priv = profiler->priv;
-    names = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
-
-    for (guint i = 0; i < priv->event_array->len; i++) {
-        cl_command_queue queue;
-        gchar *name;
-        gulong queued, submitted, start, end;
-
-        row = &g_array_index (priv->event_array, struct EventRow, i);
-        name = g_hash_table_lookup (names, row->kernel);
+    resolve_events (profiler, TRUE);
 
-        if (name == NULL) {
-            name = get_kernel_name (row->kernel);
-            g_hash_table_insert (names, row->kernel, name);
-        }
+    for (guint i = 0; i < priv->resolved_array->len; i++) {
+        struct ResolvedRow *row;
 
-        clGetEventInfo (row->event, CL_EVENT_COMMAND_QUEUE, sizeof (cl_command_queue), &queue, NULL);
-        get_time_stamps (row->event, &queued, &submitted, &start, &end);
-        func (name, queue, queued, submitted, start, end, user_data);
+        row = &g_array_index (priv->resolved_array, struct ResolvedRow, i);
+        func (row->name, row->queue, row->queued, row->submitted, row->start, row->end, user_data);
     }
-
-    g_hash_table_destroy (names);
 }
 
 static void
 ufo_profiler_dispose (GObject *object)
 {
+    UfoProfilerPrivate *priv;
+
+    priv = UFO_PROFILER_GET_PRIVATE (object);
+
+    if (priv->resources != NULL) {
+        g_object_unref (priv->resources);
+        priv->resources = NULL;
+    }
+
     G_OBJECT_CLASS (ufo_profiler_parent_class)->dispose (object);
 }
 
@@ -374,6 +954,11 @@ ufo_profiler_finalize (GObject *object)
     }
 
     g_array_free (priv->event_array, TRUE);
+    g_array_free (priv->resolved_array, TRUE);
+    g_hash_table_destroy (priv->kernel_names);
+    g_hash_table_destroy (priv->queue_stats);
+    g_hash_table_destroy (priv->memory);
+    g_free (priv->histograms);
 
     g_list_foreach (priv->trace_events, (GFunc) g_free, NULL);
     g_list_free (priv->trace_events);
@@ -392,9 +977,6 @@ ufo_profiler_class_init (UfoProfilerClass *klass)
     gobject_class->finalize = ufo_profiler_finalize;
 
     g_type_class_add_private (klass, sizeof (UfoProfilerPrivate));
-
-    if (global_clock == NULL)
-        global_clock = g_timer_new ();
 }
 
 static void
@@ -403,9 +985,20 @@ ufo_profiler_init (UfoProfiler *manager)
     UfoProfilerPrivate *priv;
 
     manager->priv = priv = UFO_PROFILER_GET_PRIVATE (manager);
-    priv->event_array = g_array_sized_new (FALSE, TRUE, sizeof(struct EventRow), 2048);
+    priv->resources = NULL;
+    priv->event_array = g_array_sized_new (FALSE, TRUE, sizeof(struct EventRow), RESOLVE_THRESHOLD);
+    priv->resolved_array = g_array_new (FALSE, TRUE, sizeof(struct ResolvedRow));
+    priv->kernel_names = g_hash_table_new (g_direct_hash, g_direct_equal);
+    priv->gpu_time = 0.0;
     priv->trace_events = NULL;
     priv->trace = FALSE;
+    priv->n_latencies = 0;
+    priv->latency_sum = 0.0;
+    priv->latency_max = 0.0;
+    priv->n_dropped = 0;
+    priv->queue_stats = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    priv->memory = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+    priv->histograms = g_new0 (Histogram, UFO_PROFILER_HISTOGRAM_LAST);
 
     /* Setup timers for all events */
     priv->timers = g_new0 (GTimer *, UFO_PROFILER_TIMER_LAST);
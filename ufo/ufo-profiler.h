@@ -25,6 +25,8 @@
 #endif
 
 #include <glib-object.h>
+#include <ufo/ufo-resources.h>
+#include <ufo/ufo-two-way-queue.h>
 
 G_BEGIN_DECLS
 
@@ -102,7 +104,9 @@ typedef enum {
 /**
  * UfoTraceEvent:
  * @type: Type of the event
- * @thread_id: ID of thread in which the event was issued
+ * @thread_id: Opaque ID of the thread in which the event was issued. IDs are
+ *  not reused while a thread runs but may be given to a later thread after it
+ *  has exited.
  * @timestamp: Arbitrary timestamp of the event
  */
 typedef struct {
@@ -120,6 +124,24 @@ typedef enum {
     UFO_PROFILER_TIMER_LAST
 } UfoProfilerTimer;
 
+/**
+ * UfoProfilerHistogram:
+ * @UFO_PROFILER_HISTOGRAM_PROCESS: Wall time of process calls
+ * @UFO_PROFILER_HISTOGRAM_GENERATE: Wall time of generate calls
+ * @UFO_PROFILER_HISTOGRAM_LATENCY: End-to-end latency of items that arrive
+ *  at the node, see ufo_profiler_record_latency()
+ * @UFO_PROFILER_HISTOGRAM_LAST: Auxiliary value, do not use.
+ *
+ * Use these values to select a duration distribution when calling
+ * ufo_profiler_record_duration() and ufo_profiler_get_percentile().
+ */
+typedef enum {
+    UFO_PROFILER_HISTOGRAM_PROCESS = 0,
+    UFO_PROFILER_HISTOGRAM_GENERATE,
+    UFO_PROFILER_HISTOGRAM_LATENCY,
+    UFO_PROFILER_HISTOGRAM_LAST
+} UfoProfilerHistogram;
+
 UfoProfiler *ufo_profiler_new           (void);
 void         ufo_profiler_call          (UfoProfiler        *profiler,
                                          gpointer            command_queue,
@@ -127,6 +149,8 @@ void         ufo_profiler_call          (UfoProfiler        *profiler,
                                          guint               work_dim,
                                          const gsize        *global_work_size,
                                          const gsize        *local_work_size);
+void         ufo_profiler_set_resources (UfoProfiler        *profiler,
+                                         UfoResources       *resources);
 void         ufo_profiler_register_event
                                         (UfoProfiler *profiler,
                                          gpointer command_queue,
@@ -148,6 +172,50 @@ GList       *ufo_profiler_get_trace_events
                                         (UfoProfiler        *profiler);
 gdouble      ufo_profiler_elapsed       (UfoProfiler        *profiler,
                                          UfoProfilerTimer    timer);
+gdouble      ufo_profiler_get_gpu_time  (UfoProfiler        *profiler);
+void         ufo_profiler_record_latency
+                                        (UfoProfiler        *profiler,
+                                         gdouble             latency);
+void         ufo_profiler_get_latency   (UfoProfiler        *profiler,
+                                         guint              *n_items,
+                                         gdouble            *mean,
+                                         gdouble            *max);
+void         ufo_profiler_record_duration
+                                        (UfoProfiler        *profiler,
+                                         UfoProfilerHistogram histogram,
+                                         gdouble             duration);
+guint64      ufo_profiler_get_num_durations
+                                        (UfoProfiler        *profiler,
+                                         UfoProfilerHistogram histogram);
+gdouble      ufo_profiler_get_percentile
+                                        (UfoProfiler        *profiler,
+                                         UfoProfilerHistogram histogram,
+                                         gdouble             percentile);
+void         ufo_profiler_count_dropped (UfoProfiler        *profiler);
+guint        ufo_profiler_get_num_dropped
+                                        (UfoProfiler        *profiler);
+void         ufo_profiler_set_queue_stats
+                                        (UfoProfiler        *profiler,
+                                         gpointer            source,
+                                         const UfoTwoWayQueueStats *stats);
+gboolean     ufo_profiler_get_queue_stats
+                                        (UfoProfiler        *profiler,
+                                         gpointer            source,
+                                         UfoTwoWayQueueStats *stats);
+void         ufo_profiler_record_allocation
+                                        (UfoProfiler        *profiler,
+                                         gpointer            device,
+                                         gssize              n_bytes);
+void         ufo_profiler_get_memory    (UfoProfiler        *profiler,
+                                         gpointer            device,
+                                         gsize              *current,
+                                         gsize              *peak);
+GList       *ufo_profiler_get_memory_devices
+                                        (UfoProfiler        *profiler);
+void         ufo_profiler_get_total_memory
+                                        (gpointer            device,
+                                         gsize              *current,
+                                         gsize              *peak);
 GType        ufo_profiler_get_type      (void);
 
 G_END_DECLS
@@ -21,7 +21,9 @@
 
 #include <glib.h>
 #include <gio/gio.h>
+#include <glib/gstdio.h>
 #include <stdio.h>
+#include <string.h>
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
 #else
@@ -42,6 +44,21 @@
  * The #UfoResources creates the OpenCL environment and loads OpenCL kernels
  * from text files. Users should in general not create a resources object
  * themselves but use one that is created automatically by #UfoArchGraph.
+ *
+ * The OpenCL platform, context and command queues are set up on first use,
+ * i.e. when a kernel is requested or the context, devices or GPU nodes are
+ * queried. Pipelines that consist only of CPU tasks never initialize OpenCL.
+ *
+ * Built programs are cached on disk in the ufo/programs sub-directory of
+ * g_get_user_cache_dir(), i.e. <filename>$XDG_CACHE_HOME/ufo/programs</filename>.
+ * Entries are keyed by the source, included files, build options, platform,
+ * devices and driver versions. Set the <envar>UFO_DISABLE_PROGRAM_CACHE</envar>
+ * environment variable to always build from source.
+ *
+ * Kernels launched with ufo_resources_enqueue_kernel() get their local work
+ * size tuned per device and global size. The results are stored in
+ * <filename>$XDG_CACHE_HOME/ufo/tuning.ini</filename>. Set
+ * <envar>UFO_DISABLE_TUNING</envar> to let the driver decide.
  */
 
 static void ufo_resources_initable_iface_init (GInitableIface *iface);
@@ -61,6 +78,8 @@ G_DEFINE_TYPE_WITH_CODE (UfoResources, ufo_resources, G_TYPE_OBJECT,
  * @UFO_RESOURCES_ERROR_BUILD_PROGRAM: Could not build program from
  *      sources
  * @UFO_RESOURCES_ERROR_CREATE_KERNEL: Could not create kernel
+ * @UFO_RESOURCES_ERROR_DEVICE_SELECTION: Invalid device selection or
+ *      partitioning
  *
  * OpenCL related errors.
  */
@@ -80,11 +99,25 @@ struct _UfoResourcesPrivate {
     cl_context       context;
     cl_uint          n_devices;         /* Number of OpenCL devices per platform id */
     cl_device_id     *devices;          /* Array of OpenCL devices per platform id */
+    gchar           *device_selection;  /* e.g. "0,2-3", NULL means all devices */
+    gchar           *device_partition;  /* "numa", "equal:N" or NULL */
+    gboolean         sub_devices;       /* TRUE if devices must be released */
 
     GList       *gpu_nodes;
 
     GList       *paths;         /* List of paths containing kernels and header files */
     GHashTable  *kernel_cache;
+    GHashTable  *program_cache; /* Programs by source and build options */
+    GHashTable  *program_keys;  /* cl_program to its key in program_cache */
+    GHashTable  *tuning;        /* Work-group size tuning state by launch key */
+    GKeyFile    *tuning_db;     /* Persisted tuning results, loaded on demand */
+    GMutex      *tuning_db_lock;/* Orders writes of the tuning database */
+    GHashTable  *tuned;         /* Finished tuning entries by LaunchKey */
+    GStaticRWLock tuned_lock;   /* Protects tuned, so launches do not take lock */
+    GMutex      *lock;
+    gint         initialized;   /* OpenCL is set up on first use */
+    gint         init_reported; /* Initialization error was warned about */
+    GCond       *program_built;
     GList       *programs;
     GList       *kernels;
     GString     *build_opts;
@@ -97,6 +130,8 @@ enum {
     PROP_0,
     PROP_PLATFORM_INDEX,
     PROP_DEVICE_TYPE,
+    PROP_DEVICE_SELECTION,
+    PROP_DEVICE_PARTITION,
     PROP_REMOTES,
     N_PROPERTIES
 };
@@ -357,7 +392,6 @@ restrict_to_gpu_subset (UfoResourcesPrivate *priv)
         return;
     }
 
-    // TODO allow restriction to real subset, like 1,3,5 etc.
     cl_device_id *devices_subset = g_malloc0 (1 * sizeof (cl_device_id));
     devices_subset[0] = priv->devices[device_index - 1];
     g_free (priv->devices);
@@ -365,6 +399,173 @@ restrict_to_gpu_subset (UfoResourcesPrivate *priv)
     priv->n_devices = 1;
 }
 
+static gboolean
+parse_device_range (const gchar *item,
+                    guint *first,
+                    guint *last)
+{
+    gchar *end;
+
+    *first = (guint) g_ascii_strtoull (item, &end, 10);
+
+    if (end == item)
+        return FALSE;
+
+    if (*end == '\0') {
+        *last = *first;
+        return TRUE;
+    }
+
+    if (*end != '-')
+        return FALSE;
+
+    item = end + 1;
+    *last = (guint) g_ascii_strtoull (item, &end, 10);
+
+    return end != item && *end == '\0' && *first <= *last;
+}
+
+static gboolean
+select_devices (UfoResourcesPrivate *priv)
+{
+    gchar **items;
+    cl_device_id *selected;
+    guint n_selected = 0;
+    gboolean success = TRUE;
+
+    /*
+     * The selection is a comma-separated list of device indices and inclusive
+     * ranges, e.g. "0,2-3". Devices are numbered in the order reported by the
+     * platform and duplicates are ignored.
+     */
+    if (priv->device_selection == NULL || *priv->device_selection == '\0')
+        return TRUE;
+
+    items = g_strsplit (priv->device_selection, ",", -1);
+    selected = g_new0 (cl_device_id, priv->n_devices);
+
+    for (gchar **item = items; *item != NULL && success; item++) {
+        guint first;
+        guint last;
+
+        g_strstrip (*item);
+
+        if (!parse_device_range (*item, &first, &last) || last >= priv->n_devices) {
+            g_set_error (&priv->construct_error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_DEVICE_SELECTION,
+                         "Invalid device selection `%s', platform has %i device(s)",
+                         priv->device_selection, priv->n_devices);
+            success = FALSE;
+            break;
+        }
+
+        for (guint i = first; i <= last; i++) {
+            gboolean duplicate = FALSE;
+
+            for (guint j = 0; j < n_selected; j++)
+                duplicate = duplicate || selected[j] == priv->devices[i];
+
+            if (!duplicate)
+                selected[n_selected++] = priv->devices[i];
+        }
+    }
+
+    g_strfreev (items);
+
+    if (!success) {
+        g_free (selected);
+        return FALSE;
+    }
+
+    g_free (priv->devices);
+    priv->devices = selected;
+    priv->n_devices = n_selected;
+    return TRUE;
+}
+
+static gboolean
+partition_devices (UfoResourcesPrivate *priv)
+{
+#ifdef CL_VERSION_1_2
+    cl_device_partition_property props[3];
+    GArray *partitioned;
+    cl_uint n_sub_devices;
+    cl_int errcode;
+
+    if (priv->device_partition == NULL || *priv->device_partition == '\0' ||
+        !g_strcmp0 (priv->device_partition, "none"))
+        return TRUE;
+
+    if (!g_strcmp0 (priv->device_partition, "numa")) {
+        props[0] = CL_DEVICE_PARTITION_BY_AFFINITY_DOMAIN;
+        props[1] = CL_DEVICE_AFFINITY_DOMAIN_NUMA;
+        props[2] = 0;
+    }
+    else if (g_str_has_prefix (priv->device_partition, "equal:")) {
+        const gchar *units;
+        gchar *end;
+
+        units = priv->device_partition + strlen ("equal:");
+        props[0] = CL_DEVICE_PARTITION_EQUALLY;
+        props[1] = (cl_device_partition_property) g_ascii_strtoull (units, &end, 10);
+        props[2] = 0;
+
+        if (end == units || *end != '\0' || props[1] == 0) {
+            g_set_error (&priv->construct_error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_DEVICE_SELECTION,
+                         "Invalid number of compute units in `%s'", priv->device_partition);
+            return FALSE;
+        }
+    }
+    else {
+        g_set_error (&priv->construct_error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_DEVICE_SELECTION,
+                     "Unknown device partition `%s', use `numa' or `equal:N'", priv->device_partition);
+        return FALSE;
+    }
+
+    partitioned = g_array_new (FALSE, FALSE, sizeof (cl_device_id));
+
+    for (guint i = 0; i < priv->n_devices; i++) {
+        cl_device_id *sub_devices;
+
+        errcode = clCreateSubDevices (priv->devices[i], props, 0, NULL, &n_sub_devices);
+
+        /* Devices that cannot be split in the requested way are used as a whole */
+        if (errcode != CL_SUCCESS || n_sub_devices == 0) {
+            g_debug ("Could not partition device %i: %s", i, ufo_resources_clerr (errcode));
+            g_array_append_val (partitioned, priv->devices[i]);
+            continue;
+        }
+
+        sub_devices = g_new0 (cl_device_id, n_sub_devices);
+        errcode = clCreateSubDevices (priv->devices[i], props, n_sub_devices, sub_devices, NULL);
+        UFO_RESOURCES_CHECK_CLERR (errcode);
+
+        if (errcode == CL_SUCCESS) {
+            g_debug ("Partitioned device %i into %i sub-device(s)", i, n_sub_devices);
+            g_array_append_vals (partitioned, sub_devices, n_sub_devices);
+        }
+        else {
+            g_array_append_val (partitioned, priv->devices[i]);
+        }
+
+        g_free (sub_devices);
+    }
+
+    g_free (priv->devices);
+    priv->n_devices = partitioned->len;
+    priv->devices = (cl_device_id *) g_array_free (partitioned, FALSE);
+    priv->sub_devices = TRUE;
+    return TRUE;
+#else
+    if (priv->device_partition == NULL || *priv->device_partition == '\0' ||
+        !g_strcmp0 (priv->device_partition, "none"))
+        return TRUE;
+
+    g_set_error_literal (&priv->construct_error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_DEVICE_SELECTION,
+                         "Device partitioning requires OpenCL 1.2");
+    return FALSE;
+#endif
+}
+
 static gboolean
 initialize_opencl (UfoResourcesPrivate *priv)
 {
@@ -396,6 +597,10 @@ initialize_opencl (UfoResourcesPrivate *priv)
         return FALSE;
 
     restrict_to_gpu_subset (priv);
+
+    if (!select_devices (priv) || !partition_devices (priv))
+        return FALSE;
+
     g_debug ("Using %i device(s):", priv->n_devices);
 
     for (guint i = 0; i < priv->n_devices; i++) {
@@ -425,6 +630,46 @@ initialize_opencl (UfoResourcesPrivate *priv)
     return TRUE;
 }
 
+static gboolean
+ensure_opencl (UfoResourcesPrivate *priv,
+               GError **error)
+{
+    if (!g_atomic_int_get (&priv->initialized)) {
+        g_mutex_lock (priv->lock);
+
+        if (!priv->initialized) {
+            initialize_opencl (priv);
+            g_atomic_int_set (&priv->initialized, TRUE);
+        }
+
+        g_mutex_unlock (priv->lock);
+    }
+
+    if (priv->construct_error != NULL) {
+        if (error != NULL)
+            g_propagate_error (error, g_error_copy (priv->construct_error));
+        else if (g_atomic_int_compare_and_exchange (&priv->init_reported, FALSE, TRUE))
+            g_warning ("Could not initialize OpenCL: %s", priv->construct_error->message);
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* Device options are only read when OpenCL is initialized */
+static gboolean
+warn_if_initialized (UfoResourcesPrivate *priv,
+                     GParamSpec *pspec)
+{
+    if (g_atomic_int_get (&priv->initialized)) {
+        g_warning ("Setting `%s' after OpenCL was initialized has no effect", pspec->name);
+        return TRUE;
+    }
+
+    return FALSE;
+}
+
 /**
  * ufo_resources_new:
  * @error: Location of a #GError or %NULL
@@ -527,177 +772,537 @@ handle_build_error (cl_program program,
     g_free (log);
 }
 
-static cl_program
-add_program_from_source (UfoResourcesPrivate *priv,
-                         const gchar *source,
-                         const gchar *options,
-                         GError **error)
-{
-    cl_program program;
-    cl_int errcode = CL_SUCCESS;
-    gchar *build_options;
+typedef struct {
+    cl_program   program;
+    GError      *error;
+    gboolean     ready;
+    guint        n_waiting;     /* Threads waiting for the build */
+} ProgramEntry;
 
-    program = clCreateProgramWithSource (priv->context,
-                                         1, &source, NULL, &errcode);
+static void
+free_program_entry (ProgramEntry *entry)
+{
+    if (entry->error != NULL)
+        g_error_free (entry->error);
 
-    if (errcode != CL_SUCCESS) {
-        g_set_error (error,
-                     UFO_RESOURCES_ERROR,
-                     UFO_RESOURCES_ERROR_CREATE_PROGRAM,
-                     "Failed to create OpenCL program: %s", ufo_resources_clerr (errcode));
-        return NULL;
-    }
+    g_free (entry);
+}
 
-    build_options = get_device_build_options (priv, 0, options);
+static gchar *
+get_device_string (cl_device_id device,
+                   cl_device_info param)
+{
+    gsize size;
+    gchar *str;
 
-    errcode = clBuildProgram (program,
-                              priv->n_devices, priv->devices,
-                              build_options,
-                              NULL, NULL);
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, param, 0, NULL, &size));
+    str = g_malloc0 (size + 1);
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, param, size, str, NULL));
+    return str;
+}
 
-    if (errcode != CL_SUCCESS) {
-        handle_build_error (program, priv->devices[0], errcode, error);
-        return NULL;
-    }
+static gchar *
+get_platform_string (cl_platform_id platform,
+                     cl_platform_info param)
+{
+    gsize size;
+    gchar *str;
 
-    priv->programs = g_list_append (priv->programs, program);
+    UFO_RESOURCES_CHECK_CLERR (clGetPlatformInfo (platform, param, 0, NULL, &size));
+    str = g_malloc0 (size + 1);
+    UFO_RESOURCES_CHECK_CLERR (clGetPlatformInfo (platform, param, size, str, NULL));
+    return str;
+}
 
-    g_free (build_options);
-    return program;
+static void
+checksum_update_string (GChecksum *checksum,
+                        gchar *str)
+{
+    /* Hash the terminating zero as well to separate consecutive strings */
+    g_checksum_update (checksum, (const guchar *) str, strlen (str) + 1);
+    g_free (str);
 }
 
-static gchar *
-get_first_kernel_name (const gchar *source)
+static void
+checksum_update_includes (UfoResourcesPrivate *priv,
+                          GChecksum *checksum,
+                          const gchar *source,
+                          guint depth)
 {
     GRegex *regex;
-    gchar *name = NULL;
-    GMatchInfo *match = NULL;
-    GError *error = NULL;
+    GMatchInfo *match;
 
-    regex = g_regex_new ("__kernel\\svoid\\s([A-Za-z][A-Za-z0-9_]+)",
-                         G_REGEX_MULTILINE, 0, &error);
+    /* Guard against recursive includes */
+    if (depth > 8)
+        return;
 
-    if (error != NULL) {
-        g_error ("%s", error->message);
-        g_error_free (error);
-        return NULL;
-    }
+    regex = g_regex_new ("^\\s*#\\s*include\\s*[<\"]([^>\"]+)[>\"]", G_REGEX_MULTILINE, 0, NULL);
+    g_regex_match (regex, source, 0, &match);
+
+    while (g_match_info_matches (match)) {
+        gchar *name;
+        gchar *path;
 
-    if (g_regex_match (regex, source, 0, &match))
         name = g_match_info_fetch (match, 1);
+        path = lookup_kernel_path (priv, name);
+
+        if (path != NULL) {
+            gchar *contents;
+
+            contents = read_file (path);
+
+            if (contents != NULL) {
+                g_checksum_update (checksum, (const guchar *) contents, strlen (contents));
+                checksum_update_includes (priv, checksum, contents, depth + 1);
+                g_free (contents);
+            }
+
+            g_free (path);
+        }
+
+        g_free (name);
+        g_match_info_next (match, NULL);
+    }
 
     g_match_info_free (match);
     g_regex_unref (regex);
-    return name;
 }
 
-static cl_kernel
-create_kernel (UfoResourcesPrivate *priv,
-               cl_program program,
-               const gchar *kernel_name,
-               GError **error)
+static gchar *
+get_program_cache_path (UfoResourcesPrivate *priv,
+                        const gchar *source,
+                        const gchar *build_options)
 {
-    cl_kernel kernel;
-    gchar *name;
-    cl_int errcode = CL_SUCCESS;
-
-    if (kernel_name == NULL) {
-        gchar *source;
-        gsize size;
+    GChecksum *checksum;
+    gchar *filename;
+    gchar *path;
 
-        UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_SOURCE, 0, NULL, &size));
-        source = g_malloc0 (size);
-        UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_SOURCE, size, source, NULL));
-        name = get_first_kernel_name (source);
-        g_free (source);
-    }
-    else {
-        name = g_strdup (kernel_name);
-    }
+    if (g_getenv ("UFO_DISABLE_PROGRAM_CACHE") != NULL)
+        return NULL;
 
-    kernel = clCreateKernel (program, name, &errcode);
-    g_free (name);
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    g_checksum_update (checksum, (const guchar *) source, strlen (source) + 1);
+    g_checksum_update (checksum, (const guchar *) build_options, strlen (build_options) + 1);
+    checksum_update_includes (priv, checksum, source, 0);
+    checksum_update_string (checksum, get_platform_string (priv->platform, CL_PLATFORM_NAME));
+    checksum_update_string (checksum, get_platform_string (priv->platform, CL_PLATFORM_VERSION));
 
-    if (kernel == NULL || errcode != CL_SUCCESS) {
-        g_set_error (error,
-                     UFO_RESOURCES_ERROR,
-                     UFO_RESOURCES_ERROR_CREATE_KERNEL,
-                     "Failed to create kernel `%s`: %s", kernel_name, ufo_resources_clerr (errcode));
-        return NULL;
+    for (guint i = 0; i < priv->n_devices; i++) {
+        checksum_update_string (checksum, get_device_string (priv->devices[i], CL_DEVICE_NAME));
+        checksum_update_string (checksum, get_device_string (priv->devices[i], CL_DEVICE_VERSION));
+        checksum_update_string (checksum, get_device_string (priv->devices[i], CL_DRIVER_VERSION));
     }
 
-    priv->kernels = g_list_append (priv->kernels, kernel);
-    return kernel;
-}
+    filename = g_strdup_printf ("%s.bin", g_checksum_get_string (checksum));
+    path = g_build_filename (g_get_user_cache_dir (), "ufo", "programs", filename, NULL);
 
-static gchar *
-create_cache_key (const gchar *filename,
-                  const gchar *kernelname)
-{
-    return g_strdup_printf ("%s:%s", filename, kernelname);
+    g_checksum_free (checksum);
+    g_free (filename);
+    return path;
 }
 
-/**
- * ufo_resources_get_kernel_with_opts:
- * @resources: A #UfoResources object
- * @filename: Name of the .cl kernel file
- * @kernel: Name of a kernel, or %NULL
- * @options: Options passed to the OpenCL compiler
- * @error: Return location for a GError from #UfoResourcesError, or %NULL
- *
- * Loads a and builds a kernel from a file. The file is searched in the current
- * working directory and all paths added through ufo_resources_add_paths (). If
- * @kernel is %NULL, the first encountered kernel is returned.
- *
- * Returns: (transfer none): a cl_kernel object that is load from @filename or %NULL on error
- */
-gpointer
-ufo_resources_get_kernel_with_opts (UfoResources   *resources,
-                                    const gchar    *filename,
-                                    const gchar    *kernel,
-                                    const gchar    *options,
-                                    GError        **error)
+static cl_program
+load_cached_program (UfoResourcesPrivate *priv,
+                     const gchar *cache_path,
+                     const gchar *build_options)
 {
-    UfoResourcesPrivate *priv;
-    gchar *path;
-    gchar *buffer;
     cl_program program;
+    cl_int errcode;
+    gchar *contents;
+    gsize length;
+    gsize offset = 0;
+    gsize *sizes;
+    const guchar **binaries;
+
+    if (!g_file_get_contents (cache_path, &contents, &length, NULL))
+        return NULL;
 
-    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
-                          (filename != NULL), NULL);
+    /* The cache file contains a size and binary blob for each device */
+    sizes = g_new0 (gsize, priv->n_devices);
+    binaries = g_new0 (const guchar *, priv->n_devices);
+    program = NULL;
 
-    priv = resources->priv;
-    path = lookup_kernel_path (priv, filename);
+    for (guint i = 0; i < priv->n_devices; i++) {
+        guint64 size;
 
-    if (path == NULL) {
-        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
-                     "Could not find `%s'. Use add_paths() to add additional kernel paths", filename);
-        return NULL;
+        if (offset + sizeof (guint64) > length)
+            goto load_cached_program_free;
+
+        memcpy (&size, contents + offset, sizeof (guint64));
+        offset += sizeof (guint64);
+
+        if (offset + size > length)
+            goto load_cached_program_free;
+
+        sizes[i] = (gsize) size;
+        binaries[i] = (const guchar *) contents + offset;
+        offset += size;
     }
 
-    buffer = read_file (path);
-    g_free (path);
+    program = clCreateProgramWithBinary (priv->context, priv->n_devices, priv->devices,
+                                         sizes, binaries, NULL, &errcode);
 
-    if (buffer == NULL) {
-        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
-                     "Could not open `%s'", filename);
-        return NULL;
+    if (errcode != CL_SUCCESS) {
+        program = NULL;
+        goto load_cached_program_free;
     }
 
-    program = add_program_from_source (priv, buffer, options, error);
+    errcode = clBuildProgram (program, priv->n_devices, priv->devices, build_options, NULL, NULL);
 
-    if (program == NULL)
-        return NULL;
+    if (errcode != CL_SUCCESS) {
+        UFO_RESOURCES_CHECK_CLERR (clReleaseProgram (program));
+        program = NULL;
+    }
 
-    g_debug ("Added program %p from `%s`", (gpointer) program, filename);
-    g_free (buffer);
+load_cached_program_free:
+    if (program == NULL)
+        g_debug ("Ignoring invalid program cache `%s'", cache_path);
 
-    return create_kernel (priv, program, kernel, error);
+    g_free (binaries);
+    g_free (sizes);
+    g_free (contents);
+    return program;
 }
 
-/**
- * ufo_resources_get_kernel:
- * @resources: A #UfoResources object
+static void
+store_cached_program (UfoResourcesPrivate *priv,
+                      cl_program program,
+                      const gchar *cache_path)
+{
+    GByteArray *contents;
+    gsize *sizes;
+    guchar **binaries;
+    gchar *dirname;
+    GError *error = NULL;
+
+    sizes = g_new0 (gsize, priv->n_devices);
+    binaries = g_new0 (guchar *, priv->n_devices);
+
+    UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_BINARY_SIZES,
+                                                 priv->n_devices * sizeof (gsize), sizes, NULL));
+
+    for (guint i = 0; i < priv->n_devices; i++)
+        binaries[i] = g_malloc0 (sizes[i]);
+
+    UFO_RESOURCES_CHECK_CLERR (clGetProgramInfo (program, CL_PROGRAM_BINARIES,
+                                                 priv->n_devices * sizeof (guchar *), binaries, NULL));
+
+    contents = g_byte_array_new ();
+
+    for (guint i = 0; i < priv->n_devices; i++) {
+        guint64 size = sizes[i];
+
+        g_byte_array_append (contents, (const guint8 *) &size, sizeof (guint64));
+        g_byte_array_append (contents, binaries[i], sizes[i]);
+        g_free (binaries[i]);
+    }
+
+    dirname = g_path_get_dirname (cache_path);
+
+    if (g_mkdir_with_parents (dirname, 0755) == 0) {
+        if (!g_file_set_contents (cache_path, (const gchar *) contents->data, contents->len, &error)) {
+            g_debug ("Could not write program cache: %s", error->message);
+            g_error_free (error);
+        }
+    }
+
+    g_free (dirname);
+    g_byte_array_free (contents, TRUE);
+    g_free (binaries);
+    g_free (sizes);
+}
+
+static cl_program
+build_program (UfoResourcesPrivate *priv,
+               const gchar *source,
+               const gchar *build_options,
+               GError **error)
+{
+    cl_program program;
+    cl_int errcode = CL_SUCCESS;
+    gchar *cache_path;
+
+    cache_path = get_program_cache_path (priv, source, build_options);
+    program = NULL;
+
+    if (cache_path != NULL) {
+        program = load_cached_program (priv, cache_path, build_options);
+
+        if (program != NULL) {
+            g_debug ("Loaded program %p from `%s'", (gpointer) program, cache_path);
+            goto build_program_free;
+        }
+    }
+
+    program = clCreateProgramWithSource (priv->context,
+                                         1, &source, NULL, &errcode);
+
+    if (errcode != CL_SUCCESS) {
+        g_set_error (error,
+                     UFO_RESOURCES_ERROR,
+                     UFO_RESOURCES_ERROR_CREATE_PROGRAM,
+                     "Failed to create OpenCL program: %s", ufo_resources_clerr (errcode));
+        program = NULL;
+        goto build_program_free;
+    }
+
+    errcode = clBuildProgram (program,
+                              priv->n_devices, priv->devices,
+                              build_options,
+                              NULL, NULL);
+
+    if (errcode != CL_SUCCESS) {
+        handle_build_error (program, priv->devices[0], errcode, error);
+        UFO_RESOURCES_CHECK_CLERR (clReleaseProgram (program));
+        program = NULL;
+        goto build_program_free;
+    }
+
+    if (cache_path != NULL)
+        store_cached_program (priv, program, cache_path);
+
+build_program_free:
+    g_free (cache_path);
+    return program;
+}
+
+static gchar *
+get_program_key (const gchar *source,
+                 const gchar *build_options)
+{
+    GChecksum *checksum;
+    gchar *key;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    g_checksum_update (checksum, (const guchar *) source, strlen (source) + 1);
+    g_checksum_update (checksum, (const guchar *) build_options, strlen (build_options) + 1);
+    key = g_strdup (g_checksum_get_string (checksum));
+    g_checksum_free (checksum);
+    return key;
+}
+
+static cl_program
+add_program_from_source (UfoResourcesPrivate *priv,
+                         const gchar *source,
+                         const gchar *options,
+                         GError **error)
+{
+    ProgramEntry *entry;
+    cl_program program;
+    gchar *build_options;
+    gchar *key;
+    GError *tmp_error = NULL;
+
+    if (!ensure_opencl (priv, error))
+        return NULL;
+
+    build_options = get_device_build_options (priv, 0, options);
+    key = get_program_key (source, build_options);
+
+    /*
+     * Identical programs are only built once, even if they are requested by
+     * several threads at the same time. The first thread builds the program
+     * outside the lock while all others wait for it to finish.
+     */
+    g_mutex_lock (priv->lock);
+
+    entry = g_hash_table_lookup (priv->program_cache, key);
+
+    if (entry != NULL) {
+        entry->n_waiting++;
+
+        while (!entry->ready)
+            g_cond_wait (priv->program_built, priv->lock);
+
+        entry->n_waiting--;
+
+        if (entry->error != NULL)
+            g_propagate_error (error, g_error_copy (entry->error));
+
+        program = entry->program;
+
+        /* Failed entries were removed from the cache, the last waiter frees them */
+        if (program == NULL && entry->n_waiting == 0)
+            free_program_entry (entry);
+
+        g_mutex_unlock (priv->lock);
+
+        g_free (key);
+        g_free (build_options);
+        return program;
+    }
+
+    entry = g_new0 (ProgramEntry, 1);
+    g_hash_table_insert (priv->program_cache, key, entry);
+
+    g_mutex_unlock (priv->lock);
+
+    program = build_program (priv, source, build_options, &tmp_error);
+
+    g_mutex_lock (priv->lock);
+
+    entry->program = program;
+    entry->ready = TRUE;
+
+    if (program != NULL) {
+        priv->programs = g_list_append (priv->programs, program);
+        g_hash_table_insert (priv->program_keys, program, key);
+    }
+    else {
+        /* Do not cache failures, so that the next request tries again */
+        entry->error = g_error_copy (tmp_error);
+        g_hash_table_steal (priv->program_cache, key);
+        g_free (key);
+
+        if (entry->n_waiting == 0)
+            free_program_entry (entry);
+    }
+
+    g_cond_broadcast (priv->program_built);
+    g_mutex_unlock (priv->lock);
+
+    if (tmp_error != NULL)
+        g_propagate_error (error, tmp_error);
+
+    g_free (build_options);
+    return program;
+}
+
+static gchar *
+get_first_kernel_name (const gchar *source)
+{
+    GRegex *regex;
+    gchar *name = NULL;
+    GMatchInfo *match = NULL;
+    GError *error = NULL;
+
+    regex = g_regex_new ("__kernel\\svoid\\s([A-Za-z][A-Za-z0-9_]+)",
+                         G_REGEX_MULTILINE, 0, &error);
+
+    if (error != NULL) {
+        g_error ("%s", error->message);
+        g_error_free (error);
+        return NULL;
+    }
+
+    if (g_regex_match (regex, source, 0, &match))
+        name = g_match_info_fetch (match, 1);
+
+    g_match_info_free (match);
+    g_regex_unref (regex);
+    return name;
+}
+
+static cl_kernel
+create_kernel (UfoResourcesPrivate *priv,
+               cl_program program,
+               const gchar *source,
+               const gchar *kernel_name,
+               GError **error)
+{
+    cl_kernel kernel;
+    gchar *name;
+    cl_int errcode = CL_SUCCESS;
+
+    /*
+     * We look at the source we were given rather than CL_PROGRAM_SOURCE
+     * because programs loaded from the binary cache do not have any.
+     */
+    if (kernel_name == NULL)
+        name = get_first_kernel_name (source);
+    else
+        name = g_strdup (kernel_name);
+
+    kernel = clCreateKernel (program, name, &errcode);
+    g_free (name);
+
+    if (kernel == NULL || errcode != CL_SUCCESS) {
+        g_set_error (error,
+                     UFO_RESOURCES_ERROR,
+                     UFO_RESOURCES_ERROR_CREATE_KERNEL,
+                     "Failed to create kernel `%s`: %s", kernel_name, ufo_resources_clerr (errcode));
+        return NULL;
+    }
+
+    g_mutex_lock (priv->lock);
+    priv->kernels = g_list_append (priv->kernels, kernel);
+    g_mutex_unlock (priv->lock);
+
+    return kernel;
+}
+
+static gchar *
+create_cache_key (const gchar *filename,
+                  const gchar *kernelname)
+{
+    return g_strdup_printf ("%s:%s", filename, kernelname);
+}
+
+/**
+ * ufo_resources_get_kernel_with_opts:
+ * @resources: A #UfoResources object
+ * @filename: Name of the .cl kernel file
+ * @kernel: Name of a kernel, or %NULL
+ * @options: Options passed to the OpenCL compiler
+ * @error: Return location for a GError from #UfoResourcesError, or %NULL
+ *
+ * Loads a and builds a kernel from a file. The file is searched in the current
+ * working directory and all paths added through ufo_resources_add_paths (). If
+ * @kernel is %NULL, the first encountered kernel is returned.
+ *
+ * Returns: (transfer none): a cl_kernel object that is load from @filename or %NULL on error
+ */
+gpointer
+ufo_resources_get_kernel_with_opts (UfoResources   *resources,
+                                    const gchar    *filename,
+                                    const gchar    *kernel,
+                                    const gchar    *options,
+                                    GError        **error)
+{
+    UfoResourcesPrivate *priv;
+    gchar *path;
+    gchar *buffer;
+    cl_program program;
+    cl_kernel result;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
+                          (filename != NULL), NULL);
+
+    priv = resources->priv;
+    path = lookup_kernel_path (priv, filename);
+
+    if (path == NULL) {
+        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
+                     "Could not find `%s'. Use add_paths() to add additional kernel paths", filename);
+        return NULL;
+    }
+
+    buffer = read_file (path);
+    g_free (path);
+
+    if (buffer == NULL) {
+        g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_LOAD_PROGRAM,
+                     "Could not open `%s'", filename);
+        return NULL;
+    }
+
+    program = add_program_from_source (priv, buffer, options, error);
+
+    if (program == NULL) {
+        g_free (buffer);
+        return NULL;
+    }
+
+    g_debug ("Added program %p from `%s`", (gpointer) program, filename);
+    result = create_kernel (priv, program, buffer, kernel, error);
+    g_free (buffer);
+
+    return result;
+}
+
+/**
+ * ufo_resources_get_kernel:
+ * @resources: A #UfoResources object
  * @filename: Name of the .cl kernel file
  * @kernel: Name of a kernel, or %NULL
  * @error: Return location for a GError from #UfoResourcesError, or %NULL
@@ -717,6 +1322,45 @@ ufo_resources_get_kernel (UfoResources *resources,
     return ufo_resources_get_kernel_with_opts (resources, filename, kernel, "", error);
 }
 
+static cl_kernel
+lookup_or_create_kernel (UfoResources *resources,
+                         const gchar *filename,
+                         const gchar *source,
+                         const gchar *kernelname,
+                         gchar *cache_key,
+                         GError **error)
+{
+    UfoResourcesPrivate *priv;
+    cl_kernel kernel;
+
+    priv = resources->priv;
+
+    g_mutex_lock (priv->lock);
+    kernel = g_hash_table_lookup (priv->kernel_cache, cache_key);
+    g_mutex_unlock (priv->lock);
+
+    if (kernel != NULL) {
+        g_free (cache_key);
+        return kernel;
+    }
+
+    if (source != NULL)
+        kernel = ufo_resources_get_kernel_from_source (resources, source, kernelname, error);
+    else
+        kernel = ufo_resources_get_kernel (resources, filename, kernelname, error);
+
+    if (kernel == NULL) {
+        g_free (cache_key);
+        return NULL;
+    }
+
+    g_mutex_lock (priv->lock);
+    g_hash_table_insert (priv->kernel_cache, cache_key, kernel);
+    g_mutex_unlock (priv->lock);
+
+    return kernel;
+}
+
 /**
  * ufo_resources_get_cached_kernel:
  * @resources: A #UfoResources object
@@ -736,37 +1380,237 @@ ufo_resources_get_cached_kernel (UfoResources *resources,
                                  const gchar *filename,
                                  const gchar *kernelname,
                                  GError **error)
+{
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
+                          (filename != NULL), NULL);
+
+    if (kernelname == NULL)
+        return ufo_resources_get_kernel (resources, filename, NULL, error);
+
+    return lookup_or_create_kernel (resources, filename, NULL, kernelname,
+                                    create_cache_key (filename, kernelname), error);
+}
+
+/*
+ * Threads are numbered by slots that are handed back when a thread exits and
+ * reused by the next one. Keying thread kernels by slot rather than by thread
+ * address bounds the cache by the number of concurrent threads, while no two
+ * running threads ever share a kernel object.
+ */
+static GStaticPrivate thread_slot = G_STATIC_PRIVATE_INIT;
+static GStaticMutex thread_slot_lock = G_STATIC_MUTEX_INIT;
+static GSList *free_thread_slots = NULL;
+static guint n_thread_slots = 0;
+
+static void
+release_thread_slot (gpointer slot)
+{
+    g_static_mutex_lock (&thread_slot_lock);
+    free_thread_slots = g_slist_prepend (free_thread_slots, slot);
+    g_static_mutex_unlock (&thread_slot_lock);
+}
+
+static guint
+get_thread_slot (void)
+{
+    gpointer slot;
+
+    slot = g_static_private_get (&thread_slot);
+
+    if (slot == NULL) {
+        g_static_mutex_lock (&thread_slot_lock);
+
+        if (free_thread_slots != NULL) {
+            slot = free_thread_slots->data;
+            free_thread_slots = g_slist_delete_link (free_thread_slots, free_thread_slots);
+        }
+        else {
+            /* Slots are stored off by one so that they are never NULL */
+            slot = GUINT_TO_POINTER (++n_thread_slots);
+        }
+
+        g_static_mutex_unlock (&thread_slot_lock);
+        g_static_private_set (&thread_slot, slot, release_thread_slot);
+    }
+
+    return GPOINTER_TO_UINT (slot) - 1;
+}
+
+/**
+ * ufo_resources_get_thread_kernel:
+ * @resources: A #UfoResources object
+ * @filename: Name of the .cl kernel file
+ * @kernel: Name of a kernel
+ * @error: Return location for a GError from #UfoResourcesError, or %NULL
+ *
+ * Like ufo_resources_get_cached_kernel() but the returned kernel object is
+ * private to the calling thread. Setting its arguments and enqueuing it does
+ * not need any locking, no matter how many threads launch the same kernel.
+ * The program is built only once and shared by all kernel objects. Once a
+ * thread exits, its kernel objects are handed to the next new thread.
+ *
+ * Returns: (transfer none): a cl_kernel object that is load from @filename or %NULL on error
+ */
+gpointer
+ufo_resources_get_thread_kernel (UfoResources *resources,
+                                 const gchar *filename,
+                                 const gchar *kernel,
+                                 GError **error)
+{
+    gchar *cache_key;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
+                          (filename != NULL) && (kernel != NULL), NULL);
+
+    cache_key = g_strdup_printf ("%s:%s@%u", filename, kernel, get_thread_slot ());
+    return lookup_or_create_kernel (resources, filename, NULL, kernel, cache_key, error);
+}
+
+/**
+ * ufo_resources_get_thread_kernel_from_source:
+ * @resources: A #UfoResources object
+ * @source: OpenCL source string
+ * @kernel: Name of a kernel
+ * @error: Return location for a GError from #UfoResourcesError, or %NULL
+ *
+ * Like ufo_resources_get_thread_kernel() but builds the kernel from @source.
+ * This is useful for generated code that is requested over and over again.
+ *
+ * Returns: (transfer none): a cl_kernel object built from @source or %NULL on error
+ */
+gpointer
+ufo_resources_get_thread_kernel_from_source (UfoResources *resources,
+                                             const gchar *source,
+                                             const gchar *kernel,
+                                             GError **error)
+{
+    gchar *digest;
+    gchar *cache_key;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
+                          (source != NULL) && (kernel != NULL), NULL);
+
+    digest = g_compute_checksum_for_string (G_CHECKSUM_SHA1, source, -1);
+    cache_key = g_strdup_printf ("source:%s:%s@%u", digest, kernel, get_thread_slot ());
+    g_free (digest);
+
+    return lookup_or_create_kernel (resources, NULL, source, kernel, cache_key, error);
+}
+
+static gboolean
+is_valid_define (const gchar *define)
+{
+    const gchar *p = define;
+
+    if (!g_ascii_isalpha (*p) && *p != '_')
+        return FALSE;
+
+    while (g_ascii_isalnum (*p) || *p == '_')
+        p++;
+
+    if (*p == '\0')
+        return TRUE;
+
+    if (*p != '=')
+        return FALSE;
+
+    for (p++; *p != '\0'; p++) {
+        if (g_ascii_isspace (*p) || *p == '"' || *p == '\'')
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+static gint
+compare_defines (gconstpointer a,
+                 gconstpointer b)
+{
+    return g_strcmp0 (*((const gchar **) a), *((const gchar **) b));
+}
+
+/**
+ * ufo_resources_get_specialized_kernel:
+ * @resources: A #UfoResources object
+ * @filename: Name of the .cl kernel file
+ * @kernel: Name of a kernel, or %NULL
+ * @defines: (array zero-terminated=1): %NULL-terminated list of preprocessor
+ *      definitions in the form <literal>NAME</literal> or
+ *      <literal>NAME=VALUE</literal>
+ * @error: Return location for a GError from #UfoResourcesError, or %NULL
+ *
+ * Loads and builds a kernel from a file with each entry of @defines passed as
+ * a <literal>-D</literal> option to the compiler. This allows specializing
+ * kernels for constant sizes, e.g. the frame dimensions or the number of
+ * projections, so that the compiler can unroll and vectorize loops. Tasks
+ * should request a new kernel when they see a different size in
+ * get_requisition().
+ *
+ * Kernels are cached by @filename, @kernel and the set of @defines, regardless
+ * of their order, so repeated requests are cheap. Like
+ * ufo_resources_get_cached_kernel(), the kernel object should not be used by
+ * two threads concurrently.
+ *
+ * Returns: (transfer none): a cl_kernel object that is load from @filename or %NULL on error
+ */
+gpointer
+ufo_resources_get_specialized_kernel (UfoResources *resources,
+                                      const gchar *filename,
+                                      const gchar *kernel,
+                                      const gchar * const *defines,
+                                      GError **error)
 {
     UfoResourcesPrivate *priv;
-    cl_kernel kernel;
+    GPtrArray *sorted;
+    GString *options;
+    gchar *cache_key;
+    cl_kernel result;
 
     g_return_val_if_fail (UFO_IS_RESOURCES (resources) &&
                           (filename != NULL), NULL);
 
     priv = resources->priv;
+    sorted = g_ptr_array_new ();
 
-    if (kernelname != NULL) {
-        gchar *cache_key;
-
-        cache_key = create_cache_key (filename, kernelname);
-        kernel = g_hash_table_lookup (priv->kernel_cache, cache_key);
-
-        if (kernel != NULL) {
-            g_free (cache_key);
-            return kernel;
+    for (guint i = 0; defines != NULL && defines[i] != NULL; i++) {
+        if (!is_valid_define (defines[i])) {
+            g_set_error (error, UFO_RESOURCES_ERROR, UFO_RESOURCES_ERROR_BUILD_PROGRAM,
+                         "Invalid definition `%s' for `%s'", defines[i], filename);
+            g_ptr_array_free (sorted, TRUE);
+            return NULL;
         }
+
+        g_ptr_array_add (sorted, (gpointer) defines[i]);
     }
 
-    kernel = ufo_resources_get_kernel (resources, filename, kernelname, error);
+    /* The same set of definitions must map to the same program and kernel */
+    g_ptr_array_sort (sorted, compare_defines);
+    options = g_string_new (NULL);
+
+    for (guint i = 0; i < sorted->len; i++)
+        g_string_append_printf (options, " -D%s", (gchar *) g_ptr_array_index (sorted, i));
+
+    g_ptr_array_free (sorted, TRUE);
+    cache_key = g_strdup_printf ("%s:%s:%s", filename, kernel != NULL ? kernel : "", options->str);
+
+    g_mutex_lock (priv->lock);
+    result = g_hash_table_lookup (priv->kernel_cache, cache_key);
+    g_mutex_unlock (priv->lock);
 
-    if (kernel != NULL && kernelname != NULL) {
-        gchar *cache_key;
+    if (result == NULL) {
+        result = ufo_resources_get_kernel_with_opts (resources, filename, kernel, options->str, error);
 
-        cache_key = create_cache_key (filename, kernelname);
-        g_hash_table_insert (priv->kernel_cache, cache_key, kernel);
+        if (result != NULL) {
+            g_mutex_lock (priv->lock);
+            g_hash_table_insert (priv->kernel_cache, cache_key, result);
+            g_mutex_unlock (priv->lock);
+            cache_key = NULL;
+        }
     }
 
-    return kernel;
+    g_free (cache_key);
+    g_string_free (options, TRUE);
+    return result;
 }
 
 /**
@@ -800,7 +1644,629 @@ ufo_resources_get_kernel_from_source (UfoResources *resources,
         return NULL;
 
     g_debug ("Added program %p from source", (gpointer) program);
-    return create_kernel (priv, program, kernel, error);
+    return create_kernel (priv, program, source, kernel, error);
+}
+
+#define MAX_TUNING_CANDIDATES   16
+#define N_TUNING_SAMPLES        2
+
+typedef struct {
+    gsize    candidates[MAX_TUNING_CANDIDATES][3];  /* All zero is the driver default */
+    gdouble  times[MAX_TUNING_CANDIDATES];
+    guint    n_candidates;
+    guint    n_started;
+    guint    n_finished;
+    guint    best;
+    gboolean done;
+} TuningEntry;
+
+/* Holds a reference on the kernel so that its address cannot be reused */
+typedef struct {
+    cl_kernel    kernel;
+    cl_device_id device;
+    guint        work_dim;
+    gsize        global_work_size[3];
+} LaunchKey;
+
+static const gsize tuning_candidates_1d[] = { 32, 64, 128, 256, 512, 1024 };
+
+static const gsize tuning_candidates_2d[][2] = {
+    { 8, 8 }, { 16, 8 }, { 8, 16 }, { 16, 16 }, { 32, 4 }, { 32, 8 },
+    { 32, 16 }, { 64, 2 }, { 64, 4 }, { 128, 1 }, { 256, 1 }
+};
+
+static gboolean
+tuning_enabled (void)
+{
+    return g_getenv ("UFO_DISABLE_TUNING") == NULL;
+}
+
+static gchar *
+get_tuning_db_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "ufo", "tuning.ini", NULL);
+}
+
+static gchar *
+get_kernel_string (cl_kernel kernel,
+                   cl_kernel_info param)
+{
+    gsize size;
+    gchar *str;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, param, 0, NULL, &size));
+    str = g_malloc0 (size + 1);
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, param, size, str, NULL));
+    return str;
+}
+
+static void
+launch_key_init (LaunchKey *key,
+                 cl_kernel kernel,
+                 cl_device_id device,
+                 guint work_dim,
+                 const gsize *global_work_size)
+{
+    key->kernel = kernel;
+    key->device = device;
+    key->work_dim = work_dim;
+
+    for (guint i = 0; i < 3; i++)
+        key->global_work_size[i] = i < work_dim ? global_work_size[i] : 0;
+}
+
+static guint
+launch_key_hash (gconstpointer data)
+{
+    const LaunchKey *key = data;
+    guint hash;
+
+    hash = g_direct_hash (key->kernel) ^ (g_direct_hash (key->device) << 7) ^ key->work_dim;
+
+    for (guint i = 0; i < 3; i++)
+        hash = hash * 31 + (guint) key->global_work_size[i];
+
+    return hash;
+}
+
+static gboolean
+launch_key_equal (gconstpointer a,
+                  gconstpointer b)
+{
+    const LaunchKey *ka = a;
+    const LaunchKey *kb = b;
+
+    return ka->kernel == kb->kernel && ka->device == kb->device && ka->work_dim == kb->work_dim &&
+           ka->global_work_size[0] == kb->global_work_size[0] &&
+           ka->global_work_size[1] == kb->global_work_size[1] &&
+           ka->global_work_size[2] == kb->global_work_size[2];
+}
+
+static void
+free_launch_key (LaunchKey *key)
+{
+    UFO_RESOURCES_CHECK_CLERR (clReleaseKernel (key->kernel));
+    g_free (key);
+}
+
+/*
+ * Returns the finished entry for @key or %NULL. Does not take priv->lock, so
+ * launches of tuned kernels do not serialize each other.
+ */
+static TuningEntry *
+lookup_tuned_entry (UfoResourcesPrivate *priv,
+                    const LaunchKey *key)
+{
+    TuningEntry *entry;
+
+    g_static_rw_lock_reader_lock (&priv->tuned_lock);
+    entry = g_hash_table_lookup (priv->tuned, key);
+    g_static_rw_lock_reader_unlock (&priv->tuned_lock);
+    return entry;
+}
+
+/* Must be called with priv->lock held and a finished @entry */
+static void
+insert_tuned_entry (UfoResourcesPrivate *priv,
+                    const LaunchKey *key,
+                    TuningEntry *entry)
+{
+    LaunchKey *copy;
+
+    g_static_rw_lock_writer_lock (&priv->tuned_lock);
+
+    if (g_hash_table_lookup (priv->tuned, key) == NULL) {
+        copy = g_memdup (key, sizeof (LaunchKey));
+        UFO_RESOURCES_CHECK_CLERR (clRetainKernel (copy->kernel));
+        g_hash_table_insert (priv->tuned, copy, entry);
+    }
+
+    g_static_rw_lock_writer_unlock (&priv->tuned_lock);
+}
+
+/*
+ * Must be called with priv->lock held. The key identifies the program source,
+ * kernel, device, driver and global work size.
+ */
+static gchar *
+get_tuning_key (UfoResourcesPrivate *priv,
+                cl_kernel kernel,
+                cl_device_id device,
+                guint work_dim,
+                const gsize *global_work_size)
+{
+    GChecksum *checksum;
+    cl_program program;
+    const gchar *program_key;
+    gchar *key;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelInfo (kernel, CL_KERNEL_PROGRAM, sizeof (cl_program), &program, NULL));
+    program_key = g_hash_table_lookup (priv->program_keys, program);
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA1);
+    checksum_update_string (checksum, g_strdup (program_key != NULL ? program_key : ""));
+    checksum_update_string (checksum, get_kernel_string (kernel, CL_KERNEL_FUNCTION_NAME));
+    checksum_update_string (checksum, get_device_string (device, CL_DEVICE_NAME));
+    checksum_update_string (checksum, get_device_string (device, CL_DRIVER_VERSION));
+
+    for (guint i = 0; i < work_dim; i++)
+        checksum_update_string (checksum, g_strdup_printf ("%zu", global_work_size[i]));
+
+    key = g_strdup (g_checksum_get_string (checksum));
+    g_checksum_free (checksum);
+    return key;
+}
+
+static gboolean
+kernel_is_tunable (cl_kernel kernel,
+                   cl_device_id device)
+{
+    gsize compile_size[3];
+    cl_ulong local_mem_size;
+
+    /*
+     * Kernels with a required work-group size cannot run with anything else
+     * and kernels using local memory may silently depend on the size.
+     */
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_COMPILE_WORK_GROUP_SIZE,
+                                                         sizeof (compile_size), compile_size, NULL));
+
+    if (compile_size[0] != 0 || compile_size[1] != 0 || compile_size[2] != 0)
+        return FALSE;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_LOCAL_MEM_SIZE,
+                                                         sizeof (cl_ulong), &local_mem_size, NULL));
+
+    return local_mem_size == 0;
+}
+
+static void
+add_tuning_candidate (TuningEntry *entry,
+                      guint work_dim,
+                      const gsize *global_work_size,
+                      const gsize *max_item_sizes,
+                      gsize max_group_size,
+                      gsize x, gsize y)
+{
+    gsize local[3] = { x, y, 1 };
+    gsize total = 1;
+
+    if (entry->n_candidates == MAX_TUNING_CANDIDATES)
+        return;
+
+    for (guint i = 0; i < work_dim; i++) {
+        if (local[i] > max_item_sizes[i] || (global_work_size[i] % local[i]) != 0)
+            return;
+
+        total *= local[i];
+    }
+
+    if (total > max_group_size)
+        return;
+
+    for (guint i = 0; i < 3; i++)
+        entry->candidates[entry->n_candidates][i] = i < work_dim ? local[i] : 0;
+
+    entry->n_candidates++;
+}
+
+static TuningEntry *
+create_tuning_entry (cl_kernel kernel,
+                     cl_device_id device,
+                     guint work_dim,
+                     const gsize *global_work_size)
+{
+    TuningEntry *entry;
+    gsize max_item_sizes[3] = { 1, 1, 1 };
+    gsize max_group_size;
+    cl_uint max_dims;
+
+    entry = g_new0 (TuningEntry, 1);
+    entry->n_candidates = 1;
+
+    if (work_dim == 0 || work_dim > 3 || !kernel_is_tunable (kernel, device)) {
+        entry->done = TRUE;
+        return entry;
+    }
+
+    UFO_RESOURCES_CHECK_CLERR (clGetKernelWorkGroupInfo (kernel, device, CL_KERNEL_WORK_GROUP_SIZE,
+                                                         sizeof (gsize), &max_group_size, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS,
+                                                sizeof (cl_uint), &max_dims, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetDeviceInfo (device, CL_DEVICE_MAX_WORK_ITEM_SIZES,
+                                                MIN (max_dims, 3) * sizeof (gsize), max_item_sizes, NULL));
+
+    if (work_dim == 1) {
+        for (guint i = 0; i < G_N_ELEMENTS (tuning_candidates_1d); i++)
+            add_tuning_candidate (entry, work_dim, global_work_size, max_item_sizes, max_group_size,
+                                  tuning_candidates_1d[i], 1);
+    }
+    else {
+        for (guint i = 0; i < G_N_ELEMENTS (tuning_candidates_2d); i++)
+            add_tuning_candidate (entry, work_dim, global_work_size, max_item_sizes, max_group_size,
+                                  tuning_candidates_2d[i][0], tuning_candidates_2d[i][1]);
+    }
+
+    entry->done = entry->n_candidates == 1;
+    return entry;
+}
+
+static gboolean
+lookup_tuning_db (UfoResourcesPrivate *priv,
+                  const gchar *key,
+                  guint work_dim,
+                  TuningEntry *entry)
+{
+    gchar *value;
+    gchar **sizes;
+    gchar *path;
+
+    if (priv->tuning_db == NULL) {
+        priv->tuning_db = g_key_file_new ();
+        path = get_tuning_db_path ();
+        g_key_file_load_from_file (priv->tuning_db, path, G_KEY_FILE_NONE, NULL);
+        g_free (path);
+    }
+
+    value = g_key_file_get_string (priv->tuning_db, "local-sizes", key, NULL);
+
+    if (value == NULL)
+        return FALSE;
+
+    sizes = g_strsplit (value, ",", 3);
+
+    if (g_strv_length (sizes) == work_dim) {
+        for (guint i = 0; i < 3; i++)
+            entry->candidates[0][i] = i < work_dim ? (gsize) g_ascii_strtoull (sizes[i], NULL, 10) : 0;
+
+        entry->n_candidates = 1;
+        entry->best = 0;
+        entry->done = TRUE;
+    }
+
+    g_strfreev (sizes);
+    g_free (value);
+    return entry->done;
+}
+
+/* Must be called with priv->lock held */
+static void
+update_tuning_db (UfoResourcesPrivate *priv,
+                  const gchar *key,
+                  guint work_dim,
+                  TuningEntry *entry)
+{
+    GString *value;
+
+    value = g_string_new (NULL);
+
+    for (guint i = 0; i < work_dim; i++)
+        g_string_append_printf (value, i == 0 ? "%zu" : ",%zu", entry->candidates[entry->best][i]);
+
+    g_key_file_set_string (priv->tuning_db, "local-sizes", key, value->str);
+    g_string_free (value, TRUE);
+}
+
+/*
+ * Must be called without priv->lock held. Writes are serialized by
+ * tuning_db_lock so that an older snapshot never replaces a newer one.
+ */
+static void
+store_tuning_db (UfoResourcesPrivate *priv)
+{
+    gchar *contents;
+    gchar *path;
+    gchar *dirname;
+    gsize length;
+
+    g_mutex_lock (priv->tuning_db_lock);
+
+    g_mutex_lock (priv->lock);
+    contents = g_key_file_to_data (priv->tuning_db, &length, NULL);
+    g_mutex_unlock (priv->lock);
+
+    path = get_tuning_db_path ();
+    dirname = g_path_get_dirname (path);
+
+    if (g_mkdir_with_parents (dirname, 0755) == 0)
+        g_file_set_contents (path, contents, length, NULL);
+
+    g_free (dirname);
+    g_free (path);
+    g_free (contents);
+
+    g_mutex_unlock (priv->tuning_db_lock);
+}
+
+/*
+ * Must be called with priv->lock held. Returns the entry for the launch
+ * configuration and creates it from the database or a new set of candidates.
+ */
+static TuningEntry *
+get_tuning_entry (UfoResourcesPrivate *priv,
+                  cl_kernel kernel,
+                  cl_device_id device,
+                  guint work_dim,
+                  const gsize *global_work_size,
+                  gchar **key)
+{
+    TuningEntry *entry;
+
+    *key = get_tuning_key (priv, kernel, device, work_dim, global_work_size);
+    entry = g_hash_table_lookup (priv->tuning, *key);
+
+    if (entry == NULL) {
+        entry = g_new0 (TuningEntry, 1);
+
+        if (!lookup_tuning_db (priv, *key, work_dim, entry)) {
+            g_free (entry);
+            entry = create_tuning_entry (kernel, device, work_dim, global_work_size);
+        }
+
+        g_hash_table_insert (priv->tuning, g_strdup (*key), entry);
+    }
+
+    if (entry->done) {
+        LaunchKey launch_key;
+
+        launch_key_init (&launch_key, kernel, device, work_dim, global_work_size);
+        insert_tuned_entry (priv, &launch_key, entry);
+    }
+
+    return entry;
+}
+
+static gdouble
+get_event_duration (cl_command_queue queue,
+                    cl_event event,
+                    gdouble wall_time)
+{
+    cl_command_queue_properties properties;
+    cl_ulong start;
+    cl_ulong end;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (queue, CL_QUEUE_PROPERTIES,
+                                                      sizeof (properties), &properties, NULL));
+
+    if (!(properties & CL_QUEUE_PROFILING_ENABLE))
+        return wall_time;
+
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_START, sizeof (cl_ulong), &start, NULL));
+    UFO_RESOURCES_CHECK_CLERR (clGetEventProfilingInfo (event, CL_PROFILING_COMMAND_END, sizeof (cl_ulong), &end, NULL));
+    return (end - start) * 1e-9;
+}
+
+/**
+ * ufo_resources_get_best_local_size: (skip)
+ * @resources: A #UfoResources
+ * @kernel: A cl_kernel
+ * @cmd_queue: A cl_command_queue on which @kernel is going to be executed
+ * @work_dim: Number of work dimensions
+ * @global_work_size: Global work size with @work_dim entries
+ * @local_work_size: Return location for the local work size with @work_dim
+ *      entries
+ *
+ * Look up the fastest local work size that was determined for @kernel with
+ * @global_work_size on the device of @cmd_queue. Results are found by
+ * ufo_resources_enqueue_kernel() and persisted in the ufo/tuning.ini file of
+ * g_get_user_cache_dir().
+ *
+ * Returns: %TRUE if a tuned local work size is known, %FALSE if the driver
+ * should choose one, i.e. %NULL should be passed to clEnqueueNDRangeKernel().
+ */
+gboolean
+ufo_resources_get_best_local_size (UfoResources *resources,
+                                   gpointer kernel,
+                                   gpointer cmd_queue,
+                                   guint work_dim,
+                                   const gsize *global_work_size,
+                                   gsize *local_work_size)
+{
+    UfoResourcesPrivate *priv;
+    TuningEntry *entry;
+    LaunchKey launch_key;
+    cl_device_id device;
+    gchar *key = NULL;
+    gboolean found;
+
+    g_return_val_if_fail (UFO_IS_RESOURCES (resources) && kernel != NULL && cmd_queue != NULL, FALSE);
+
+    if (!tuning_enabled () || work_dim == 0 || work_dim > 3)
+        return FALSE;
+
+    priv = resources->priv;
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (cmd_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL));
+
+    launch_key_init (&launch_key, kernel, device, work_dim, global_work_size);
+    entry = lookup_tuned_entry (priv, &launch_key);
+
+    if (entry == NULL) {
+        g_mutex_lock (priv->lock);
+        entry = get_tuning_entry (priv, kernel, device, work_dim, global_work_size, &key);
+        found = entry->done;
+        g_mutex_unlock (priv->lock);
+        g_free (key);
+
+        if (!found)
+            return FALSE;
+    }
+
+    /* Finished entries are not modified anymore */
+    found = entry->candidates[entry->best][0] != 0;
+
+    if (found) {
+        for (guint i = 0; i < work_dim; i++)
+            local_work_size[i] = entry->candidates[entry->best][i];
+    }
+
+    return found;
+}
+
+/**
+ * ufo_resources_enqueue_kernel: (skip)
+ * @resources: A #UfoResources
+ * @cmd_queue: A cl_command_queue
+ * @kernel: A cl_kernel with all arguments set
+ * @work_dim: Number of work dimensions
+ * @global_work_size: Global work size with @work_dim entries
+ * @event: (allow-none): Return location for a cl_event or %NULL
+ *
+ * Enqueue @kernel with the best known local work size. As long as no size is
+ * known for the kernel, device and @global_work_size, each call measures one
+ * candidate while doing real work, so no launch is repeated. Once all
+ * candidates are timed, the fastest one is stored on disk and used from then
+ * on. Launches that find all candidates being measured by other threads use
+ * the driver's choice and are not timed. Once tuned, launches only take a
+ * reader lock. Kernels with a required work-group size or local memory arguments are
+ * always launched with the driver's choice. Set <envar>UFO_DISABLE_TUNING</envar>
+ * to turn this off.
+ */
+void
+ufo_resources_enqueue_kernel (UfoResources *resources,
+                              gpointer cmd_queue,
+                              gpointer kernel,
+                              guint work_dim,
+                              const gsize *global_work_size,
+                              gpointer *event)
+{
+    UfoResourcesPrivate *priv;
+    TuningEntry *entry;
+    LaunchKey launch_key;
+    cl_device_id device;
+    cl_event tuning_event;
+    gsize local_work_size[3];
+    gboolean use_default;
+    gboolean measure;
+    gboolean finished = FALSE;
+    guint candidate;
+    gchar *key;
+    GTimer *timer;
+    gdouble elapsed;
+
+    g_return_if_fail (UFO_IS_RESOURCES (resources) && kernel != NULL && cmd_queue != NULL);
+
+    if (!tuning_enabled () || work_dim == 0 || work_dim > 3) {
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, work_dim, NULL, global_work_size,
+                                                           NULL, 0, NULL, (cl_event *) event));
+        return;
+    }
+
+    priv = resources->priv;
+    UFO_RESOURCES_CHECK_CLERR (clGetCommandQueueInfo (cmd_queue, CL_QUEUE_DEVICE, sizeof (cl_device_id), &device, NULL));
+
+    launch_key_init (&launch_key, kernel, device, work_dim, global_work_size);
+    entry = lookup_tuned_entry (priv, &launch_key);
+
+    if (entry != NULL) {
+        for (guint i = 0; i < work_dim; i++)
+            local_work_size[i] = entry->candidates[entry->best][i];
+
+        use_default = local_work_size[0] == 0;
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, work_dim, NULL, global_work_size,
+                                                           use_default ? NULL : local_work_size,
+                                                           0, NULL, (cl_event *) event));
+        return;
+    }
+
+    g_mutex_lock (priv->lock);
+    entry = get_tuning_entry (priv, kernel, device, work_dim, global_work_size, &key);
+    measure = FALSE;
+
+    if (entry->done) {
+        candidate = entry->best;
+    }
+    else if (entry->n_started < entry->n_candidates * N_TUNING_SAMPLES) {
+        candidate = entry->n_started++ / N_TUNING_SAMPLES;
+        measure = TRUE;
+    }
+    else {
+        /* All candidates are being measured by other threads, do not count this launch */
+        candidate = 0;
+    }
+
+    for (guint i = 0; i < work_dim; i++)
+        local_work_size[i] = entry->candidates[candidate][i];
+
+    use_default = local_work_size[0] == 0;
+
+    if (!measure) {
+        g_mutex_unlock (priv->lock);
+        g_free (key);
+
+        UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, work_dim, NULL, global_work_size,
+                                                           use_default ? NULL : local_work_size,
+                                                           0, NULL, (cl_event *) event));
+        return;
+    }
+
+    g_mutex_unlock (priv->lock);
+
+    /* Measure the candidate in isolation */
+    UFO_RESOURCES_CHECK_CLERR (clFinish (cmd_queue));
+    timer = g_timer_new ();
+
+    UFO_RESOURCES_CHECK_CLERR (clEnqueueNDRangeKernel (cmd_queue, kernel, work_dim, NULL, global_work_size,
+                                                       use_default ? NULL : local_work_size,
+                                                       0, NULL, &tuning_event));
+    UFO_RESOURCES_CHECK_CLERR (clWaitForEvents (1, &tuning_event));
+
+    elapsed = get_event_duration (cmd_queue, tuning_event, g_timer_elapsed (timer, NULL));
+    g_timer_destroy (timer);
+
+    if (event != NULL)
+        *event = tuning_event;
+    else
+        UFO_RESOURCES_CHECK_CLERR (clReleaseEvent (tuning_event));
+
+    g_mutex_lock (priv->lock);
+
+    if (!entry->done) {
+        if (entry->times[candidate] == 0.0 || elapsed < entry->times[candidate])
+            entry->times[candidate] = elapsed;
+
+        entry->n_finished++;
+
+        if (entry->n_finished == entry->n_candidates * N_TUNING_SAMPLES) {
+            for (guint i = 1; i < entry->n_candidates; i++) {
+                if (entry->times[i] < entry->times[entry->best])
+                    entry->best = i;
+            }
+
+            entry->done = TRUE;
+            finished = TRUE;
+            update_tuning_db (priv, key, work_dim, entry);
+            insert_tuned_entry (priv, &launch_key, entry);
+            g_debug ("Tuned local size for key %s: %zu x %zu", key,
+                     entry->candidates[entry->best][0], entry->candidates[entry->best][1]);
+        }
+    }
+
+    g_mutex_unlock (priv->lock);
+
+    if (finished)
+        store_tuning_db (priv);
+
+    g_free (key);
 }
 
 /**
@@ -816,6 +2282,7 @@ gpointer
 ufo_resources_get_context (UfoResources *resources)
 {
     g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+    ensure_opencl (resources->priv, NULL);
     return resources->priv->context;
 }
 
@@ -837,6 +2304,7 @@ ufo_resources_get_cmd_queues (UfoResources *resources)
 
     g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
     priv = UFO_RESOURCES_GET_PRIVATE (resources);
+    ensure_opencl (priv, NULL);
 
     g_list_for (priv->gpu_nodes, it) {
         result = g_list_append (result, ufo_gpu_node_get_cmd_queue (UFO_GPU_NODE (it->data)));
@@ -862,6 +2330,7 @@ ufo_resources_get_devices (UfoResources *resources)
 
     g_return_val_if_fail (UFO_IS_RESOURCES(resources), NULL);
     priv = resources->priv;
+    ensure_opencl (priv, NULL);
 
     for (guint i = 0; i < priv->n_devices; i++)
         result = g_list_append (result, priv->devices[i]);
@@ -882,6 +2351,7 @@ GList *
 ufo_resources_get_gpu_nodes (UfoResources *resources)
 {
     g_return_val_if_fail (UFO_IS_RESOURCES (resources), NULL);
+    ensure_opencl (resources->priv, NULL);
     return g_list_copy (resources->priv->gpu_nodes);
 }
 
@@ -918,6 +2388,22 @@ ufo_resources_set_property (GObject *object,
             priv->device_type = g_value_get_flags (value);
             break;
 
+        case PROP_DEVICE_SELECTION:
+            if (warn_if_initialized (priv, pspec))
+                break;
+
+            g_free (priv->device_selection);
+            priv->device_selection = g_value_dup_string (value);
+            break;
+
+        case PROP_DEVICE_PARTITION:
+            if (warn_if_initialized (priv, pspec))
+                break;
+
+            g_free (priv->device_partition);
+            priv->device_partition = g_value_dup_string (value);
+            break;
+
         case PROP_REMOTES:
             {
                 GValueArray *array;
@@ -964,6 +2450,14 @@ ufo_resources_get_property (GObject *object,
             g_value_set_flags (value, priv->device_type);
             break;
 
+        case PROP_DEVICE_SELECTION:
+            g_value_set_string (value, priv->device_selection);
+            break;
+
+        case PROP_DEVICE_PARTITION:
+            g_value_set_string (value, priv->device_partition);
+            break;
+
         case PROP_REMOTES:
             g_value_set_boxed (value, priv->remotes);
             break;
@@ -1006,6 +2500,17 @@ ufo_resources_finalize (GObject *object)
 
     g_clear_error (&priv->construct_error);
     g_hash_table_destroy (priv->kernel_cache);
+    g_hash_table_destroy (priv->program_keys);
+    g_hash_table_destroy (priv->program_cache);
+    g_hash_table_destroy (priv->tuned);
+    g_static_rw_lock_free (&priv->tuned_lock);
+    g_hash_table_destroy (priv->tuning);
+    g_mutex_free (priv->tuning_db_lock);
+
+    if (priv->tuning_db != NULL)
+        g_key_file_free (priv->tuning_db);
+    g_mutex_free (priv->lock);
+    g_cond_free (priv->program_built);
 
     g_list_free_full (priv->remotes, g_free);
     g_list_free_full (priv->paths, g_free);
@@ -1019,7 +2524,17 @@ ufo_resources_finalize (GObject *object)
 
     g_string_free (priv->build_opts, TRUE);
 
+#ifdef CL_VERSION_1_2
+    /* Releasing a root device is a no-op, so this is safe for mixed lists */
+    if (priv->sub_devices) {
+        for (guint i = 0; i < priv->n_devices; i++)
+            UFO_RESOURCES_CHECK_CLERR (clReleaseDevice (priv->devices[i]));
+    }
+#endif
+
     g_free (priv->devices);
+    g_free (priv->device_selection);
+    g_free (priv->device_partition);
 
     priv->kernels = NULL;
     priv->devices = NULL;
@@ -1096,6 +2611,38 @@ ufo_resources_class_init (UfoResourcesClass *klass)
                             UFO_TYPE_DEVICE_TYPE, UFO_DEVICE_ALL,
                             G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 
+    /**
+     * UfoResources:device-selection:
+     *
+     * Comma-separated list of device indices and inclusive ranges such as
+     * "0,2-3" that restricts the devices used for computation. %NULL selects
+     * all devices. Must be set before OpenCL is initialized on first use,
+     * later changes are ignored with a warning.
+     */
+    properties[PROP_DEVICE_SELECTION] =
+        g_param_spec_string ("device-selection",
+                             "Indices of devices to use",
+                             "Indices of devices to use, e.g. \"0,2-3\"",
+                             NULL,
+                             G_PARAM_READWRITE);
+
+    /**
+     * UfoResources:device-partition:
+     *
+     * Split the selected devices into OpenCL sub-devices, either one per NUMA
+     * domain with "numa" or with N compute units each with "equal:N". Each
+     * sub-device is treated like a separate device, so task graphs are expanded
+     * across them. Devices that do not support the partitioning are used as a
+     * whole. Must be set before OpenCL is initialized on first use, later
+     * changes are ignored with a warning.
+     */
+    properties[PROP_DEVICE_PARTITION] =
+        g_param_spec_string ("device-partition",
+                             "Sub-device partitioning",
+                             "Sub-device partitioning, \"numa\" or \"equal:N\"",
+                             NULL,
+                             G_PARAM_READWRITE);
+
     properties[PROP_REMOTES] =
         g_param_spec_value_array ("remotes",
                                   "List with remote addresses",
@@ -1127,6 +2674,17 @@ ufo_resources_init (UfoResources *self)
     priv->programs = NULL;
     priv->kernels = NULL;
     priv->kernel_cache = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    priv->program_cache = g_hash_table_new_full (g_str_hash, g_str_equal,
+                                                 g_free, (GDestroyNotify) free_program_entry);
+    priv->program_keys = g_hash_table_new (g_direct_hash, g_direct_equal);
+    priv->tuning = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+    priv->tuning_db = NULL;
+    priv->tuning_db_lock = g_mutex_new ();
+    priv->tuned = g_hash_table_new_full (launch_key_hash, launch_key_equal,
+                                         (GDestroyNotify) free_launch_key, NULL);
+    g_static_rw_lock_init (&priv->tuned_lock);
+    priv->lock = g_mutex_new ();
+    priv->program_built = g_cond_new ();
     priv->build_opts = g_string_new ("-cl-mad-enable ");
 
     priv->paths = g_list_append (NULL, g_strdup ("."));
@@ -1151,6 +2709,9 @@ ufo_resources_init (UfoResources *self)
 
     priv->device_type = UFO_DEVICE_GPU;
     priv->platform_index = -1;
-
-    initialize_opencl (priv);
+    priv->device_selection = NULL;
+    priv->device_partition = NULL;
+    priv->sub_devices = FALSE;
+    priv->initialized = FALSE;
+    priv->init_reported = FALSE;
 }
@@ -47,7 +47,8 @@ typedef enum {
     UFO_RESOURCES_ERROR_LOAD_PROGRAM,
     UFO_RESOURCES_ERROR_CREATE_PROGRAM,
     UFO_RESOURCES_ERROR_BUILD_PROGRAM,
-    UFO_RESOURCES_ERROR_CREATE_KERNEL
+    UFO_RESOURCES_ERROR_CREATE_KERNEL,
+    UFO_RESOURCES_ERROR_DEVICE_SELECTION
 } UfoResourcesError;
 
 /**
@@ -129,10 +130,36 @@ gpointer         ufo_resources_get_cached_kernel        (UfoResources   *resourc
                                                          const gchar    *filename,
                                                          const gchar    *kernel,
                                                          GError        **error);
+gpointer         ufo_resources_get_thread_kernel        (UfoResources   *resources,
+                                                         const gchar    *filename,
+                                                         const gchar    *kernel,
+                                                         GError        **error);
+gpointer         ufo_resources_get_thread_kernel_from_source
+                                                        (UfoResources   *resources,
+                                                         const gchar    *source,
+                                                         const gchar    *kernel,
+                                                         GError        **error);
+gpointer         ufo_resources_get_specialized_kernel   (UfoResources   *resources,
+                                                         const gchar    *filename,
+                                                         const gchar    *kernel,
+                                                         const gchar * const *defines,
+                                                         GError        **error);
 gpointer         ufo_resources_get_kernel_from_source   (UfoResources   *resources,
                                                          const gchar    *source,
                                                          const gchar    *kernel,
                                                          GError        **error);
+gboolean         ufo_resources_get_best_local_size      (UfoResources   *resources,
+                                                         gpointer        kernel,
+                                                         gpointer        cmd_queue,
+                                                         guint           work_dim,
+                                                         const gsize    *global_work_size,
+                                                         gsize          *local_work_size);
+void             ufo_resources_enqueue_kernel           (UfoResources   *resources,
+                                                         gpointer        cmd_queue,
+                                                         gpointer        kernel,
+                                                         guint           work_dim,
+                                                         const gsize    *global_work_size,
+                                                         gpointer       *event);
 gpointer         ufo_resources_get_context              (UfoResources   *resources);
 GList          * ufo_resources_get_cmd_queues           (UfoResources   *resources);
 GList          * ufo_resources_get_devices              (UfoResources   *resources);
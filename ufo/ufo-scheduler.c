@@ -18,6 +18,11 @@
  */
 #include "config.h"
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
 #ifdef WITH_PYTHON
 #include <Python.h>
 #endif
@@ -32,12 +37,14 @@
 #include <string.h>
 
 #include <ufo/ufo-buffer.h>
+#include <ufo/ufo-gpu-node.h>
 #include <ufo/ufo-remote-node.h>
 #include <ufo/ufo-remote-task.h>
 #include <ufo/ufo-resources.h>
 #include <ufo/ufo-scheduler.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-task-iface.h>
+#include "ufo-metrics.h"
 #include "ufo-priv.h"
 #include "compat.h"
 
@@ -53,6 +60,12 @@
 
 G_DEFINE_TYPE (UfoScheduler, ufo_scheduler, UFO_TYPE_BASE_SCHEDULER)
 
+/* Number of threads that run ufo_task_setup() concurrently */
+#define MAX_SETUP_THREADS       8
+
+/* Number of queue polls before a thread blocks in low-latency mode */
+#define LOW_LATENCY_SPIN_COUNT  256
+
 #define UFO_SCHEDULER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_SCHEDULER, UfoSchedulerPrivate))
 
 typedef struct {
@@ -62,8 +75,17 @@ typedef struct {
     guint           *dims;
     gboolean        *finished;
     gboolean         strict;
+    gint             cpu;
+    GCancellable    *cancellable;
+    gpointer         upload_queue;
+    gpointer         download_queue;
 } TaskLocalData;
 
+typedef struct {
+    UfoTask         *task;
+    GError          *error;
+} SetupJob;
+
 
 struct _UfoSchedulerPrivate {
     UfoRemoteMode    mode;
@@ -150,6 +172,20 @@ release_inputs (TaskLocalData *tld,
     }
 }
 
+static void
+stop_upstream (TaskLocalData *tld)
+{
+    UfoTaskNode *node = UFO_TASK_NODE (tld->task);
+
+    /* Several producers can feed one input, all of them must stop */
+    for (guint i = 0; i < tld->n_inputs; i++) {
+        GList *it;
+
+        g_list_for (ufo_task_node_get_in_groups (node, i), it)
+            ufo_group_set_target_done (UFO_GROUP (it->data), tld->task);
+    }
+}
+
 static gboolean
 any (gboolean *values,
      guint n_values)
@@ -216,6 +252,54 @@ run_remote_task (TaskLocalData *tld)
     ufo_remote_node_terminate (remote);
 }
 
+#ifdef __linux__
+static void
+pin_thread (gint cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO (&set);
+    CPU_SET (cpu, &set);
+
+    if (sched_setaffinity (0, sizeof (cpu_set_t), &set) != 0)
+        g_warning ("Could not pin thread to CPU %i", cpu);
+}
+#endif
+
+static void
+record_latency (TaskLocalData *tld,
+                UfoBuffer **inputs)
+{
+    gint64 timestamp;
+
+    if (tld->n_inputs == 0)
+        return;
+
+    timestamp = ufo_buffer_get_timestamp (inputs[0]);
+
+    if (timestamp > 0) {
+        UfoProfiler *profiler;
+
+        profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (tld->task));
+        ufo_profiler_record_latency (profiler, (g_get_monotonic_time () - timestamp) / 1e6);
+    }
+}
+
+static void
+set_transfer_queues (TaskLocalData *tld,
+                     UfoBuffer **inputs,
+                     UfoBuffer *output)
+{
+    if (tld->upload_queue == NULL)
+        return;
+
+    for (guint i = 0; i < tld->n_inputs; i++)
+        ufo_buffer_set_transfer_queues (inputs[i], tld->upload_queue, tld->download_queue);
+
+    if (output != NULL)
+        ufo_buffer_set_transfer_queues (output, tld->upload_queue, tld->download_queue);
+}
+
 static gpointer
 run_task (TaskLocalData *tld)
 {
@@ -231,6 +315,11 @@ run_task (TaskLocalData *tld)
     active = TRUE;
     output = NULL;
 
+#ifdef __linux__
+    if (tld->cpu >= 0)
+        pin_thread (tld->cpu);
+#endif
+
     if (UFO_IS_REMOTE_TASK (tld->task)) {
         run_remote_task (tld);
         return NULL;
@@ -245,6 +334,11 @@ run_task (TaskLocalData *tld)
 
         group = ufo_task_node_get_out_group (node);
 
+        if (g_cancellable_is_cancelled (tld->cancellable)) {
+            ufo_group_finish (group);
+            break;
+        }
+
         /* Get input buffers */
         active = get_inputs (tld, inputs);
 
@@ -258,20 +352,34 @@ run_task (TaskLocalData *tld)
 
         if (produces) {
             output = ufo_group_pop_output_buffer (group, &requisition);
-            g_assert (output != NULL);
+
+            /* The group was aborted */
+            if (output == NULL) {
+                ufo_group_finish (group);
+                break;
+            }
         }
 
         if (output != NULL) {
             ufo_buffer_discard_location (output);
 
+            /* Output buffers are reused, forget the age of the previous item */
+            ufo_buffer_set_timestamp (output, 0);
+
             for (guint i = 0; i < tld->n_inputs; i++)
                 ufo_buffer_copy_metadata (inputs[i], output);
         }
 
+        set_transfer_queues (tld, inputs, output);
+
         switch (mode) {
             case UFO_TASK_MODE_PROCESSOR:
+                active = ufo_task_process (tld->task, inputs, output, &requisition);
+                break;
+
             case UFO_TASK_MODE_SINK:
                 active = ufo_task_process (tld->task, inputs, output, &requisition);
+                record_latency (tld, inputs);
                 break;
 
             case UFO_TASK_MODE_REDUCTOR:
@@ -292,6 +400,11 @@ run_task (TaskLocalData *tld)
                         if (go_on) {
                             ufo_group_push_output_buffer (group, output);
                             output = ufo_group_pop_output_buffer (group, &requisition);
+
+                            if (output == NULL) {
+                                active = FALSE;
+                                go_on = FALSE;
+                            }
                         }
                     } while (go_on);
                 } while (active);
@@ -300,6 +413,10 @@ run_task (TaskLocalData *tld)
 
             case UFO_TASK_MODE_GENERATOR:
                 active = ufo_task_generate (tld->task, output, &requisition);
+
+                if (active)
+                    ufo_buffer_set_timestamp (output, g_get_monotonic_time ());
+
                 break;
 
             default:
@@ -313,10 +430,20 @@ run_task (TaskLocalData *tld)
         if (active)
             release_inputs (tld, inputs);
 
+        /* Nobody is interested in our results anymore */
+        if (active && produces && ufo_group_is_done (group))
+            active = FALSE;
+
         if (!active)
             ufo_group_finish (group);
     }
 
+    /*
+     * If we stopped before the end of the stream, e.g. because a sink has seen
+     * enough, producers upstream must not continue to work for us.
+     */
+    stop_upstream (tld);
+
     return NULL;
 }
 
@@ -382,6 +509,85 @@ check_target_connections (UfoTaskGraph *graph,
     return result;
 }
 
+static void
+setup_task (SetupJob *job,
+            UfoResources *resources)
+{
+    ufo_task_setup (job->task, resources, &job->error);
+}
+
+static gboolean
+setup_tasks_concurrently (GList *nodes,
+                          UfoResources *resources,
+                          GError **error)
+{
+    SetupJob *jobs;
+    GThreadPool *pool;
+    guint n_nodes;
+    gboolean success = TRUE;
+
+    n_nodes = g_list_length (nodes);
+    jobs = g_new0 (SetupJob, n_nodes);
+
+    /*
+     * Task setup is dominated by building OpenCL programs. Running it
+     * concurrently lets independent programs build in parallel while
+     * UfoResources makes sure identical programs are only built once.
+     */
+    pool = g_thread_pool_new ((GFunc) setup_task, resources,
+                              MAX_SETUP_THREADS, FALSE, error);
+
+    if (pool == NULL) {
+        g_free (jobs);
+        return FALSE;
+    }
+
+    for (guint i = 0; i < n_nodes; i++) {
+        jobs[i].task = UFO_TASK (g_list_nth_data (nodes, i));
+        g_thread_pool_push (pool, &jobs[i], NULL);
+    }
+
+    g_thread_pool_free (pool, FALSE, TRUE);
+
+    for (guint i = 0; i < n_nodes; i++) {
+        if (jobs[i].error == NULL)
+            continue;
+
+        if (success)
+            g_propagate_error (error, jobs[i].error);
+        else
+            g_error_free (jobs[i].error);
+
+        success = FALSE;
+    }
+
+    g_free (jobs);
+    return success;
+}
+
+#ifdef WITH_PYTHON
+static gboolean
+setup_tasks_sequentially (GList *nodes,
+                          UfoResources *resources,
+                          GError **error)
+{
+    GList *it;
+
+    g_list_for (nodes, it) {
+        GError *tmp_error = NULL;
+
+        ufo_task_setup (UFO_TASK (it->data), resources, &tmp_error);
+
+        if (tmp_error != NULL) {
+            g_propagate_error (error, tmp_error);
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+#endif
+
 static TaskLocalData **
 setup_tasks (UfoBaseScheduler *scheduler,
              UfoTaskGraph *task_graph,
@@ -392,6 +598,7 @@ setup_tasks (UfoBaseScheduler *scheduler,
     GList *nodes;
     guint n_nodes;
     gboolean tracing_enabled;
+    gboolean success;
 
     resources = ufo_base_scheduler_get_resources (scheduler);
     g_object_get (scheduler, "enable-tracing", &tracing_enabled, NULL);
@@ -399,18 +606,42 @@ setup_tasks (UfoBaseScheduler *scheduler,
     nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
     n_nodes = g_list_length (nodes);
 
+#ifdef WITH_PYTHON
+    /* Python tasks must be set up from the thread holding the GIL */
+    if (Py_IsInitialized ())
+        success = setup_tasks_sequentially (nodes, resources, error);
+    else
+        success = setup_tasks_concurrently (nodes, resources, error);
+#else
+    success = setup_tasks_concurrently (nodes, resources, error);
+#endif
+
+    if (!success) {
+        g_list_free (nodes);
+        return NULL;
+    }
+
     tlds = g_new0 (TaskLocalData *, n_nodes);
 
     for (guint i = 0; i < n_nodes; i++) {
         UfoNode *node;
+        UfoNode *proc_node;
         TaskLocalData *tld;
 
         node = g_list_nth_data (nodes, i);
         tld = g_new0 (TaskLocalData, 1);
         tld->task = UFO_TASK (node);
+        tld->cpu = -1;
+        tld->cancellable = ufo_base_scheduler_get_cancellable (scheduler);
         tlds[i] = tld;
 
-        ufo_task_setup (tld->task, resources, error);
+        proc_node = ufo_task_node_get_proc_node (UFO_TASK_NODE (node));
+
+        if (proc_node != NULL && UFO_IS_GPU_NODE (proc_node)) {
+            tld->upload_queue = ufo_gpu_node_get_upload_queue (UFO_GPU_NODE (proc_node));
+            tld->download_queue = ufo_gpu_node_get_download_queue (UFO_GPU_NODE (proc_node));
+        }
+
         tld->mode = ufo_task_get_mode (tld->task);
         tld->n_inputs = ufo_task_get_num_inputs (tld->task);
         tld->dims = g_new0 (guint, tld->n_inputs);
@@ -426,10 +657,6 @@ setup_tasks (UfoBaseScheduler *scheduler,
         }
 
         tld->finished = g_new0 (gboolean, tld->n_inputs);
-
-        if (error && *error != NULL) {
-            return NULL;
-        }
     }
 
     g_list_free (nodes);
@@ -437,6 +664,33 @@ setup_tasks (UfoBaseScheduler *scheduler,
     return tlds;
 }
 
+#ifdef __linux__
+static void
+assign_cpus (TaskLocalData **tlds,
+             guint n_tlds)
+{
+    cpu_set_t allowed;
+    gint cpus[CPU_SETSIZE];
+    guint n_cpus = 0;
+
+    if (sched_getaffinity (0, sizeof (cpu_set_t), &allowed) != 0) {
+        g_warning ("Could not determine CPU affinity, threads are not pinned");
+        return;
+    }
+
+    for (gint i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET (i, &allowed))
+            cpus[n_cpus++] = i;
+    }
+
+    if (n_cpus < n_tlds)
+        g_warning ("%u tasks but only %u CPUs, pinned threads will share CPUs", n_tlds, n_cpus);
+
+    for (guint i = 0; i < n_tlds && n_cpus > 0; i++)
+        tlds[i]->cpu = cpus[i % n_cpus];
+}
+#endif
+
 static GList *
 setup_groups (UfoBaseScheduler *scheduler,
               UfoTaskGraph *task_graph)
@@ -446,11 +700,18 @@ setup_groups (UfoBaseScheduler *scheduler,
     GList *nodes;
     GList *it;
     cl_context context;
+    gboolean low_latency;
 
+    g_object_get (scheduler, "low-latency", &low_latency, NULL);
     groups = NULL;
     nodes = ufo_graph_get_nodes (UFO_GRAPH (task_graph));
     resources = ufo_base_scheduler_get_resources (scheduler);
-    context = ufo_resources_get_context (resources);
+
+    /*
+     * Host-only buffers do not need a context, so avoid initializing OpenCL.
+     * Groups accept a NULL context and their buffers then stay on the host.
+     */
+    context = ufo_any_task_uses_gpu (nodes) ? ufo_resources_get_context (resources) : NULL;
 
     g_list_for (nodes, it) {
         GList *successors;
@@ -465,6 +726,13 @@ setup_groups (UfoBaseScheduler *scheduler,
 
         group = ufo_group_new (successors, context, pattern);
         groups = g_list_append (groups, group);
+        ufo_group_set_profiler (group, ufo_task_node_get_profiler (UFO_TASK_NODE (node)));
+
+        if (low_latency) {
+            ufo_group_set_queue_depth (group, 1);
+            ufo_group_set_spin_count (group, LOW_LATENCY_SPIN_COUNT);
+        }
+
         ufo_task_node_set_out_group (UFO_TASK_NODE (node), group);
 
         g_list_for (successors, jt) {
@@ -479,6 +747,9 @@ setup_groups (UfoBaseScheduler *scheduler,
             ufo_group_set_num_expected (group, UFO_TASK (target),
                                         ufo_task_node_get_num_expected (UFO_TASK_NODE (target),
                                                                         input));
+            ufo_group_set_overflow_policy (group, UFO_TASK (target),
+                                           ufo_task_node_get_overflow_policy (UFO_TASK_NODE (target),
+                                                                              input));
         }
 
         g_list_free (successors);
@@ -568,6 +839,47 @@ propagate_partition (UfoTaskGraph *graph)
     g_list_free (nodes);
 }
 
+static void
+abort_groups (GCancellable *cancellable,
+              GList *groups)
+{
+    g_list_foreach (groups, (GFunc) ufo_group_abort, NULL);
+}
+
+static void
+collect_queue_stats (UfoTaskGraph *graph)
+{
+    GList *nodes;
+    GList *it;
+
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+
+    g_list_for (nodes, it) {
+        UfoNode *node;
+        UfoGroup *group;
+        GList *successors;
+        GList *jt;
+
+        node = UFO_NODE (it->data);
+        group = ufo_task_node_get_out_group (UFO_TASK_NODE (node));
+        successors = ufo_graph_get_successors (UFO_GRAPH (graph), node);
+
+        g_list_for (successors, jt) {
+            UfoTwoWayQueueStats stats;
+            UfoTaskNode *target;
+
+            target = UFO_TASK_NODE (jt->data);
+
+            if (ufo_group_get_queue_stats (group, UFO_TASK (target), &stats))
+                ufo_profiler_set_queue_stats (ufo_task_node_get_profiler (target), node, &stats);
+        }
+
+        g_list_free (successors);
+    }
+
+    g_list_free (nodes);
+}
+
 static void
 join_threads (GThread **threads, guint n_threads)
 {
@@ -583,24 +895,35 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
     UfoSchedulerPrivate *priv;
     UfoResources *resources;
     UfoTaskGraph *graph;
+    GList *nodes;
     GList *gpu_nodes;
     GList *groups;
     guint n_nodes;
-    GThread **threads;
+    GThread **threads = NULL;
     TaskLocalData **tlds;
+    GCancellable *cancellable;
+    UfoMetrics *metrics = NULL;
+    gulong abort_handler;
     gboolean expand;
     gboolean trace;
+    gboolean low_latency;
+    gchar *metrics_file;
+    guint metrics_port;
+    gdouble metrics_interval;
 
     priv = UFO_SCHEDULER_GET_PRIVATE (scheduler);
 
     g_object_get (scheduler,
                   "enable-tracing", &trace,
                   "expand", &expand,
+                  "low-latency", &low_latency,
                   NULL);
 
     graph = task_graph;
     resources = ufo_base_scheduler_get_resources (scheduler);
-    gpu_nodes = ufo_resources_get_gpu_nodes (resources);
+    nodes = ufo_graph_get_nodes (UFO_GRAPH (graph));
+    gpu_nodes = ufo_any_task_uses_gpu (nodes) ? ufo_resources_get_gpu_nodes (resources) : NULL;
+    g_list_free (nodes);
 
     if (priv->mode == UFO_REMOTE_MODE_REPLICATE) {
         replicate_task_graph (graph, resources);
@@ -625,20 +948,52 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
         return;
     }
 
+    n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (graph));
     groups = setup_groups (scheduler, graph);
 
     if (!correct_connections (graph, error))
-        return;
+        goto ufo_scheduler_run_free;
+
+    g_object_get (scheduler,
+                  "metrics-file", &metrics_file,
+                  "metrics-port", &metrics_port,
+                  "metrics-interval", &metrics_interval,
+                  NULL);
+
+    if (metrics_file != NULL || metrics_port > 0) {
+        metrics = ufo_metrics_new (graph, metrics_file, metrics_port, metrics_interval, error);
+
+        if (metrics == NULL) {
+            g_free (metrics_file);
+            goto ufo_scheduler_run_free;
+        }
+    }
+
+    g_free (metrics_file);
 
-    n_nodes = ufo_graph_get_num_nodes (UFO_GRAPH (graph));
     threads = g_new0 (GThread *, n_nodes);
 
+    /* Wake up all blocked threads when the run is aborted */
+    cancellable = ufo_base_scheduler_get_cancellable (scheduler);
+    abort_handler = g_cancellable_connect (cancellable, G_CALLBACK (abort_groups), groups, NULL);
+
+#ifdef __linux__
+    if (low_latency)
+        assign_cpus (tlds, n_nodes);
+#endif
+
     /* Spawn threads */
     for (guint i = 0; i < n_nodes; i++) {
         threads[i] = g_thread_create ((GThreadFunc) run_task, tlds[i], TRUE, error);
 
-        if (error && (*error != NULL))
+        if (error && (*error != NULL)) {
+            g_cancellable_disconnect (cancellable, abort_handler);
+
+            if (metrics != NULL)
+                ufo_metrics_free (metrics);
+
             return;
+        }
     }
 
 #ifdef WITH_PYTHON
@@ -659,12 +1014,19 @@ ufo_scheduler_run (UfoBaseScheduler *scheduler,
 #endif
 
     /* Cleanup */
+    g_cancellable_disconnect (cancellable, abort_handler);
+
+    if (metrics != NULL)
+        ufo_metrics_free (metrics);
+
+    collect_queue_stats (graph);
+    priv->ran = TRUE;
+
+ufo_scheduler_run_free:
     cleanup_task_local_data (tlds, n_nodes);
     g_list_foreach (groups, (GFunc) g_object_unref, NULL);
     g_list_free (groups);
     g_free (threads);
-
-    priv->ran = TRUE;
 }
 
 static void
@@ -0,0 +1,511 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+
+#ifdef __APPLE__
+#include <OpenCL/cl.h>
+#else
+#include <CL/cl.h>
+#endif
+
+#include <ufo/ufo-synthetic-task.h>
+
+/**
+ * SECTION:ufo-synthetic-task
+ * @Short_description: Task with configurable cost
+ * @Title: UfoSyntheticTask
+ *
+ * A #UfoSyntheticTask stands in for real tasks when benchmarking or load
+ * testing the runtime. It can act as a generator, processor, reductor or sink,
+ * produces buffers of a given size without computing their contents and spends
+ * a configurable amount of CPU time and memory traffic per item. The cost can
+ * be varied randomly per item with the #UfoSyntheticTask:jitter property. The
+ * task is available as `synthetic' from JSON and ufo-launch, e.g.
+ *
+ * |[
+ * ufo-launch synthetic mode=generator number=1000 ! synthetic cpu-time=500 ! synthetic mode=sink
+ * ]|
+ */
+
+typedef enum {
+    JITTER_NONE = 0,
+    JITTER_UNIFORM,
+    JITTER_NORMAL,
+    JITTER_EXPONENTIAL
+} Jitter;
+
+static const gchar *mode_names[] = { "generator", "processor", "reductor", "sink", NULL };
+
+static const UfoTaskMode modes[] = {
+    UFO_TASK_MODE_GENERATOR,
+    UFO_TASK_MODE_PROCESSOR,
+    UFO_TASK_MODE_REDUCTOR,
+    UFO_TASK_MODE_SINK
+};
+
+static const gchar *jitter_names[] = { "none", "uniform", "normal", "exponential", NULL };
+
+struct _UfoSyntheticTaskPrivate {
+    UfoTaskMode mode;
+    guint number;
+    guint width;
+    guint height;
+    gdouble cpu_time;
+    guint touch_bytes;
+    Jitter jitter;
+    gdouble jitter_amount;
+    guint seed;
+
+    GRand *rand;
+    guint8 *scratch;
+    gsize scratch_size;
+    guint current;
+};
+
+static void ufo_task_interface_init (UfoTaskIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (UfoSyntheticTask, ufo_synthetic_task, UFO_TYPE_TASK_NODE,
+                         G_IMPLEMENT_INTERFACE (UFO_TYPE_TASK,
+                                                ufo_task_interface_init))
+
+#define UFO_SYNTHETIC_TASK_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), UFO_TYPE_SYNTHETIC_TASK, UfoSyntheticTaskPrivate))
+
+enum {
+    PROP_0,
+    PROP_MODE,
+    PROP_NUMBER,
+    PROP_WIDTH,
+    PROP_HEIGHT,
+    PROP_CPU_TIME,
+    PROP_TOUCH_BYTES,
+    PROP_JITTER,
+    PROP_JITTER_AMOUNT,
+    PROP_SEED,
+    N_PROPERTIES
+};
+
+static GParamSpec *properties[N_PROPERTIES] = { NULL, };
+
+UfoNode *
+ufo_synthetic_task_new (void)
+{
+    return UFO_NODE (g_object_new (UFO_TYPE_SYNTHETIC_TASK, NULL));
+}
+
+static gint
+find_name (const gchar **names,
+           const gchar *name)
+{
+    for (gint i = 0; names[i] != NULL; i++) {
+        if (!g_strcmp0 (names[i], name))
+            return i;
+    }
+
+    return -1;
+}
+
+static gdouble
+draw_scale (UfoSyntheticTaskPrivate *priv)
+{
+    gdouble scale = 1.0;
+
+    switch (priv->jitter) {
+        case JITTER_UNIFORM:
+            scale = 1.0 + priv->jitter_amount * g_rand_double_range (priv->rand, -1.0, 1.0);
+            break;
+
+        case JITTER_NORMAL:
+            {
+                /* Box-Muller, the first sample must not be zero */
+                gdouble u = 1.0 - g_rand_double (priv->rand);
+                gdouble v = g_rand_double (priv->rand);
+
+                scale = 1.0 + priv->jitter_amount * sqrt (-2.0 * log (u)) * cos (2.0 * G_PI * v);
+            }
+            break;
+
+        case JITTER_EXPONENTIAL:
+            scale = -log (1.0 - g_rand_double (priv->rand));
+            break;
+
+        default:
+            break;
+    }
+
+    return MAX (scale, 0.0);
+}
+
+static void
+spend (UfoSyntheticTaskPrivate *priv)
+{
+    gdouble scale;
+    gsize n_bytes;
+
+    if (priv->cpu_time <= 0.0 && priv->touch_bytes == 0)
+        return;
+
+    scale = draw_scale (priv);
+    n_bytes = (gsize) (scale * priv->touch_bytes);
+
+    if (n_bytes > priv->scratch_size) {
+        priv->scratch = g_realloc (priv->scratch, n_bytes);
+        priv->scratch_size = n_bytes;
+    }
+
+    /* One write per cache line is enough to move the memory through the caches */
+    for (gsize i = 0; i < n_bytes; i += 64)
+        priv->scratch[i]++;
+
+    if (priv->cpu_time > 0.0) {
+        gint64 end;
+
+        end = g_get_monotonic_time () + (gint64) (scale * priv->cpu_time);
+
+        while (g_get_monotonic_time () < end)
+            ;
+    }
+}
+
+static void
+ufo_synthetic_task_setup (UfoTask *task,
+                          UfoResources *resources,
+                          GError **error)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (task);
+    priv->current = 0;
+
+    /* Copies of an expanded graph draw different but reproducible costs */
+    if (priv->rand != NULL)
+        g_rand_free (priv->rand);
+
+    priv->rand = g_rand_new_with_seed (priv->seed + ufo_node_get_index (UFO_NODE (task)));
+}
+
+static void
+ufo_synthetic_task_get_requisition (UfoTask *task,
+                                    UfoBuffer **inputs,
+                                    UfoRequisition *requisition)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (task);
+
+    if (priv->mode == UFO_TASK_MODE_SINK) {
+        requisition->n_dims = 0;
+        return;
+    }
+
+    requisition->n_dims = 2;
+    requisition->dims[0] = priv->width;
+    requisition->dims[1] = priv->height;
+}
+
+static guint
+ufo_synthetic_task_get_num_inputs (UfoTask *task)
+{
+    return UFO_SYNTHETIC_TASK_GET_PRIVATE (task)->mode == UFO_TASK_MODE_GENERATOR ? 0 : 1;
+}
+
+static guint
+ufo_synthetic_task_get_num_dimensions (UfoTask *task,
+                                       guint input)
+{
+    return 2;
+}
+
+static UfoTaskMode
+ufo_synthetic_task_get_mode (UfoTask *task)
+{
+    return UFO_SYNTHETIC_TASK_GET_PRIVATE (task)->mode | UFO_TASK_MODE_CPU;
+}
+
+static gboolean
+ufo_synthetic_task_process (UfoTask *task,
+                            UfoBuffer **inputs,
+                            UfoBuffer *output,
+                            UfoRequisition *requisition)
+{
+    spend (UFO_SYNTHETIC_TASK_GET_PRIVATE (task));
+    return TRUE;
+}
+
+static gboolean
+ufo_synthetic_task_generate (UfoTask *task,
+                             UfoBuffer *output,
+                             UfoRequisition *requisition)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (task);
+
+    if (priv->current >= priv->number)
+        return FALSE;
+
+    /* Reductors already paid for each of their inputs */
+    if (priv->mode == UFO_TASK_MODE_GENERATOR)
+        spend (priv);
+
+    priv->current++;
+    return TRUE;
+}
+
+static void
+ufo_synthetic_task_set_property (GObject *object,
+                                 guint property_id,
+                                 const GValue *value,
+                                 GParamSpec *pspec)
+{
+    UfoSyntheticTaskPrivate *priv;
+    gint pos;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (object);
+
+    switch (property_id) {
+        case PROP_MODE:
+            pos = find_name (mode_names, g_value_get_string (value));
+
+            if (pos >= 0)
+                priv->mode = modes[pos];
+            else
+                g_warning ("`%s' is not a valid mode", g_value_get_string (value));
+            break;
+
+        case PROP_NUMBER:
+            priv->number = g_value_get_uint (value);
+            break;
+
+        case PROP_WIDTH:
+            priv->width = g_value_get_uint (value);
+            break;
+
+        case PROP_HEIGHT:
+            priv->height = g_value_get_uint (value);
+            break;
+
+        case PROP_CPU_TIME:
+            priv->cpu_time = g_value_get_double (value);
+            break;
+
+        case PROP_TOUCH_BYTES:
+            priv->touch_bytes = g_value_get_uint (value);
+            break;
+
+        case PROP_JITTER:
+            pos = find_name (jitter_names, g_value_get_string (value));
+
+            if (pos >= 0)
+                priv->jitter = (Jitter) pos;
+            else
+                g_warning ("`%s' is not a valid jitter distribution", g_value_get_string (value));
+            break;
+
+        case PROP_JITTER_AMOUNT:
+            priv->jitter_amount = g_value_get_double (value);
+            break;
+
+        case PROP_SEED:
+            priv->seed = g_value_get_uint (value);
+            break;
+
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+ufo_synthetic_task_get_property (GObject *object,
+                                 guint property_id,
+                                 GValue *value,
+                                 GParamSpec *pspec)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (object);
+
+    switch (property_id) {
+        case PROP_MODE:
+            for (guint i = 0; mode_names[i] != NULL; i++) {
+                if (modes[i] == priv->mode)
+                    g_value_set_string (value, mode_names[i]);
+            }
+            break;
+
+        case PROP_NUMBER:
+            g_value_set_uint (value, priv->number);
+            break;
+
+        case PROP_WIDTH:
+            g_value_set_uint (value, priv->width);
+            break;
+
+        case PROP_HEIGHT:
+            g_value_set_uint (value, priv->height);
+            break;
+
+        case PROP_CPU_TIME:
+            g_value_set_double (value, priv->cpu_time);
+            break;
+
+        case PROP_TOUCH_BYTES:
+            g_value_set_uint (value, priv->touch_bytes);
+            break;
+
+        case PROP_JITTER:
+            g_value_set_string (value, jitter_names[priv->jitter]);
+            break;
+
+        case PROP_JITTER_AMOUNT:
+            g_value_set_double (value, priv->jitter_amount);
+            break;
+
+        case PROP_SEED:
+            g_value_set_uint (value, priv->seed);
+            break;
+
+        default:
+            G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+            break;
+    }
+}
+
+static void
+ufo_synthetic_task_finalize (GObject *object)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (object);
+
+    if (priv->rand != NULL) {
+        g_rand_free (priv->rand);
+        priv->rand = NULL;
+    }
+
+    g_free (priv->scratch);
+    priv->scratch = NULL;
+
+    G_OBJECT_CLASS (ufo_synthetic_task_parent_class)->finalize (object);
+}
+
+static void
+ufo_task_interface_init (UfoTaskIface *iface)
+{
+    iface->setup = ufo_synthetic_task_setup;
+    iface->get_num_inputs = ufo_synthetic_task_get_num_inputs;
+    iface->get_num_dimensions = ufo_synthetic_task_get_num_dimensions;
+    iface->get_mode = ufo_synthetic_task_get_mode;
+    iface->get_requisition = ufo_synthetic_task_get_requisition;
+    iface->process = ufo_synthetic_task_process;
+    iface->generate = ufo_synthetic_task_generate;
+}
+
+static void
+ufo_synthetic_task_class_init (UfoSyntheticTaskClass *klass)
+{
+    GObjectClass *oclass = G_OBJECT_CLASS (klass);
+
+    oclass->set_property = ufo_synthetic_task_set_property;
+    oclass->get_property = ufo_synthetic_task_get_property;
+    oclass->finalize = ufo_synthetic_task_finalize;
+
+    properties[PROP_MODE] =
+        g_param_spec_string ("mode",
+                             "Task mode",
+                             "Task mode: \"generator\", \"processor\", \"reductor\" or \"sink\"",
+                             "processor", G_PARAM_READWRITE);
+
+    properties[PROP_NUMBER] =
+        g_param_spec_uint ("number",
+                           "Number of items",
+                           "Number of items a generator produces or a reductor produces after its input ended",
+                           0, G_MAXUINT, 1, G_PARAM_READWRITE);
+
+    properties[PROP_WIDTH] =
+        g_param_spec_uint ("width",
+                           "Width of the output",
+                           "Width of the output",
+                           1, G_MAXUINT, 512, G_PARAM_READWRITE);
+
+    properties[PROP_HEIGHT] =
+        g_param_spec_uint ("height",
+                           "Height of the output",
+                           "Height of the output",
+                           1, G_MAXUINT, 512, G_PARAM_READWRITE);
+
+    properties[PROP_CPU_TIME] =
+        g_param_spec_double ("cpu-time",
+                             "CPU time per item in microseconds",
+                             "Time in microseconds the task keeps a CPU busy per item",
+                             0.0, G_MAXDOUBLE, 0.0, G_PARAM_READWRITE);
+
+    properties[PROP_TOUCH_BYTES] =
+        g_param_spec_uint ("touch-bytes",
+                           "Bytes of memory touched per item",
+                           "Bytes of scratch memory the task writes to per item",
+                           0, G_MAXUINT, 0, G_PARAM_READWRITE);
+
+    properties[PROP_JITTER] =
+        g_param_spec_string ("jitter",
+                             "Distribution of the cost",
+                             "Distribution of the cost per item: \"none\", \"uniform\", \"normal\" or \"exponential\"",
+                             "none", G_PARAM_READWRITE);
+
+    properties[PROP_JITTER_AMOUNT] =
+        g_param_spec_double ("jitter-amount",
+                             "Relative spread of the cost",
+                             "Half width of uniform or standard deviation of normal jitter relative to the cost",
+                             0.0, G_MAXDOUBLE, 0.1, G_PARAM_READWRITE);
+
+    properties[PROP_SEED] =
+        g_param_spec_uint ("seed",
+                           "Seed of the jitter",
+                           "Seed of the jitter, copies of the task add their index",
+                           0, G_MAXUINT, 0, G_PARAM_READWRITE);
+
+    for (guint i = PROP_0 + 1; i < N_PROPERTIES; i++)
+        g_object_class_install_property (oclass, i, properties[i]);
+
+    g_type_class_add_private (oclass, sizeof(UfoSyntheticTaskPrivate));
+}
+
+static void
+ufo_synthetic_task_init (UfoSyntheticTask *task)
+{
+    UfoSyntheticTaskPrivate *priv;
+
+    task->priv = priv = UFO_SYNTHETIC_TASK_GET_PRIVATE (task);
+    priv->mode = UFO_TASK_MODE_PROCESSOR;
+    priv->number = 1;
+    priv->width = 512;
+    priv->height = 512;
+    priv->cpu_time = 0.0;
+    priv->touch_bytes = 0;
+    priv->jitter = JITTER_NONE;
+    priv->jitter_amount = 0.1;
+    priv->seed = 0;
+    priv->rand = NULL;
+    priv->scratch = NULL;
+    priv->scratch_size = 0;
+    priv->current = 0;
+
+    ufo_task_node_set_plugin_name (UFO_TASK_NODE (task), "synthetic");
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __UFO_SYNTHETIC_TASK_H
+#define __UFO_SYNTHETIC_TASK_H
+
+#if !defined (__UFO_H_INSIDE__) && !defined (UFO_COMPILATION)
+#error "Only <ufo/ufo.h> can be included directly."
+#endif
+
+#include <ufo/ufo-task-node.h>
+
+G_BEGIN_DECLS
+
+#define UFO_TYPE_SYNTHETIC_TASK             (ufo_synthetic_task_get_type())
+#define UFO_SYNTHETIC_TASK(obj)             (G_TYPE_CHECK_INSTANCE_CAST((obj), UFO_TYPE_SYNTHETIC_TASK, UfoSyntheticTask))
+#define UFO_IS_SYNTHETIC_TASK(obj)          (G_TYPE_CHECK_INSTANCE_TYPE((obj), UFO_TYPE_SYNTHETIC_TASK))
+#define UFO_SYNTHETIC_TASK_CLASS(klass)     (G_TYPE_CHECK_CLASS_CAST((klass), UFO_TYPE_SYNTHETIC_TASK, UfoSyntheticTaskClass))
+#define UFO_IS_SYNTHETIC_TASK_CLASS(klass)  (G_TYPE_CHECK_CLASS_TYPE((klass), UFO_TYPE_SYNTHETIC_TASK))
+#define UFO_SYNTHETIC_TASK_GET_CLASS(obj)   (G_TYPE_INSTANCE_GET_CLASS((obj), UFO_TYPE_SYNTHETIC_TASK, UfoSyntheticTaskClass))
+
+typedef struct _UfoSyntheticTask           UfoSyntheticTask;
+typedef struct _UfoSyntheticTaskClass      UfoSyntheticTaskClass;
+typedef struct _UfoSyntheticTaskPrivate    UfoSyntheticTaskPrivate;
+
+/**
+ * UfoSyntheticTask:
+ *
+ * Task with a configurable mode, output size and cost per item. The contents
+ * of the #UfoSyntheticTask structure are private and should only be accessed
+ * via the provided API.
+ */
+struct _UfoSyntheticTask {
+    /*< private >*/
+    UfoTaskNode parent_instance;
+
+    UfoSyntheticTaskPrivate *priv;
+};
+
+/**
+ * UfoSyntheticTaskClass:
+ *
+ * #UfoSyntheticTask class
+ */
+struct _UfoSyntheticTaskClass {
+    /*< private >*/
+    UfoTaskNodeClass parent_class;
+};
+
+UfoNode   * ufo_synthetic_task_new      (void);
+GType       ufo_synthetic_task_get_type (void);
+
+G_END_DECLS
+
+#endif
@@ -26,6 +26,7 @@
 #include <ufo/ufo-input-task.h>
 #include <ufo/ufo-dummy-task.h>
 #include <ufo/ufo-remote-task.h>
+#include <ufo/ufo-enums.h>
 #include "compat.h"
 
 /**
@@ -217,6 +218,7 @@ get_json_representation (UfoTaskGraph *graph,
         g_list_for (successors, jt) {
             UfoNode *to;
             gint port;
+            UfoOverflowPolicy policy;
             JsonObject *to_object;
             JsonObject *from_object;
             JsonObject *edge_object;
@@ -230,6 +232,17 @@ get_json_representation (UfoTaskGraph *graph,
             json_object_set_int_member (to_object, "input", port);
             json_object_set_object_member (edge_object, "to", to_object);
             json_object_set_object_member (edge_object, "from", from_object);
+
+            policy = ufo_task_node_get_overflow_policy (UFO_TASK_NODE (to), (guint) port);
+
+            if (policy != UFO_OVERFLOW_BLOCK) {
+                GEnumClass *enum_class;
+
+                enum_class = g_type_class_ref (UFO_TYPE_OVERFLOW_POLICY);
+                json_object_set_string_member (edge_object, "overflow",
+                                               g_enum_get_value (enum_class, policy)->value_nick);
+                g_type_class_unref (enum_class);
+            }
             json_array_add_object_element (edges, edge_object);
         }
 
@@ -510,7 +523,8 @@ map_proc_node (UfoGraph *graph,
 
     proc_node = UFO_NODE (g_list_nth_data (gpu_nodes, proc_index));
 
-    if ((ufo_task_uses_gpu (UFO_TASK (node)) || UFO_IS_INPUT_TASK (node)) &&
+    if (proc_node != NULL &&
+        (ufo_task_uses_gpu (UFO_TASK (node)) || UFO_IS_INPUT_TASK (node)) &&
         (!ufo_task_node_get_proc_node (UFO_TASK_NODE (node)))) {
 
         g_debug ("Mapping UfoGpuNode-%p to %s-%p",
@@ -886,6 +900,23 @@ handle_json_task_edge (JsonArray *array,
 
     ufo_task_graph_connect_nodes_full (graph, from_node, to_node, to_port);
 
+    if (json_object_has_member (edge, "overflow")) {
+        GEnumClass *enum_class;
+        GEnumValue *policy;
+        const gchar *name;
+
+        enum_class = g_type_class_ref (UFO_TYPE_OVERFLOW_POLICY);
+        name = json_object_get_string_member (edge, "overflow");
+        policy = g_enum_get_value_by_nick (enum_class, name);
+
+        if (policy != NULL)
+            ufo_task_node_set_overflow_policy (to_node, to_port, policy->value);
+        else
+            g_warning ("Unknown overflow policy `%s', use `block', `drop-oldest' or `drop-newest'", name);
+
+        g_type_class_unref (enum_class);
+    }
+
     if (error != NULL)
         g_warning ("%s", error->message);
 }
@@ -20,6 +20,7 @@
 #include <ufo/ufo-task-iface.h>
 #include <ufo/ufo-task-node.h>
 #include <ufo/ufo-misc.h>
+#include "ufo-trace.h"
 
 /**
  * SECTION:ufo-task-iface
@@ -64,6 +65,7 @@ ufo_task_setup (UfoTask *task,
     GError *tmp_error = NULL;
 
     ufo_task_node_setup (UFO_TASK_NODE (task));
+    ufo_profiler_set_resources (ufo_task_node_get_profiler (UFO_TASK_NODE (task)), resources);
     UFO_TASK_GET_IFACE (task)->setup (task, resources, &tmp_error);
 
     if (tmp_error != NULL) {
@@ -115,10 +117,13 @@ ufo_task_process (UfoTask *task,
 {
     UfoProfiler *profiler;
     gboolean result;
+    guint64 start;
 
     profiler = ufo_task_node_get_profiler (UFO_TASK_NODE (task));
     ufo_profiler_trace_event (profiler, UFO_TRACE_EVENT_PROCESS | UFO_TRACE_EVENT_BEGIN);
+    start = ufo_trace_now ();
     result = UFO_TASK_GET_IFACE (task)->process (task, inputs, output, requisition);
+    ufo_profiler_record_duration (profiler, UFO_PROFILER_HISTOGRAM_PROCESS, (ufo_trace_now () - start) * 1e-9);
     ufo_profiler_trace_event (profiler, UFO_TRACE_EVENT_PROCESS | UFO_TRACE_EVENT_END);
 
     ufo_signal_emit (task, signals[PROCESSED], 0);
@@ -134,10 +139,17 @@ ufo_task_generate (UfoTask *task,
 {
     UfoProfiler *profiler;
     gboolean result;
+    guint64 start;
 
     profiler = ufo_task_node_get_profiler (UFO_TASK_NODE(task));
     ufo_profiler_trace_event (profiler, UFO_TRACE_EVENT_GENERATE | UFO_TRACE_EVENT_BEGIN);
+    start = ufo_trace_now ();
     result = UFO_TASK_GET_IFACE (task)->generate (task, output, requisition);
+
+    /* The final call only reports that there is nothing left to generate */
+    if (result)
+        ufo_profiler_record_duration (profiler, UFO_PROFILER_HISTOGRAM_GENERATE, (ufo_trace_now () - start) * 1e-9);
+
     ufo_profiler_trace_event (profiler, UFO_TRACE_EVENT_GENERATE | UFO_TRACE_EVENT_END);
 
     ufo_signal_emit (task, signals[GENERATED], 0);
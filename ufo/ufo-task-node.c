@@ -49,6 +49,7 @@ struct _UfoTaskNodePrivate {
     GList           *in_groups[16];
     GList           *current[16];
     gint             n_expected[16];
+    UfoOverflowPolicy overflow[16];
     guint            index;
     guint            total;
     guint            num_processed;
@@ -143,6 +144,33 @@ ufo_task_node_get_num_expected (UfoTaskNode *node,
     return node->priv->n_expected[pos];
 }
 
+/**
+ * ufo_task_node_set_overflow_policy:
+ * @node: A #UfoTaskNode
+ * @pos: Input port
+ * @policy: Policy for the edge connected to @pos
+ *
+ * Decide what happens if the producer connected to input @pos outruns @node.
+ */
+void
+ufo_task_node_set_overflow_policy (UfoTaskNode *node,
+                                   guint pos,
+                                   UfoOverflowPolicy policy)
+{
+    g_return_if_fail (UFO_IS_TASK_NODE (node));
+    g_return_if_fail (pos < 16);
+    node->priv->overflow[pos] = policy;
+}
+
+UfoOverflowPolicy
+ufo_task_node_get_overflow_policy (UfoTaskNode *node,
+                                   guint pos)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), UFO_OVERFLOW_BLOCK);
+    g_return_val_if_fail (pos < 16, UFO_OVERFLOW_BLOCK);
+    return node->priv->overflow[pos];
+}
+
 void
 ufo_task_node_set_out_group (UfoTaskNode *node,
                              UfoGroup *group)
@@ -221,6 +249,25 @@ ufo_task_node_get_current_in_group (UfoTaskNode *node,
     return UFO_GROUP (node->priv->current[pos]->data);
 }
 
+/**
+ * ufo_task_node_get_in_groups:
+ * @node: A #UfoTaskNode
+ * @pos: Input position of @node
+ *
+ * Get all groups connected to input @pos of @node.
+ *
+ * Return value: (transfer none) (element-type UfoGroup): The in groups of
+ * @node for @pos.
+ */
+GList *
+ufo_task_node_get_in_groups (UfoTaskNode *node,
+                             guint pos)
+{
+    g_return_val_if_fail (UFO_IS_TASK_NODE (node), NULL);
+    g_assert (pos < 16);
+    return node->priv->in_groups[pos];
+}
+
 void
 ufo_task_node_switch_in_group (UfoTaskNode *node,
                                guint pos)
@@ -326,8 +373,10 @@ ufo_task_node_copy (UfoNode *node,
 
     copy->priv->pattern = orig->priv->pattern;
 
-    for (guint i = 0; i < 16; i++)
+    for (guint i = 0; i < 16; i++) {
         copy->priv->n_expected[i] = orig->priv->n_expected[i];
+        copy->priv->overflow[i] = orig->priv->overflow[i];
+    }
 
     ufo_task_node_set_plugin_name (copy, orig->priv->plugin);
 
@@ -434,5 +483,6 @@ ufo_task_node_init (UfoTaskNode *self)
         self->priv->in_groups[i] = NULL;
         self->priv->current[i] = NULL;
         self->priv->n_expected[i] = -1;
+        self->priv->overflow[i] = UFO_OVERFLOW_BLOCK;
     }
 }
@@ -85,6 +85,12 @@ void            ufo_task_node_set_num_expected      (UfoTaskNode    *node,
                                                      gint            n_expected);
 gint            ufo_task_node_get_num_expected      (UfoTaskNode    *node,
                                                      guint           pos);
+void            ufo_task_node_set_overflow_policy   (UfoTaskNode    *node,
+                                                     guint           pos,
+                                                     UfoOverflowPolicy policy);
+UfoOverflowPolicy
+                ufo_task_node_get_overflow_policy   (UfoTaskNode    *node,
+                                                     guint           pos);
 void            ufo_task_node_set_out_group         (UfoTaskNode    *node,
                                                      UfoGroup       *group);
 UfoGroup       *ufo_task_node_get_out_group         (UfoTaskNode    *node);
@@ -93,6 +99,8 @@ void            ufo_task_node_add_in_group          (UfoTaskNode    *node,
                                                      UfoGroup       *group);
 UfoGroup       *ufo_task_node_get_current_in_group  (UfoTaskNode    *node,
                                                      guint           pos);
+GList          *ufo_task_node_get_in_groups         (UfoTaskNode    *node,
+                                                     guint           pos);
 void            ufo_task_node_switch_in_group       (UfoTaskNode    *node,
                                                      guint           pos);
 void            ufo_task_node_set_proc_node         (UfoTaskNode    *task_node,
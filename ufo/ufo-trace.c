@@ -0,0 +1,977 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <errno.h>
+#include <time.h>
+#include <string.h>
+#include "ufo/ufo-profiler.h"
+#include "ufo-trace.h"
+
+/*
+ * Tracing is designed to be cheap enough to leave on. Every thread that emits
+ * records owns a fixed-size single-producer/single-consumer ring buffer, so
+ * recording an event is a clock read, a copy and an atomic store. A
+ * background thread drains all rings into per-thread spill arrays while the
+ * pipeline runs. Since each thread's records are already ordered by time, the
+ * complete trace is obtained with a k-way merge of these arrays. If a ring is
+ * full because the drainer could not keep up, the record is dropped and
+ * counted rather than blocking the producer. When a thread exits, its ring
+ * is drained and handed to the next thread that starts recording, so the
+ * number of rings is bounded by the number of concurrently recording threads.
+ * Rings of finished threads are released when the next trace starts.
+ *
+ * For long-running pipelines the records do not have to be kept at all: if a
+ * trace file is given to ufo_trace_start(), the drainer writes each batch to
+ * disk in the Chrome trace format and discards it, so memory use does not
+ * grow with the run time. Batches are ordered internally but may overlap
+ * slightly at their boundaries, which the trace viewers do not mind.
+ *
+ * OpenCL commands are written to the same file so that host stalls can be
+ * related to kernels and transfers. Device clocks are unrelated to the host
+ * clock, hence each command queue is registered with the offset between the
+ * two, estimated when the queue was created. Host records are shown in one
+ * process, commands in one process per device with a thread per queue and
+ * task node. Memory allocated by each node is shown as a counter of the host
+ * or device process. Statistics of the queues between nodes are appended as a
+ * "ufoEdges" list next to the events, which trace viewers ignore.
+ *
+ * Events are formatted while the tracer lock is held but written to the file
+ * after it was released, so that threads recording or registering queues do
+ * not wait for the disk.
+ */
+
+#define RING_SIZE           16384
+#define RING_MASK           (RING_SIZE - 1)
+#define DRAIN_INTERVAL_US   10000
+#define MAX_NESTING         8
+
+typedef struct {
+    UfoTraceRecord  records[RING_SIZE];
+    volatile gint   head;       /* Only written by the owning thread */
+    volatile gint   tail;       /* Only written by the drainer */
+    guint           index;      /* Shared by threads that reuse the ring */
+    GArray         *spill;
+    gpointer        current[MAX_NESTING];   /* Sources of unended begin records */
+    guint           depth;      /* May exceed MAX_NESTING */
+} Ring;
+
+typedef struct {
+    gint64          offset;     /* Add to device time to get host time */
+    guint           pid;
+    gchar          *name;
+} QueueClock;
+
+typedef struct {
+    guint           pid;
+    gchar          *name;
+} Device;
+
+typedef struct {
+    gpointer            source;
+    gpointer            target;
+    UfoTwoWayQueueStats stats;
+} Edge;
+
+typedef struct {
+    GPtrArray      *rings;
+    GSList         *free_rings; /* Rings of exited threads, still in rings */
+    guint           next_index;
+    GStaticMutex    lock;       /* Protects everything except fp and first */
+    GStaticMutex    file_lock;  /* Protects fp and first, taken after lock */
+    GThread        *drainer;
+    volatile gint   running;
+    volatile gint   n_dropped;
+    UfoTraceRecord *merged;
+    guint           n_merged;
+    GHashTable     *names;      /* Maps sources to thread names in the trace */
+    GHashTable     *queues;     /* Maps command queues to QueueClock */
+    GHashTable     *devices;    /* Maps devices to Device */
+    GArray         *edges;
+    FILE           *fp;
+    gboolean        first;
+    volatile gint   file_open;
+} Tracer;
+
+static Tracer tracer = {
+    .rings = NULL,
+    .free_rings = NULL,
+    .next_index = 0,
+    .lock = G_STATIC_MUTEX_INIT,
+    .file_lock = G_STATIC_MUTEX_INIT,
+    .drainer = NULL,
+    .running = 0,
+    .n_dropped = 0,
+    .merged = NULL,
+    .n_merged = 0,
+    .names = NULL,
+    .queues = NULL,
+    .devices = NULL,
+    .edges = NULL,
+    .fp = NULL,
+    .file_open = 0,
+};
+
+static GStaticPrivate thread_ring = G_STATIC_PRIVATE_INIT;
+
+static void stream_records (GString *events);
+static void flush_events (GString *events);
+
+guint64
+ufo_trace_now (void)
+{
+    struct timespec ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return ((guint64) ts.tv_sec) * 1000000000 + (guint64) ts.tv_nsec;
+}
+
+/* Must be called with tracer.lock held */
+static void
+drain_ring (Ring *ring)
+{
+    guint head;
+    guint tail;
+
+    head = (guint) g_atomic_int_get (&ring->head);
+    tail = (guint) ring->tail;
+
+    for (; tail != head; tail++)
+        g_array_append_val (ring->spill, ring->records[tail & RING_MASK]);
+
+    g_atomic_int_set (&ring->tail, (gint) tail);
+}
+
+/* Must be called with tracer.lock held */
+static void
+drain_all (void)
+{
+    if (tracer.rings == NULL)
+        return;
+
+    for (guint i = 0; i < tracer.rings->len; i++)
+        drain_ring (g_ptr_array_index (tracer.rings, i));
+}
+
+static gpointer
+drain_loop (gpointer unused)
+{
+    while (g_atomic_int_get (&tracer.running)) {
+        GString *events = NULL;
+
+        g_usleep (DRAIN_INTERVAL_US);
+        g_static_mutex_lock (&tracer.lock);
+        drain_all ();
+
+        if (g_atomic_int_get (&tracer.file_open)) {
+            events = g_string_new (NULL);
+            stream_records (events);
+        }
+
+        g_static_mutex_unlock (&tracer.lock);
+
+        if (events != NULL)
+            flush_events (events);
+    }
+
+    return NULL;
+}
+
+static FILE *
+open_trace_file (const gchar *filename)
+{
+    FILE *fp;
+
+    if (filename == NULL)
+        return NULL;
+
+    fp = fopen (filename, "w");
+
+    if (fp == NULL) {
+        g_warning ("Could not open trace file `%s': %s", filename, g_strerror (errno));
+        return NULL;
+    }
+
+    fprintf (fp, "{ \"traceEvents\": [");
+    return fp;
+}
+
+/* @tail is written before the event list is closed, it may be %NULL */
+static void
+close_trace_file (FILE *fp,
+                  const gchar *tail)
+{
+    if (fp == NULL)
+        return;
+
+    if (tail != NULL)
+        fputs (tail, fp);
+
+    fprintf (fp, "] }");
+    fclose (fp);
+}
+
+/*
+ * Write events formatted by the functions below to the trace file and free
+ * @events. Each event starts with a comma, which is skipped for the first
+ * event of the file.
+ */
+static void
+flush_events (GString *events)
+{
+    if (events->len > 0) {
+        g_static_mutex_lock (&tracer.file_lock);
+
+        if (tracer.fp != NULL) {
+            fputs (tracer.first ? events->str + 1 : events->str, tracer.fp);
+            tracer.first = FALSE;
+        }
+
+        g_static_mutex_unlock (&tracer.file_lock);
+    }
+
+    g_string_free (events, TRUE);
+}
+
+/* Append @s escaped for use in a JSON string */
+static void
+append_escaped (GString *str,
+                const gchar *s)
+{
+    for (; *s != '\0'; s++) {
+        guchar c = (guchar) *s;
+
+        if (c == '"' || c == '\\') {
+            g_string_append_c (str, '\\');
+            g_string_append_c (str, (gchar) c);
+        }
+        else if (c < 0x20)
+            g_string_append_printf (str, "\\u%04x", c);
+        else
+            g_string_append_c (str, (gchar) c);
+    }
+}
+
+/* Append a single event, @timestamp is in nanoseconds */
+static void
+write_event (GString *events,
+             gchar type,
+             guint64 timestamp,
+             gsize pid,
+             const gchar *tid,
+             const gchar *name)
+{
+    g_string_append_printf (events, ",{\"cat\":\"f\",\"ph\": \"%c\", \"ts\": %.0f, \"pid\": %zu, \"tid\": \"",
+                            type, timestamp * 1e-3, pid);
+    append_escaped (events, tid);
+    g_string_append (events, "\",\"name\": \"");
+    append_escaped (events, name);
+    g_string_append (events, "\", \"args\": {}}");
+}
+
+/* Append an event of known duration, timestamps are in nanoseconds */
+static void
+write_complete_event (GString *events,
+                      guint64 start,
+                      guint64 end,
+                      gsize pid,
+                      const gchar *tid,
+                      const gchar *name)
+{
+    g_string_append_printf (events, ",{\"cat\":\"f\",\"ph\": \"X\", \"ts\": %.0f, \"dur\": %.3f, \"pid\": %zu, \"tid\": \"",
+                            start * 1e-3, end > start ? (end - start) * 1e-3 : 0.0, pid);
+    append_escaped (events, tid);
+    g_string_append (events, "\",\"name\": \"");
+    append_escaped (events, name);
+    g_string_append (events, "\", \"args\": {}}");
+}
+
+static void
+write_process_name (GString *events,
+                    gsize pid,
+                    const gchar *name)
+{
+    g_string_append_printf (events, ",{\"ph\": \"M\", \"pid\": %zu, \"name\": \"process_name\", \"args\": {\"name\": \"", pid);
+    append_escaped (events, name);
+    g_string_append (events, "\"}}");
+}
+
+/* Must be called with tracer.lock held */
+static void
+write_edges (GString *str)
+{
+    gboolean first = TRUE;
+
+    g_string_append (str, "], \"ufoEdges\": [");
+
+    for (guint i = 0; i < tracer.edges->len; i++) {
+        Edge *edge = &g_array_index (tracer.edges, Edge, i);
+        const gchar *source;
+        const gchar *target;
+
+        source = tracer.names != NULL ? g_hash_table_lookup (tracer.names, edge->source) : NULL;
+        target = tracer.names != NULL ? g_hash_table_lookup (tracer.names, edge->target) : NULL;
+
+        if (source == NULL || target == NULL)
+            continue;
+
+        g_string_append_printf (str, "%s{\"source\": \"", first ? "" : ",");
+        append_escaped (str, source);
+        g_string_append (str, "\", \"target\": \"");
+        append_escaped (str, target);
+        g_string_append_printf (str, "\", \"items\": %" G_GUINT64_FORMAT ", "
+                                "\"max_occupancy\": %u, \"producer_blocked\": %.6f, \"consumer_blocked\": %.6f}",
+                                edge->stats.n_items, edge->stats.max_occupancy,
+                                edge->stats.producer_blocked, edge->stats.consumer_blocked);
+        first = FALSE;
+    }
+}
+
+static void
+free_queue_clock (QueueClock *clock)
+{
+    g_free (clock->name);
+    g_free (clock);
+}
+
+static void
+free_device (Device *device)
+{
+    g_free (device->name);
+    g_free (device);
+}
+
+/*
+ * Called when the owning thread exits. The records stay in the spill array
+ * until they are merged or written, the ring itself is reused by the next
+ * thread that records.
+ */
+static void
+retire_ring (Ring *ring)
+{
+    g_static_mutex_lock (&tracer.lock);
+    drain_ring (ring);
+    ring->depth = 0;
+    tracer.free_rings = g_slist_prepend (tracer.free_rings, ring);
+    g_static_mutex_unlock (&tracer.lock);
+}
+
+/* Must be called with tracer.lock held */
+static void
+free_retired_rings (void)
+{
+    GSList *it;
+
+    for (it = tracer.free_rings; it != NULL; it = g_slist_next (it)) {
+        Ring *ring = (Ring *) it->data;
+
+        g_ptr_array_remove (tracer.rings, ring);
+        g_array_free (ring->spill, TRUE);
+        g_free (ring);
+    }
+
+    g_slist_free (tracer.free_rings);
+    tracer.free_rings = NULL;
+}
+
+static Ring *
+get_thread_ring (void)
+{
+    Ring *ring;
+
+    ring = g_static_private_get (&thread_ring);
+
+    if (G_LIKELY (ring != NULL))
+        return ring;
+
+    g_static_mutex_lock (&tracer.lock);
+
+    if (tracer.free_rings != NULL) {
+        ring = tracer.free_rings->data;
+        tracer.free_rings = g_slist_delete_link (tracer.free_rings, tracer.free_rings);
+    }
+    else {
+        ring = g_new0 (Ring, 1);
+        ring->spill = g_array_new (FALSE, FALSE, sizeof (UfoTraceRecord));
+        ring->index = tracer.next_index++;
+
+        if (tracer.rings == NULL)
+            tracer.rings = g_ptr_array_new ();
+
+        g_ptr_array_add (tracer.rings, ring);
+    }
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    g_static_private_set (&thread_ring, ring, (GDestroyNotify) retire_ring);
+    return ring;
+}
+
+/*
+ * Record an event in the ring buffer of the calling thread. This function
+ * never blocks and does not allocate memory after the first call per thread.
+ */
+void
+ufo_trace_record (gpointer source,
+                  guint32 type)
+{
+    UfoTraceRecord *record;
+    Ring *ring;
+    guint head;
+
+    ring = get_thread_ring ();
+    head = (guint) ring->head;
+
+    if (type & UFO_TRACE_EVENT_BEGIN) {
+        if (ring->depth < MAX_NESTING)
+            ring->current[ring->depth] = source;
+
+        ring->depth++;
+    }
+    else if ((type & UFO_TRACE_EVENT_END) && ring->depth > 0)
+        ring->depth--;
+
+    if (head - (guint) g_atomic_int_get (&ring->tail) >= RING_SIZE) {
+        g_atomic_int_inc (&tracer.n_dropped);
+        return;
+    }
+
+    record = &ring->records[head & RING_MASK];
+    record->timestamp = ufo_trace_now ();
+    record->source = source;
+    record->type = type;
+    record->thread = ring->index;
+
+    /* Publishes the record to the drainer */
+    g_atomic_int_set (&ring->head, (gint) (head + 1));
+}
+
+/*
+ * Get the source of the innermost begin record of the calling thread that was
+ * not ended yet, i.e. the task whose process or generate call is running.
+ * Beyond a nesting depth of MAX_NESTING, the deepest stored source is returned.
+ */
+gpointer
+ufo_trace_get_current_source (void)
+{
+    Ring *ring;
+
+    ring = g_static_private_get (&thread_ring);
+
+    if (ring == NULL || ring->depth == 0)
+        return NULL;
+
+    return ring->current[MIN (ring->depth, MAX_NESTING) - 1];
+}
+
+/*
+ * Discard previously recorded data and start draining ring buffers in the
+ * background. If @filename is given, records and the events passed to
+ * ufo_trace_write_device_event() are written to that file instead of being
+ * kept in memory.
+ */
+void
+ufo_trace_start (const gchar *filename)
+{
+    GString *events;
+    FILE *fp;
+    FILE *old_fp;
+
+    fp = open_trace_file (filename);
+    events = g_string_new (NULL);
+
+    g_static_mutex_lock (&tracer.lock);
+
+    drain_all ();
+
+    if (tracer.rings != NULL) {
+        for (guint i = 0; i < tracer.rings->len; i++) {
+            Ring *ring = g_ptr_array_index (tracer.rings, i);
+            g_array_set_size (ring->spill, 0);
+        }
+
+        free_retired_rings ();
+    }
+
+    g_free (tracer.merged);
+    tracer.merged = NULL;
+    tracer.n_merged = 0;
+    g_atomic_int_set (&tracer.n_dropped, 0);
+
+    if (fp != NULL) {
+        write_process_name (events, 0, "host");
+
+        if (tracer.devices != NULL) {
+            GHashTableIter iter;
+            Device *device;
+
+            g_hash_table_iter_init (&iter, tracer.devices);
+
+            while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &device))
+                write_process_name (events, device->pid, device->name);
+        }
+    }
+
+    g_static_mutex_lock (&tracer.file_lock);
+    old_fp = tracer.fp;
+    tracer.fp = fp;
+    tracer.first = TRUE;
+    g_atomic_int_set (&tracer.file_open, fp != NULL);
+    g_static_mutex_unlock (&tracer.file_lock);
+
+    if (tracer.drainer == NULL) {
+        g_atomic_int_set (&tracer.running, 1);
+        tracer.drainer = g_thread_create (drain_loop, NULL, TRUE, NULL);
+    }
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    close_trace_file (old_fp, NULL);
+    flush_events (events);
+}
+
+/*
+ * Stop the background drainer and move all remaining records out of the ring
+ * buffers. Trace files are completed and closed.
+ */
+void
+ufo_trace_stop (void)
+{
+    GThread *drainer;
+    GString *events;
+    GString *edges = NULL;
+    FILE *fp;
+
+    g_static_mutex_lock (&tracer.lock);
+    drainer = tracer.drainer;
+    tracer.drainer = NULL;
+    g_atomic_int_set (&tracer.running, 0);
+    g_static_mutex_unlock (&tracer.lock);
+
+    if (drainer != NULL)
+        g_thread_join (drainer);
+
+    events = g_string_new (NULL);
+
+    g_static_mutex_lock (&tracer.lock);
+    drain_all ();
+
+    if (g_atomic_int_get (&tracer.file_open)) {
+        stream_records (events);
+
+        if (tracer.edges != NULL && tracer.edges->len > 0) {
+            edges = g_string_new (NULL);
+            write_edges (edges);
+        }
+    }
+
+    if (tracer.edges != NULL)
+        g_array_set_size (tracer.edges, 0);
+
+    if (tracer.names != NULL)
+        g_hash_table_remove_all (tracer.names);
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    flush_events (events);
+
+    g_static_mutex_lock (&tracer.file_lock);
+    fp = tracer.fp;
+    tracer.fp = NULL;
+    g_atomic_int_set (&tracer.file_open, 0);
+    g_static_mutex_unlock (&tracer.file_lock);
+
+    close_trace_file (fp, edges != NULL ? edges->str : NULL);
+
+    if (edges != NULL)
+        g_string_free (edges, TRUE);
+}
+
+/*
+ * Name the thread in which records of @source are shown in the trace file.
+ * Records of sources without a name are not written.
+ */
+void
+ufo_trace_set_source_name (gpointer source,
+                           const gchar *name)
+{
+    g_static_mutex_lock (&tracer.lock);
+
+    if (tracer.names == NULL)
+        tracer.names = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, g_free);
+
+    g_hash_table_insert (tracer.names, source, g_strdup (name));
+    g_static_mutex_unlock (&tracer.lock);
+}
+
+/*
+ * Write the number of bytes that @source has allocated on @device, which is
+ * %NULL for host memory. Nothing is written for unregistered devices.
+ */
+void
+ufo_trace_write_counter (gconstpointer device,
+                         gpointer source,
+                         guint64 value)
+{
+    const gchar *node;
+    Device *entry = NULL;
+    GString *events = NULL;
+
+    g_static_mutex_lock (&tracer.lock);
+
+    node = tracer.names != NULL ? g_hash_table_lookup (tracer.names, source) : NULL;
+
+    if (device != NULL && tracer.devices != NULL)
+        entry = g_hash_table_lookup (tracer.devices, device);
+
+    if (g_atomic_int_get (&tracer.file_open) && node != NULL && (device == NULL || entry != NULL)) {
+        events = g_string_new (NULL);
+        g_string_append_printf (events, ",{\"ph\": \"C\", \"ts\": %.0f, \"pid\": %u, \"name\": \"memory ",
+                                ufo_trace_now () * 1e-3, entry != NULL ? entry->pid : 0);
+        append_escaped (events, node);
+        g_string_append_printf (events, "\", \"args\": {\"bytes\": %" G_GUINT64_FORMAT "}}", value);
+    }
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    if (events != NULL)
+        flush_events (events);
+}
+
+/*
+ * Add the statistics of the queue from @source to @target to the trace file.
+ * Edges are written by ufo_trace_stop(), using the names of both sources.
+ */
+void
+ufo_trace_add_edge (gpointer source,
+                    gpointer target,
+                    const UfoTwoWayQueueStats *stats)
+{
+    Edge edge;
+
+    edge.source = source;
+    edge.target = target;
+    edge.stats = *stats;
+
+    g_static_mutex_lock (&tracer.lock);
+
+    if (tracer.edges == NULL)
+        tracer.edges = g_array_new (FALSE, FALSE, sizeof (Edge));
+
+    g_array_append_val (tracer.edges, edge);
+    g_static_mutex_unlock (&tracer.lock);
+}
+
+/*
+ * Register a command queue of @device whose commands are written to the trace.
+ * @offset is the host time minus the device time in nanoseconds. Registering
+ * a queue again replaces its offset, e.g. to account for clock drift.
+ */
+void
+ufo_trace_register_queue (gconstpointer queue,
+                          gconstpointer device,
+                          const gchar *device_name,
+                          const gchar *queue_name,
+                          gint64 offset)
+{
+    QueueClock *clock;
+    Device *entry;
+    GString *events = NULL;
+
+    g_static_mutex_lock (&tracer.lock);
+
+    if (tracer.queues == NULL) {
+        tracer.queues = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_queue_clock);
+        tracer.devices = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL, (GDestroyNotify) free_device);
+    }
+
+    entry = g_hash_table_lookup (tracer.devices, device);
+
+    if (entry == NULL) {
+        entry = g_new0 (Device, 1);
+        entry->pid = g_hash_table_size (tracer.devices) + 1;
+        entry->name = g_strdup_printf ("device-%u %s", entry->pid - 1, device_name);
+        g_hash_table_insert (tracer.devices, (gpointer) device, entry);
+
+        if (g_atomic_int_get (&tracer.file_open)) {
+            events = g_string_new (NULL);
+            write_process_name (events, entry->pid, entry->name);
+        }
+    }
+
+    clock = g_new0 (QueueClock, 1);
+    clock->offset = offset;
+    clock->pid = entry->pid;
+    clock->name = g_strdup (queue_name);
+    g_hash_table_insert (tracer.queues, (gpointer) queue, clock);
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    if (events != NULL)
+        flush_events (events);
+}
+
+/*
+ * Forget @queue, must be called before the queue is released.
+ */
+void
+ufo_trace_unregister_queue (gconstpointer queue)
+{
+    g_static_mutex_lock (&tracer.lock);
+
+    if (tracer.queues != NULL)
+        g_hash_table_remove (tracer.queues, queue);
+
+    g_static_mutex_unlock (&tracer.lock);
+}
+
+/*
+ * Returns: %TRUE if a trace file is open and commands of @queue can be written
+ * with ufo_trace_write_device_event().
+ */
+gboolean
+ufo_trace_is_tracing_queue (gconstpointer queue)
+{
+    gboolean tracing;
+
+    /* Called for every transfer, avoid the lock when not tracing to a file */
+    if (!g_atomic_int_get (&tracer.file_open))
+        return FALSE;
+
+    g_static_mutex_lock (&tracer.lock);
+    tracing = tracer.queues != NULL && g_hash_table_lookup (tracer.queues, queue) != NULL;
+    g_static_mutex_unlock (&tracer.lock);
+
+    return tracing;
+}
+
+/*
+ * Write the execution of an OpenCL command issued by @source to the trace
+ * file. Timestamps are in nanoseconds of the device clock and mapped to host
+ * time with the offset of @queue.
+ *
+ * Returns: %FALSE if no trace file is open or @queue was not registered and
+ * the caller has to keep the event itself.
+ */
+gboolean
+ufo_trace_write_device_event (const gchar *name,
+                              gconstpointer queue,
+                              gpointer source,
+                              guint64 start,
+                              guint64 end)
+{
+    QueueClock *clock;
+    GString *events = NULL;
+
+    if (!g_atomic_int_get (&tracer.file_open))
+        return FALSE;
+
+    g_static_mutex_lock (&tracer.lock);
+
+    clock = tracer.queues != NULL ? g_hash_table_lookup (tracer.queues, queue) : NULL;
+
+    if (clock != NULL) {
+        const gchar *node;
+        gchar *tid;
+
+        node = tracer.names != NULL && source != NULL ? g_hash_table_lookup (tracer.names, source) : NULL;
+
+        /* Threads are sorted by name, which groups them by queue first */
+        tid = node != NULL ? g_strdup_printf ("%s/%s", clock->name, node) : g_strdup (clock->name);
+
+        events = g_string_new (NULL);
+        write_complete_event (events,
+                              (guint64) ((gint64) start + clock->offset),
+                              (guint64) ((gint64) end + clock->offset),
+                              clock->pid, tid, name);
+        g_free (tid);
+    }
+
+    g_static_mutex_unlock (&tracer.lock);
+
+    if (events == NULL)
+        return FALSE;
+
+    flush_events (events);
+    return TRUE;
+}
+
+static gboolean
+record_less (const UfoTraceRecord *a,
+             const UfoTraceRecord *b)
+{
+    if (a->timestamp != b->timestamp)
+        return a->timestamp < b->timestamp;
+
+    /* Order by type so that begin records come before end records */
+    return a->type < b->type;
+}
+
+typedef struct {
+    const UfoTraceRecord *current;
+    const UfoTraceRecord *end;
+} Cursor;
+
+static void
+sift_down (Cursor *heap, guint n, guint i)
+{
+    for (;;) {
+        guint smallest = i;
+        guint left = 2 * i + 1;
+        guint right = 2 * i + 2;
+        Cursor tmp;
+
+        if (left < n && record_less (heap[left].current, heap[smallest].current))
+            smallest = left;
+
+        if (right < n && record_less (heap[right].current, heap[smallest].current))
+            smallest = right;
+
+        if (smallest == i)
+            return;
+
+        tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+/* Must be called with tracer.lock held */
+static void
+merge_spills (void)
+{
+    Cursor *heap;
+    UfoTraceRecord *merged;
+    guint n_cursors = 0;
+    guint n_total = tracer.n_merged;
+    guint n = 0;
+
+    if (tracer.rings == NULL)
+        return;
+
+    heap = g_new0 (Cursor, tracer.rings->len + 1);
+
+    /* Records merged by a previous call form one more sorted run */
+    if (tracer.n_merged > 0) {
+        heap[n_cursors].current = tracer.merged;
+        heap[n_cursors].end = tracer.merged + tracer.n_merged;
+        n_cursors++;
+    }
+
+    for (guint i = 0; i < tracer.rings->len; i++) {
+        Ring *ring = g_ptr_array_index (tracer.rings, i);
+
+        if (ring->spill->len == 0)
+            continue;
+
+        heap[n_cursors].current = (UfoTraceRecord *) ring->spill->data;
+        heap[n_cursors].end = heap[n_cursors].current + ring->spill->len;
+        n_total += ring->spill->len;
+        n_cursors++;
+    }
+
+    if (n_total == tracer.n_merged) {
+        g_free (heap);
+        return;
+    }
+
+    merged = g_new (UfoTraceRecord, n_total);
+
+    for (gint i = (gint) n_cursors / 2 - 1; i >= 0; i--)
+        sift_down (heap, n_cursors, (guint) i);
+
+    while (n_cursors > 0) {
+        merged[n++] = *heap[0].current;
+        heap[0].current++;
+
+        if (heap[0].current == heap[0].end)
+            heap[0] = heap[--n_cursors];
+
+        sift_down (heap, n_cursors, 0);
+    }
+
+    for (guint i = 0; i < tracer.rings->len; i++) {
+        Ring *ring = g_ptr_array_index (tracer.rings, i);
+        g_array_set_size (ring->spill, 0);
+    }
+
+    g_free (tracer.merged);
+    g_free (heap);
+    tracer.merged = merged;
+    tracer.n_merged = n_total;
+}
+
+/* Must be called with tracer.lock held, appends all records to @events */
+static void
+stream_records (GString *events)
+{
+    merge_spills ();
+
+    for (guint i = 0; i < tracer.n_merged; i++) {
+        const UfoTraceRecord *record = &tracer.merged[i];
+        const gchar *tid;
+
+        tid = tracer.names != NULL ? g_hash_table_lookup (tracer.names, record->source) : NULL;
+
+        if (tid == NULL)
+            continue;
+
+        write_event (events,
+                     record->type & UFO_TRACE_EVENT_BEGIN ? 'B' : 'E',
+                     record->timestamp, 0, tid,
+                     record->type & UFO_TRACE_EVENT_PROCESS ? "process" : "generate");
+    }
+
+    g_free (tracer.merged);
+    tracer.merged = NULL;
+    tracer.n_merged = 0;
+}
+
+/*
+ * Get all records since the last ufo_trace_start() ordered by time. Records
+ * that were already written to a trace file are not returned.
+ *
+ * Returns: A copy of the records, free it with g_free().
+ */
+UfoTraceRecord *
+ufo_trace_get_records (guint *n_records)
+{
+    UfoTraceRecord *records;
+
+    g_static_mutex_lock (&tracer.lock);
+    drain_all ();
+    merge_spills ();
+    records = g_memdup (tracer.merged, tracer.n_merged * sizeof (UfoTraceRecord));
+    *n_records = tracer.n_merged;
+    g_static_mutex_unlock (&tracer.lock);
+
+    return records;
+}
+
+/*
+ * Returns: Number of records that were dropped because a ring was full.
+ */
+guint
+ufo_trace_get_num_dropped (void)
+{
+    return (guint) g_atomic_int_get (&tracer.n_dropped);
+}
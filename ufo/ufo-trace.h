@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2011-2013 Karlsruhe Institute of Technology
+ *
+ * This file is part of Ufo.
+ *
+ * This library is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, either
+ * version 3 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UFO_TRACE_H
+#define UFO_TRACE_H
+
+#include <glib.h>
+#include <ufo/ufo-two-way-queue.h>
+
+/*
+ * Packed trace record as stored in the per-thread ring buffers. @timestamp is
+ * taken from the monotonic clock in nanoseconds, @source identifies the
+ * emitter, usually a UfoProfiler. @thread is the index of the ring buffer the
+ * record was written to. A ring is owned by one thread at a time but may be
+ * reused by a later thread once its owner has exited.
+ */
+typedef struct {
+    guint64     timestamp;
+    gpointer    source;
+    guint32     type;
+    guint32     thread;
+} UfoTraceRecord;
+
+void            ufo_trace_start         (const gchar    *filename);
+void            ufo_trace_stop          (void);
+void            ufo_trace_set_source_name
+                                        (gpointer        source,
+                                         const gchar    *name);
+void            ufo_trace_write_counter (gconstpointer   device,
+                                         gpointer        source,
+                                         guint64         value);
+void            ufo_trace_add_edge      (gpointer        source,
+                                         gpointer        target,
+                                         const UfoTwoWayQueueStats *stats);
+void            ufo_trace_register_queue
+                                        (gconstpointer   queue,
+                                         gconstpointer   device,
+                                         const gchar    *device_name,
+                                         const gchar    *queue_name,
+                                         gint64          offset);
+void            ufo_trace_unregister_queue
+                                        (gconstpointer   queue);
+gboolean        ufo_trace_is_tracing_queue
+                                        (gconstpointer   queue);
+gboolean        ufo_trace_write_device_event
+                                        (const gchar    *name,
+                                         gconstpointer   queue,
+                                         gpointer        source,
+                                         guint64         start,
+                                         guint64         end);
+void            ufo_trace_record        (gpointer        source,
+                                         guint32         type);
+gpointer        ufo_trace_get_current_source
+                                        (void);
+guint64         ufo_trace_now           (void);
+UfoTraceRecord *ufo_trace_get_records   (guint          *n_records);
+guint           ufo_trace_get_num_dropped
+                                        (void);
+
+#endif
@@ -25,8 +25,54 @@ struct _UfoTwoWayQueue {
     GAsyncQueue *producer_queue;
     GAsyncQueue *consumer_queue;
     guint capacity;
+    guint n_spins;
+
+    /* Each statistic is only written by either the producer or the consumer */
+    guint64 n_items;
+    guint max_occupancy;
+    gint64 consumer_blocked;
+    gint64 producer_blocked;
 };
 
+/* Polls without yielding before the spinning thread gives up its time slice */
+#define TIGHT_SPIN_COUNT    64
+
+static gpointer
+pop_spinning (GAsyncQueue *queue,
+              guint n_spins,
+              gint64 *blocked)
+{
+    gpointer data;
+    gint64 start;
+
+    /* Only pay for the clock if we actually have to wait */
+    data = g_async_queue_try_pop (queue);
+
+    if (data != NULL)
+        return data;
+
+    start = g_get_monotonic_time ();
+
+    /*
+     * Poll the queue a bounded number of times before falling back to a
+     * blocking pop. This avoids the sleep/wake round trip when the other side
+     * hands over an item within a few microseconds. After the first polls,
+     * yield between them so that the other side can run on a busy machine.
+     */
+    for (guint i = 0; i < n_spins && data == NULL; i++) {
+        if (i >= TIGHT_SPIN_COUNT)
+            g_thread_yield ();
+
+        data = g_async_queue_try_pop (queue);
+    }
+
+    if (data == NULL)
+        data = g_async_queue_pop (queue);
+
+    *blocked += g_get_monotonic_time () - start;
+    return data;
+}
+
 /**
  * ufo_two_way_queue_new: (skip)
  * @init: (element-type gpointer): List with elements inserted into
@@ -46,6 +92,11 @@ ufo_two_way_queue_new (GList *init)
     queue->producer_queue = g_async_queue_new ();
     queue->consumer_queue = g_async_queue_new ();
     queue->capacity = 0;
+    queue->n_spins = 0;
+    queue->n_items = 0;
+    queue->max_occupancy = 0;
+    queue->consumer_blocked = 0;
+    queue->producer_blocked = 0;
 
     g_list_for (init, it) {
         ufo_two_way_queue_insert (queue, it->data);
@@ -73,7 +124,21 @@ ufo_two_way_queue_free (UfoTwoWayQueue *queue)
 gpointer
 ufo_two_way_queue_consumer_pop (UfoTwoWayQueue *queue)
 {
-    return g_async_queue_pop (queue->consumer_queue);
+    return pop_spinning (queue->consumer_queue, queue->n_spins, &queue->consumer_blocked);
+}
+
+/**
+ * ufo_two_way_queue_consumer_try_pop:
+ * @queue: A #UfoTwoWayQueue
+ *
+ * Fetch an item for consumption without blocking.
+ *
+ * Returns: (transfer none): A consumable item or %NULL if none is available.
+ */
+gpointer
+ufo_two_way_queue_consumer_try_pop (UfoTwoWayQueue *queue)
+{
+    return g_async_queue_try_pop (queue->consumer_queue);
 }
 
 void
@@ -93,13 +158,59 @@ ufo_two_way_queue_consumer_push (UfoTwoWayQueue *queue, gpointer data)
 gpointer
 ufo_two_way_queue_producer_pop (UfoTwoWayQueue *queue)
 {
-    return g_async_queue_pop (queue->producer_queue);
+    return pop_spinning (queue->producer_queue, queue->n_spins, &queue->producer_blocked);
+}
+
+/**
+ * ufo_two_way_queue_producer_try_pop:
+ * @queue: A #UfoTwoWayQueue
+ *
+ * Fetch an item for production without blocking.
+ *
+ * Returns: (transfer none): A producable item or %NULL if none is available.
+ */
+gpointer
+ufo_two_way_queue_producer_try_pop (UfoTwoWayQueue *queue)
+{
+    return g_async_queue_try_pop (queue->producer_queue);
 }
 
 void
 ufo_two_way_queue_producer_push (UfoTwoWayQueue *queue, gpointer data)
 {
+    gint occupancy;
+
     g_async_queue_push (queue->consumer_queue, data);
+    queue->n_items++;
+
+    /* Items minus waiting consumers, i.e. what is actually piling up */
+    occupancy = g_async_queue_length (queue->consumer_queue);
+
+    if (occupancy > 0 && (guint) occupancy > queue->max_occupancy)
+        queue->max_occupancy = (guint) occupancy;
+}
+
+/**
+ * ufo_two_way_queue_producer_reclaim:
+ * @queue: A #UfoTwoWayQueue
+ *
+ * Take back the oldest item that was pushed but not consumed yet, for example
+ * to drop it in favour of a newer one. Must be called by the producer. The
+ * item is no longer counted as transferred.
+ *
+ * Returns: (transfer none): The oldest pushed item or %NULL if none is waiting.
+ */
+gpointer
+ufo_two_way_queue_producer_reclaim (UfoTwoWayQueue *queue)
+{
+    gpointer data;
+
+    data = g_async_queue_try_pop (queue->consumer_queue);
+
+    if (data != NULL)
+        queue->n_items--;
+
+    return data;
 }
 
 void
@@ -114,3 +225,42 @@ ufo_two_way_queue_get_capacity (UfoTwoWayQueue *queue)
 {
     return queue->capacity;
 }
+
+/**
+ * ufo_two_way_queue_set_spin_count:
+ * @queue: A #UfoTwoWayQueue
+ * @n_spins: Number of non-blocking polls before blocking
+ *
+ * Let both consumer and producer pops poll the queue @n_spins times before
+ * going to sleep. A value of 0 (the default) blocks immediately. Beyond the
+ * first few polls, the calling thread yields between polls.
+ */
+void
+ufo_two_way_queue_set_spin_count (UfoTwoWayQueue *queue,
+                                  guint n_spins)
+{
+    queue->n_spins = n_spins;
+}
+
+/**
+ * ufo_two_way_queue_get_stats:
+ * @queue: A #UfoTwoWayQueue
+ * @stats: (out): Location for the statistics
+ *
+ * Get the number of transferred items, the high-water occupancy and the time
+ * both sides spent waiting. This can be called while the queue is in use, in
+ * which case the values are approximate.
+ */
+void
+ufo_two_way_queue_get_stats (UfoTwoWayQueue *queue,
+                             UfoTwoWayQueueStats *stats)
+{
+    gint occupancy;
+
+    occupancy = g_async_queue_length (queue->consumer_queue);
+    stats->n_items = queue->n_items;
+    stats->occupancy = (guint) MAX (occupancy, 0);
+    stats->max_occupancy = queue->max_occupancy;
+    stats->consumer_blocked = queue->consumer_blocked * 1e-6;
+    stats->producer_blocked = queue->producer_blocked * 1e-6;
+}
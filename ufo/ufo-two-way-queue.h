@@ -30,17 +30,47 @@ G_BEGIN_DECLS
 
 typedef struct _UfoTwoWayQueue          UfoTwoWayQueue;
 
+/**
+ * UfoTwoWayQueueStats:
+ * @n_items: Number of items pushed by the producer and not reclaimed
+ * @occupancy: Number of items currently waiting for the consumer
+ * @max_occupancy: Maximum number of items that waited for the consumer
+ * @consumer_blocked: Time in seconds the consumer waited for an item
+ * @producer_blocked: Time in seconds the producer waited for a free item
+ *
+ * Statistics of a #UfoTwoWayQueue. A consumer that is blocked for a long time
+ * is starved, a producer that is blocked for a long time is held back by a
+ * slow consumer.
+ */
+typedef struct {
+    guint64     n_items;
+    guint       occupancy;
+    guint       max_occupancy;
+    gdouble     consumer_blocked;
+    gdouble     producer_blocked;
+} UfoTwoWayQueueStats;
+
 UfoTwoWayQueue  * ufo_two_way_queue_new             (GList *init);
 void              ufo_two_way_queue_free            (UfoTwoWayQueue *queue);
 gpointer          ufo_two_way_queue_consumer_pop    (UfoTwoWayQueue *queue);
+gpointer          ufo_two_way_queue_consumer_try_pop
+                                                    (UfoTwoWayQueue *queue);
 void              ufo_two_way_queue_consumer_push   (UfoTwoWayQueue *queue,
                                                      gpointer data);
 gpointer          ufo_two_way_queue_producer_pop    (UfoTwoWayQueue *queue);
+gpointer          ufo_two_way_queue_producer_try_pop
+                                                    (UfoTwoWayQueue *queue);
 void              ufo_two_way_queue_producer_push   (UfoTwoWayQueue *queue,
                                                      gpointer data);
+gpointer          ufo_two_way_queue_producer_reclaim
+                                                    (UfoTwoWayQueue *queue);
 void              ufo_two_way_queue_insert          (UfoTwoWayQueue *queue,
                                                      gpointer data);
 guint             ufo_two_way_queue_get_capacity    (UfoTwoWayQueue *queue);
+void              ufo_two_way_queue_set_spin_count  (UfoTwoWayQueue *queue,
+                                                     guint n_spins);
+void              ufo_two_way_queue_get_stats       (UfoTwoWayQueue *queue,
+                                                     UfoTwoWayQueueStats *stats);
 
 G_END_DECLS
 
@@ -39,6 +39,7 @@
 #include <ufo/ufo-method-iface.h>
 #include <ufo/ufo-misc.h>
 #include <ufo/ufo-node.h>
+#include <ufo/ufo-op-expr.h>
 #include <ufo/ufo-output-task.h>
 #include <ufo/ufo-plugin-manager.h>
 #include <ufo/ufo-processor.h>
@@ -47,6 +48,7 @@
 #include <ufo/ufo-remote-task.h>
 #include <ufo/ufo-resources.h>
 #include <ufo/ufo-scheduler.h>
+#include <ufo/ufo-synthetic-task.h>
 #include <ufo/ufo-task-graph.h>
 #include <ufo/ufo-task-iface.h>
 #include <ufo/ufo-task-node.h>